@@ -0,0 +1,532 @@
+#include <sodium.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ThorpCycleWalking.hpp"
+#include "ThorpKeySet.hpp"
+#include "ThorpMemo.hpp"
+#include "ThorpParallel.hpp"
+#include "ThorpShuffler.hpp"
+#include "ThorpWideShuffler.hpp"
+
+// throughput and latency of both obfuscators over a matrix of domains, passes, optimization levels,
+// batch sizes and thread counts (for parallel_encrypt the size of the pool). the results are written as json or csv so runs of different versions can be diffed.
+//
+// usage: bench [--format json|csv] [--output file] [--quick] [--min-time-ms n]
+//              [--round-functions blake2b,aes128,siphash24] [--threads 1,2,4] [--batches 1,8,64,1024]
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    struct Options {
+        std::string format = "json";
+        std::string output;
+        bool quick = false;
+        double min_time_ms = 20;
+        std::vector<thorp::RoundFunction> round_functions{ thorp::RoundFunction::blake2b };
+        std::vector<unsigned> threads{ 1 };
+        std::vector<std::size_t> batches{ 1, 8, 64, 1024 };
+    };
+
+    struct Record {
+        std::string obfuscator;
+        std::string round_function;
+        std::string operation;
+        uint64_t max_message;      // the lower 64 bits of it for the 128 bit domains.
+        unsigned domain_bits;
+        uint64_t npasses;
+        uint64_t optimization_level; // 0 for the ThorpObfuscator
+        std::size_t batch;
+        unsigned threads;
+        std::size_t samples;
+        double ns_per_op;
+        double ops_per_s;
+        double p50_ns;
+        double p90_ns;
+        double p99_ns;
+    };
+
+    // the per sample timings of all threads, each sample covers ops_per_sample operations.
+    struct Measurement {
+        std::vector<double> sample_ns;
+        uint64_t ops_per_sample;
+        double wall_ns;
+    };
+
+    const char* round_function_name(thorp::RoundFunction round_function)
+    {
+        switch (round_function) {
+        case thorp::RoundFunction::aes128: return "aes128";
+        case thorp::RoundFunction::siphash24: return "siphash24";
+        default: return "blake2b";
+        };
+    }
+
+    template <class T, class Parse>
+    std::vector<T> parse_list(const std::string& list, Parse parse)
+    {
+        std::vector<T> values;
+        std::stringstream stream{ list };
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            values.push_back(parse(item));
+        };
+        return values;
+    }
+
+    thorp::RoundFunction parse_round_function(const std::string& name)
+    {
+        if (name == "aes128") return thorp::RoundFunction::aes128;
+        if (name == "siphash24") return thorp::RoundFunction::siphash24;
+        if (name == "blake2b") return thorp::RoundFunction::blake2b;
+        throw std::invalid_argument("unknown round function " + name);
+    }
+
+    Options parse_options(int argc, char** argv)
+    {
+        Options options;
+        for (int iarg = 1; iarg < argc; ++iarg) {
+            const std::string arg = argv[iarg];
+            auto value = [&]() -> std::string {
+                if (iarg + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+                return argv[++iarg];
+            };
+            if (arg == "--format") options.format = value();
+            else if (arg == "--output") options.output = value();
+            else if (arg == "--quick") options.quick = true;
+            else if (arg == "--min-time-ms") options.min_time_ms = std::stod(value());
+            else if (arg == "--round-functions") options.round_functions = parse_list<thorp::RoundFunction>(value(), parse_round_function);
+            else if (arg == "--threads") options.threads = parse_list<unsigned>(value(), [](const std::string& s) { return static_cast<unsigned>(std::stoul(s)); });
+            else if (arg == "--batches") options.batches = parse_list<std::size_t>(value(), [](const std::string& s) { return static_cast<std::size_t>(std::stoull(s)); });
+            else throw std::invalid_argument("unknown argument " + arg);
+        };
+        if (options.format != "json" && options.format != "csv") {
+            throw std::invalid_argument("unknown format " + options.format);
+        };
+        return options;
+    }
+
+    // messages spread over the domain, all domains of the benchmark are of the form 2^n.
+    std::vector<uint64_t> make_messages(std::size_t count, uint64_t max_message, uint64_t seed)
+    {
+        std::vector<uint64_t> messages(count);
+        uint64_t state = seed * 0x9e3779b97f4a7c15ull + 1;
+        for (uint64_t& message : messages) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            message = state & max_message;
+        };
+        return messages;
+    }
+
+    // runs sample(ithread, isample) on nthreads threads until min_time has passed on each of them.
+    template <class Sample>
+    Measurement measure(Sample&& sample, uint64_t ops_per_sample, unsigned nthreads, double min_time_ms)
+    {
+        constexpr std::size_t min_samples = 5;
+        const auto min_time = std::chrono::duration<double, std::milli>(min_time_ms);
+        std::vector<std::vector<double>> thread_samples(nthreads);
+        std::vector<double> thread_wall_ns(nthreads);
+        auto run = [&](unsigned ithread) {
+            const clock_type::time_point start = clock_type::now();
+            clock_type::time_point now = start;
+            for (std::size_t isample = 0; isample < min_samples || now - start < min_time; ++isample) {
+                const clock_type::time_point before = clock_type::now();
+                sample(ithread, isample);
+                now = clock_type::now();
+                thread_samples[ithread].push_back(std::chrono::duration<double, std::nano>(now - before).count());
+            };
+            thread_wall_ns[ithread] = std::chrono::duration<double, std::nano>(now - start).count();
+        };
+        std::vector<std::thread> threads;
+        for (unsigned ithread = 1; ithread < nthreads; ++ithread) {
+            threads.emplace_back(run, ithread);
+        };
+        run(0);
+        for (std::thread& thread : threads) {
+            thread.join();
+        };
+        Measurement measurement{ {}, ops_per_sample, *std::max_element(thread_wall_ns.begin(), thread_wall_ns.end()) };
+        for (const std::vector<double>& samples : thread_samples) {
+            measurement.sample_ns.insert(measurement.sample_ns.end(), samples.begin(), samples.end());
+        };
+        return measurement;
+    }
+
+    double percentile(std::vector<double>& sorted, double fraction)
+    {
+        const std::size_t index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[index];
+    }
+
+    // the percentiles are per operation, so samples of a batch are divided by the batch size.
+    Record make_record(Record record, Measurement measurement)
+    {
+        std::vector<double>& samples = measurement.sample_ns;
+        const double ops_per_sample = static_cast<double>(measurement.ops_per_sample);
+        double total_ns = 0;
+        for (double& sample : samples) {
+            total_ns += sample;
+            sample /= ops_per_sample;
+        };
+        std::sort(samples.begin(), samples.end());
+        const double total_ops = ops_per_sample * static_cast<double>(samples.size());
+        record.samples = samples.size();
+        record.ns_per_op = total_ns / total_ops;
+        record.ops_per_s = total_ops / measurement.wall_ns * 1e9;
+        record.p50_ns = percentile(samples, 0.5);
+        record.p90_ns = percentile(samples, 0.9);
+        record.p99_ns = percentile(samples, 0.99);
+        return record;
+    }
+
+    // encrypt/decrypt one at a time and in batches on all thread counts.
+    template <class Obfuscator>
+    void bench_operations(const Obfuscator& obfuscator, const Record& base, const Options& options, std::vector<Record>& records)
+    {
+        const std::size_t nmessages = 4096;
+        const uint64_t max_message = base.max_message;
+        for (unsigned nthreads : options.threads) {
+            std::vector<std::vector<uint64_t>> messages(nthreads);
+            std::vector<std::vector<uint64_t>> results(nthreads);
+            for (unsigned ithread = 0; ithread < nthreads; ++ithread) {
+                messages[ithread] = make_messages(nmessages, max_message, ithread + 1);
+                results[ithread].resize(nmessages);
+            };
+            Record record = base;
+            record.threads = nthreads;
+            record.batch = 1;
+            record.operation = "encrypt";
+            records.push_back(make_record(record, measure([&](unsigned ithread, std::size_t isample) {
+                results[ithread][isample % nmessages] = obfuscator.encrypt(messages[ithread][isample % nmessages]);
+                }, 1, nthreads, options.min_time_ms)));
+            record.operation = "decrypt";
+            records.push_back(make_record(record, measure([&](unsigned ithread, std::size_t isample) {
+                results[ithread][isample % nmessages] = obfuscator.decrypt(messages[ithread][isample % nmessages]);
+                }, 1, nthreads, options.min_time_ms)));
+            // one span split over a pool of nthreads workers, the scaling of parallel_encrypt.
+            {
+                const std::vector<uint64_t> span = make_messages(1 << 18, max_message, 1);
+                std::vector<uint64_t> span_results(span.size());
+                thorp::WorkStealingPool pool{ nthreads };
+                record.batch = span.size();
+                record.operation = "parallel_encrypt";
+                records.push_back(make_record(record, measure([&](unsigned, std::size_t) {
+                    thorp::parallel_encrypt(obfuscator, span.data(), span_results.data(), span.size(), pool);
+                    }, span.size(), 1, options.min_time_ms)));
+            };
+            for (std::size_t batch : options.batches) {
+                const std::size_t nbatches = std::max<std::size_t>(nmessages / batch, 1);
+                if (batch > nmessages) continue;
+                record.batch = batch;
+                record.operation = "encrypt_batch";
+                records.push_back(make_record(record, measure([&](unsigned ithread, std::size_t isample) {
+                    const std::size_t first = isample % nbatches * batch;
+                    obfuscator.encrypt_batch(messages[ithread].data() + first, results[ithread].data() + first, batch);
+                    }, batch, nthreads, options.min_time_ms)));
+                record.operation = "decrypt_batch";
+                records.push_back(make_record(record, measure([&](unsigned ithread, std::size_t isample) {
+                    const std::size_t first = isample % nbatches * batch;
+                    obfuscator.decrypt_batch(messages[ithread].data() + first, results[ithread].data() + first, batch);
+                    }, batch, nthreads, options.min_time_ms)));
+            };
+        };
+    }
+
+#if THORP_HAS_INT128
+    // encrypt/decrypt of the 64 bit and the 128 bit instantiation of BasicOptThorpObfuscator on their full domains.
+    void bench_wide(thorp::RoundFunction round_function, const Options& options, std::vector<Record>& records)
+    {
+        const std::size_t nmessages = 4096;
+        const auto obfuscator64 = thorp::BasicOptThorpObfuscator<uint64_t>::from_uint64(1, std::numeric_limits<uint64_t>::max(), round_function);
+        const auto obfuscator128 = thorp::OptThorpObfuscator128::from_uint64(1, ~thorp::uint128_t{ 0 }, round_function);
+        Record base{};
+        base.round_function = round_function_name(round_function);
+        base.max_message = std::numeric_limits<uint64_t>::max();
+        base.npasses = obfuscator64.npasses();
+        base.optimization_level = obfuscator64.optimization_level();
+        base.batch = 1;
+        for (unsigned nthreads : options.threads) {
+            std::vector<std::vector<uint64_t>> messages(nthreads);
+            std::vector<std::vector<thorp::uint128_t>> results(nthreads, std::vector<thorp::uint128_t>(nmessages));
+            for (unsigned ithread = 0; ithread < nthreads; ++ithread) {
+                messages[ithread] = make_messages(nmessages, std::numeric_limits<uint64_t>::max(), ithread + 1);
+            };
+            Record record = base;
+            record.threads = nthreads;
+            record.obfuscator = "BasicOptThorpObfuscator<uint64_t>";
+            record.domain_bits = 64;
+            record.operation = "encrypt";
+            records.push_back(make_record(record, measure([&](unsigned ithread, std::size_t isample) {
+                results[ithread][isample % nmessages] = obfuscator64.encrypt(messages[ithread][isample % nmessages]);
+                }, 1, nthreads, options.min_time_ms)));
+            record.operation = "decrypt";
+            records.push_back(make_record(record, measure([&](unsigned ithread, std::size_t isample) {
+                results[ithread][isample % nmessages] = obfuscator64.decrypt(messages[ithread][isample % nmessages]);
+                }, 1, nthreads, options.min_time_ms)));
+            // the messages fill both halves of the 128 bits.
+            record.obfuscator = "OptThorpObfuscator128";
+            record.domain_bits = 128;
+            record.operation = "encrypt";
+            records.push_back(make_record(record, measure([&](unsigned ithread, std::size_t isample) {
+                const uint64_t message = messages[ithread][isample % nmessages];
+                results[ithread][isample % nmessages] = obfuscator128.encrypt((thorp::uint128_t{ message } << 64) | ~message);
+                }, 1, nthreads, options.min_time_ms)));
+            record.operation = "decrypt";
+            records.push_back(make_record(record, measure([&](unsigned ithread, std::size_t isample) {
+                const uint64_t message = messages[ithread][isample % nmessages];
+                results[ithread][isample % nmessages] = obfuscator128.decrypt((thorp::uint128_t{ message } << 64) | ~message);
+                }, 1, nthreads, options.min_time_ms)));
+        };
+    }
+#endif
+
+    // batches of CycleWalkingObfuscator against batches of its cover obfuscator, on domains that need walks.
+    // the walks cost at least (cover max_message+1)/(max_message+1) times the cover, the records show how close they get.
+    void bench_cycle_walking(thorp::RoundFunction round_function, const Options& options, std::vector<Record>& records)
+    {
+        const std::size_t nmessages = 4096;
+        const std::size_t batch = 1024;
+        // no walks, 1/16000 of the messages walk, and a third of them with a 3/2 larger cover.
+        for (uint64_t max_message : { (1ull << 20) - 1, 1000000ull, (1ull << 21) + (1ull << 20) - 1 }) {
+            const auto walking = max_message == (1ull << 21) + (1ull << 20) - 1
+                ? thorp::CycleWalkingObfuscator{ thorp::OptThorpObfuscator::from_uint64(1, (1ull << 22) - 1, round_function), max_message }
+                : thorp::CycleWalkingObfuscator::from_uint64(1, max_message, round_function);
+            const thorp::OptThorpObfuscator& cover = walking.cover();
+            const std::vector<uint64_t> messages = make_messages(nmessages, max_message, 1);
+            std::vector<uint64_t> results(nmessages);
+            Record record{};
+            record.round_function = round_function_name(round_function);
+            record.operation = "encrypt_batch";
+            record.npasses = cover.npasses();
+            record.optimization_level = cover.optimization_level();
+            record.batch = batch;
+            record.threads = 1;
+            record.obfuscator = "CycleWalkingObfuscator";
+            record.max_message = max_message;
+            record.domain_bits = static_cast<unsigned>(thorp::nrounds_per_pass(max_message));
+            records.push_back(make_record(record, measure([&](unsigned, std::size_t isample) {
+                const std::size_t first = isample % (nmessages / batch) * batch;
+                walking.encrypt_batch(messages.data() + first, results.data() + first, batch);
+                }, batch, 1, options.min_time_ms)));
+            record.obfuscator = "OptThorpObfuscator";
+            record.max_message = cover.max_message();
+            record.domain_bits = static_cast<unsigned>(thorp::nrounds_per_pass(cover.max_message()));
+            records.push_back(make_record(record, measure([&](unsigned, std::size_t isample) {
+                const std::size_t first = isample % (nmessages / batch) * batch;
+                cover.encrypt_batch(messages.data() + first, results.data() + first, batch);
+                }, batch, 1, options.min_time_ms)));
+        };
+    }
+
+    // one id under many keys: KeySet::encrypt_under_all against a loop over an OptThorpObfuscator per key.
+    void bench_key_set(thorp::RoundFunction round_function, const Options& options, std::vector<Record>& records)
+    {
+        const uint64_t max_message = (1ull << 32) - 1;
+        for (std::size_t nkeys : { std::size_t{ 64 }, std::size_t{ 1024 } }) {
+            std::vector<uint64_t> key_numbers(nkeys);
+            for (std::size_t ikey = 0; ikey < nkeys; ++ikey) key_numbers[ikey] = ikey;
+            const thorp::KeySet key_set = thorp::KeySet::from_uint64(key_numbers, max_message, round_function);
+            std::vector<thorp::OptThorpObfuscator> obfuscators;
+            for (uint64_t key_number : key_numbers) {
+                obfuscators.push_back(thorp::OptThorpObfuscator::from_uint64(key_number, max_message, round_function));
+            };
+            std::vector<uint64_t> results(nkeys);
+            Record record{};
+            record.round_function = round_function_name(round_function);
+            record.max_message = max_message;
+            record.domain_bits = 32;
+            record.npasses = key_set.npasses();
+            record.optimization_level = key_set.optimization_level();
+            record.batch = nkeys;
+            record.threads = 1;
+            record.obfuscator = "KeySet";
+            record.operation = "encrypt_under_all";
+            records.push_back(make_record(record, measure([&](unsigned, std::size_t isample) {
+                key_set.encrypt_under_all(isample, results.data());
+                }, nkeys, 1, options.min_time_ms)));
+            record.obfuscator = "OptThorpObfuscator";
+            records.push_back(make_record(record, measure([&](unsigned, std::size_t isample) {
+                for (std::size_t ikey = 0; ikey < nkeys; ++ikey) {
+                    results[ikey] = obfuscators[ikey].encrypt(isample);
+                };
+                }, nkeys, 1, options.min_time_ms)));
+        };
+    }
+
+    // a skewed workload, 9 of 10 ids out of 256 hot ones: MemoizedObfuscator (1 MiB) against the plain obfuscator.
+    void bench_memo(thorp::RoundFunction round_function, const Options& options, std::vector<Record>& records)
+    {
+        const std::size_t nmessages = 4096;
+        const uint64_t max_message = std::numeric_limits<uint64_t>::max();
+        const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(1, max_message, round_function);
+        const thorp::MemoizedObfuscator memoized{ obfuscator, 1 << 20 };
+        std::vector<uint64_t> messages = make_messages(nmessages, max_message, 1);
+        for (std::size_t imessage = 0; imessage < nmessages; ++imessage) {
+            if (imessage % 10 != 0) messages[imessage] %= 256;
+        };
+        std::vector<uint64_t> results(nmessages);
+        Record record{};
+        record.round_function = round_function_name(round_function);
+        record.max_message = max_message;
+        record.domain_bits = 64;
+        record.npasses = obfuscator.npasses();
+        record.optimization_level = obfuscator.optimization_level();
+        record.batch = 1;
+        record.threads = 1;
+        record.operation = "encrypt_skewed";
+        record.obfuscator = "MemoizedObfuscator";
+        records.push_back(make_record(record, measure([&](unsigned, std::size_t isample) {
+            results[isample % nmessages] = memoized.encrypt(messages[isample % nmessages]);
+            }, 1, 1, options.min_time_ms)));
+        record.obfuscator = "OptThorpObfuscator";
+        records.push_back(make_record(record, measure([&](unsigned, std::size_t isample) {
+            results[isample % nmessages] = obfuscator.encrypt(messages[isample % nmessages]);
+            }, 1, 1, options.min_time_ms)));
+        std::cerr << "memo hit rate " << memoized.statistics().hit_rate() << '\n';
+    }
+
+    std::vector<uint64_t> domains(const Options& options)
+    {
+        const std::vector<unsigned> bits = options.quick
+            ? std::vector<unsigned>{ 8, 32, 64 }
+            : std::vector<unsigned>{ 8, 16, 24, 32, 48, 64 };
+        std::vector<uint64_t> max_messages;
+        for (unsigned nbits : bits) {
+            max_messages.push_back(nbits == 64 ? std::numeric_limits<uint64_t>::max() : (1ull << nbits) - 1);
+        };
+        return max_messages;
+    }
+
+    std::vector<Record> run(const Options& options)
+    {
+        std::vector<Record> records;
+        const std::vector<uint64_t> npasses_list = options.quick ? std::vector<uint64_t>{ 8 } : std::vector<uint64_t>{ 2, 4, 8 };
+        std::vector<thorp::byte_t> key_data;
+        for (thorp::RoundFunction round_function : options.round_functions) {
+            if (!thorp::round_function_supported(round_function)) {
+                std::cerr << "skipping " << round_function_name(round_function) << ", not supported on this cpu\n";
+                continue;
+            };
+            const uint64_t opt_level_max = thorp::OptThorpObfuscator::optimization_level_max_for(round_function);
+#if THORP_HAS_INT128
+            bench_wide(round_function, options, records);
+#endif
+            bench_cycle_walking(round_function, options, records);
+            bench_key_set(round_function, options, records);
+            bench_memo(round_function, options, records);
+            for (uint64_t max_message : domains(options)) {
+                std::cerr << round_function_name(round_function) << " max_message " << max_message << '\n';
+                Record base{};
+                base.round_function = round_function_name(round_function);
+                base.max_message = max_message;
+                base.domain_bits = static_cast<unsigned>(thorp::nrounds_per_pass(max_message));
+                base.threads = 1;
+                base.batch = 1;
+
+                // construction, from_uint64 always uses 8 passes and the largest optimization level.
+                base.operation = "from_uint64";
+                base.npasses = 8;
+                base.obfuscator = "ThorpObfuscator";
+                base.optimization_level = 0;
+                records.push_back(make_record(base, measure([&](unsigned, std::size_t isample) {
+                    const auto obfuscator = thorp::ThorpObfuscator::from_uint64(isample, max_message, round_function);
+                    (void)obfuscator;
+                    }, 1, 1, options.min_time_ms)));
+                base.obfuscator = "OptThorpObfuscator";
+                base.optimization_level = opt_level_max;
+                records.push_back(make_record(base, measure([&](unsigned, std::size_t isample) {
+                    const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(isample, max_message, round_function);
+                    (void)obfuscator;
+                    }, 1, 1, options.min_time_ms)));
+
+                for (uint64_t npasses : npasses_list) {
+                    key_data.resize(thorp::ThorpObfuscator::round_keys_data_size(npasses, max_message));
+                    randombytes_buf(key_data.data(), key_data.size());
+                    base.npasses = npasses;
+                    base.obfuscator = "ThorpObfuscator";
+                    base.optimization_level = 0;
+                    bench_operations(thorp::ThorpObfuscator{ key_data, max_message, npasses, round_function }, base, options, records);
+                    base.obfuscator = "OptThorpObfuscator";
+                    for (uint64_t opt_level = 1; opt_level <= opt_level_max; ++opt_level) {
+                        // the optimization needs half of the domain to be divisible by 2^(opt_level-1).
+                        if ((max_message / 2 + 1) % (1ull << (opt_level - 1)) != 0) continue;
+                        if (options.quick && opt_level != 1 && opt_level != opt_level_max) continue;
+                        base.optimization_level = opt_level;
+                        bench_operations(thorp::OptThorpObfuscator{ key_data, max_message, npasses, opt_level, round_function },
+                            base, options, records);
+                    };
+                };
+            };
+        };
+        return records;
+    }
+
+    void write_json(std::ostream& out, const std::vector<Record>& records)
+    {
+        out << "{\n  \"benchmark\": \"thorp_shuffle\",\n  \"records\": [\n";
+        for (std::size_t irecord = 0; irecord < records.size(); ++irecord) {
+            const Record& r = records[irecord];
+            out << "    {\"obfuscator\": \"" << r.obfuscator << "\", \"round_function\": \"" << r.round_function
+                << "\", \"operation\": \"" << r.operation << "\", \"max_message\": " << r.max_message
+                << ", \"domain_bits\": " << r.domain_bits
+                << ", \"npasses\": " << r.npasses << ", \"optimization_level\": " << r.optimization_level
+                << ", \"batch\": " << r.batch << ", \"threads\": " << r.threads << ", \"samples\": " << r.samples
+                << ", \"ns_per_op\": " << r.ns_per_op << ", \"ops_per_s\": " << r.ops_per_s
+                << ", \"p50_ns\": " << r.p50_ns << ", \"p90_ns\": " << r.p90_ns << ", \"p99_ns\": " << r.p99_ns
+                << (irecord + 1 < records.size() ? "},\n" : "}\n");
+        };
+        out << "  ]\n}\n";
+    }
+
+    void write_csv(std::ostream& out, const std::vector<Record>& records)
+    {
+        out << "obfuscator,round_function,operation,max_message,domain_bits,npasses,optimization_level,batch,threads,samples,"
+            "ns_per_op,ops_per_s,p50_ns,p90_ns,p99_ns\n";
+        for (const Record& r : records) {
+            out << r.obfuscator << ',' << r.round_function << ',' << r.operation << ',' << r.max_message << ',' << r.domain_bits << ','
+                << r.npasses << ',' << r.optimization_level << ',' << r.batch << ',' << r.threads << ',' << r.samples << ','
+                << r.ns_per_op << ',' << r.ops_per_s << ',' << r.p50_ns << ',' << r.p90_ns << ',' << r.p99_ns << '\n';
+        };
+    }
+}
+
+int main(int argc, char** argv) {
+    if (sodium_init() == -1) {
+        return 1;
+    };
+    Options options;
+    try {
+        options = parse_options(argc, argv);
+    }
+    catch (const std::exception& error) {
+        std::cerr << error.what() << '\n';
+        return 2;
+    };
+    const std::vector<Record> records = run(options);
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            std::cerr << "can not open " << options.output << '\n';
+            return 1;
+        };
+    };
+    std::ostream& out = options.output.empty() ? std::cout : file;
+    if (options.format == "csv") {
+        write_csv(out, records);
+    }
+    else {
+        write_json(out, records);
+    };
+    return 0;
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+
+// BLAKE2b as used by the obfuscators: a single message block keyed with a short key.
+// the results are bit-identical to crypto_generichash(out, outlen, message, 8, key, keylen)
+// but the lane kernels hash several independent messages in one go.
+//  see RFC 7693 for the description of BLAKE2b.
+
+namespace thorp {
+    using byte_t = unsigned char;
+}
+
+namespace thorp::detail {
+    // number of 64bit words in the chaining value of blake2b.
+    constexpr std::size_t blake2b_state_words = 8;
+    // the largest number of lanes any kernel hashes at once (8 x 64bit for AVX-512).
+    constexpr std::size_t blake2b_lanes_max = 8;
+
+    // scalar reference: hashes one 8 byte (little endian) message.
+    void blake2b_keyed_hash(byte_t* out, std::size_t outlen, uint64_t message, const byte_t* key, std::size_t keylen) noexcept;
+
+    // hashes `lanes` messages at once, lane i uses messages[i] and keys[i].
+    // writes the first outlen/8 words of the digest of lane i to out_words[iword * lanes + i]
+    // outlen has to be a multiple of 8.
+    using blake2b_lanes_fn = void (*)(
+        uint64_t* out_words, std::size_t outlen,
+        const uint64_t* messages,
+        const byte_t* const* keys, std::size_t keylen) noexcept;
+
+    struct Blake2bLaneKernel {
+        const char* name;
+        std::size_t lanes;
+        blake2b_lanes_fn keyed_hash;
+    };
+
+    // the widest kernel the cpu supports (decided once at runtime).
+    const Blake2bLaneKernel& blake2b_lane_kernel() noexcept;
+    // all kernels the cpu supports, the portable one is always the first.
+    std::size_t blake2b_lane_kernels(const Blake2bLaneKernel** kernels_out, std::size_t max_kernels) noexcept;
+
+    // the key block is the same for every message hashed with a key, so the chaining value after it
+    // can be computed once and every hash costs a single compression.
+    // the state is stored as blake2b_state_words little endian words (blake2b_state_bytes bytes).
+    constexpr std::size_t blake2b_state_bytes = blake2b_state_words * sizeof(uint64_t);
+    // the state after the key block of a keyed hash with a digest of outlen bytes.
+    void blake2b_key_state(byte_t* state, std::size_t outlen, const byte_t* key, std::size_t keylen) noexcept;
+    // finishes the keyed hash of an 8 byte message, outlen has to be the one the state was computed for.
+    void blake2b_hash_from_state(byte_t* out, std::size_t outlen, uint64_t message, const byte_t* state) noexcept;
+    // the same for a 16 byte message (message_lo first), for the 128 bit domains.
+    void blake2b_hash_from_state_wide(byte_t* out, std::size_t outlen, uint64_t message_lo, uint64_t message_hi,
+        const byte_t* state) noexcept;
+    // lane kernels continuing from key states: keys[i] points to the state of lane i, keylen is ignored.
+    const Blake2bLaneKernel& blake2b_state_lane_kernel() noexcept;
+    std::size_t blake2b_state_lane_kernels(const Blake2bLaneKernel** kernels_out, std::size_t max_kernels) noexcept;
+
+    // shared pieces of the kernels
+    constexpr std::array<uint64_t, blake2b_state_words> blake2b_iv{
+        0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+        0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+    };
+
+    constexpr std::array<std::array<byte_t, 16>, 12> blake2b_sigma{ {
+        {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+        { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+        { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+        {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+        {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+        {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+        { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+        { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+        {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+        { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+        {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+        { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+    } };
+
+    // first word of the parameter block: digest length, key length, fanout=1, depth=1.
+    constexpr uint64_t blake2b_param_word(std::size_t outlen, std::size_t keylen) noexcept
+    {
+        return 0x01010000ull ^ (static_cast<uint64_t>(keylen) << 8) ^ static_cast<uint64_t>(outlen);
+    }
+
+    // reads up to 8 bytes little endian, missing bytes are zero.
+    constexpr uint64_t blake2b_load_word(const byte_t* bytes, std::size_t nbytes) noexcept
+    {
+        static_assert(CHAR_BIT == 8, "need 8 bit characters");
+        uint64_t word = 0;
+        for (std::size_t ibyte = 0; ibyte < nbytes && ibyte < 8; ++ibyte) {
+            word |= static_cast<uint64_t>(bytes[ibyte]) << (8 * ibyte);
+        };
+        return word;
+    }
+
+    // parity of all bits, ThorpObfuscator::generate_random_bit reduces its hash the same way.
+    constexpr uint64_t parity(uint64_t word) noexcept
+    {
+        word ^= word >> 32;
+        word ^= word >> 16;
+        word ^= word >> 8;
+        word ^= word >> 4;
+        word ^= word >> 2;
+        word ^= word >> 1;
+        return word & 1;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ThorpShuffler.hpp"
+
+// an OptThorpObfuscator for domains of any size.
+// the thorp rounds need an even domain whose half is divisible by 2^(optimization_level-1), so the permutation
+// runs on the cover domain, the domain rounded up to the next multiple of 2^optimization_level, and cycle walks:
+// a cyphertext outside of [0, max_message] is encrypted again until it lands inside. that is a permutation
+// of [0, max_message] and costs (cover_max_message+1)/(max_message+1) encryptions per message on average.
+//
+// the batch functions walk all messages of the batch together: the first pass is a batch of the whole input,
+// the messages that left the domain are gathered into the next, shorter, batch (which again runs on the lane
+// kernels) and so on, instead of walking each message in a scalar loop.
+
+namespace thorp {
+    class CycleWalkingObfuscator {
+    public:
+        // cover has to have a domain of at least max_message+1 messages.
+        CycleWalkingObfuscator(OptThorpObfuscator cover, uint64_t max_message);
+        // uses the optimization level with the fewest expected hashes per message, walks included.
+        static CycleWalkingObfuscator from_uint64(uint64_t key_number, uint64_t max_message,
+            RoundFunction round_function = RoundFunction::blake2b);
+        // the keys of OptThorpObfuscator::from_uint64 on the cover domain.
+        static CycleWalkingObfuscator from_uint64(uint64_t key_number, uint64_t max_message, uint64_t npasses, uint64_t optimization_level,
+            RoundFunction round_function = RoundFunction::blake2b);
+        // the smallest domain above max_message the rounds of the optimization level can handle, 2^64-1 if it is not below 2^64.
+        static uint64_t cover_max_message(uint64_t max_message, uint64_t optimization_level) noexcept;
+        uint64_t max_message() const noexcept;
+        const OptThorpObfuscator& cover() const noexcept;
+        // neither allocates.
+        uint64_t encrypt(uint64_t plaintext) const noexcept;
+        uint64_t decrypt(uint64_t cyphertext) const noexcept;
+        // same contract as OptThorpObfuscator::encrypt_batch, the arrays may be the same.
+        void encrypt_batch(const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const;
+        void decrypt_batch(const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const;
+    private:
+        // walks the messages of values that are outside of the domain until all are inside.
+        void walk(uint64_t* values, std::size_t count, bool decrypt) const;
+    private:
+        OptThorpObfuscator cover_;
+        uint64_t max_message_;
+    };
+}
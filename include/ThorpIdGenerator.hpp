@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include "ThorpShuffler.hpp"
+
+// issues the ids encrypt(0), encrypt(1), ... of an OptThorpObfuscator, the counter order does not leak.
+//
+// threads reserve blocks of block_size counters with a compare_exchange on a shared counter and encrypt the
+// whole block into a thread local ring, next_id only takes the next id of the ring.
+// every counter is reserved once, so every id is issued at most once until all max_message()+1 ids are taken,
+// the last block is cut short at max_message and after it every call throws.
+// ids are not issued in counter order across threads, and counters reserved by a thread that stops
+// asking (or by a generator that is destroyed) are skipped.
+//
+// persistence: the generator hands out counters only below the persisted high-water mark. before a block
+// crosses it the mark is moved lease counters ahead and passed to persist (under a mutex, once per lease).
+// a generator restarted with the last persisted mark as first_counter never repeats an id.
+// a thread keeps the rings of its last few generators, the rest of an older ring is skipped.
+
+namespace thorp {
+    namespace detail {
+        struct IdRing;
+    }
+
+    struct IdPersistence {
+        // called with the new high-water mark before any counter at or above the old one is issued.
+        // may throw, the block that needed the mark is dropped then.
+        std::function<void(uint64_t high_water_mark)> persist;
+        // how many counters one call to persist covers.
+        uint64_t lease = 1ull << 20;
+    };
+
+    // thrown by next_id once every id of the domain has been reserved.
+    class IdsExhausted : public std::out_of_range {
+    public:
+        IdsExhausted();
+    };
+
+    class ObfuscatedIdGenerator {
+    public:
+        static constexpr std::size_t default_block_size = 256;
+
+        explicit ObfuscatedIdGenerator(OptThorpObfuscator obfuscator, uint64_t first_counter = 0,
+            std::size_t block_size = default_block_size, IdPersistence persistence = {});
+        ObfuscatedIdGenerator(const ObfuscatedIdGenerator&) = delete;
+        ObfuscatedIdGenerator& operator=(const ObfuscatedIdGenerator&) = delete;
+
+        // the next id of the calling thread, throws IdsExhausted when the domain is used up.
+        uint64_t next_id();
+        // the first counter not reserved yet, at or below the persisted high-water mark.
+        uint64_t reserved_counters() const noexcept;
+        // the last mark passed to persist (first_counter before the first call).
+        uint64_t high_water_mark() const noexcept;
+        const OptThorpObfuscator& obfuscator() const noexcept;
+    private:
+        uint64_t refill(detail::IdRing& ring);
+        void persist_up_to(uint64_t end);
+    private:
+        OptThorpObfuscator obfuscator_;
+        std::size_t block_size_;
+        IdPersistence persistence_;
+        // distinguishes the thread local rings of generators, addresses may be reused.
+        uint64_t instance_;
+        alignas(64) std::atomic<uint64_t> next_counter_;
+        // set once the last block is taken, max_message + 1 does not fit next_counter_ for a 2^64 domain.
+        std::atomic<bool> exhausted_{ false };
+        alignas(64) std::atomic<uint64_t> high_water_mark_;
+        std::mutex persist_mutex_;
+    };
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ThorpPartition.hpp"
+#include "ThorpShuffler.hpp"
+
+// reading and writing streams of ids, as the thorp tool does.
+//
+// binary ids are little endian uint64, text ids are one per line (decimal, or hex with or without 0x),
+// surrounding blanks and a trailing \r are ignored and empty lines are skipped.
+// IdParser takes the input in blocks of any size, an id split over two blocks is carried over to the next one.
+
+namespace thorp {
+    enum class IdFormat { binary, decimal, hex };
+
+    // "binary", "decimal" or "hex", throws std::invalid_argument for anything else.
+    IdFormat parse_id_format(const std::string& name);
+
+    // the parameters of the OptThorpObfuscator::from_uint64 the thorp tool runs the ids through.
+    struct ObfuscatorParameters {
+        uint64_t max_message;
+        uint64_t npasses;
+        uint64_t optimization_level; // 0 for the largest level of the round function
+        RoundFunction round_function;
+    };
+
+    // parameters with the level resolved, throws std::invalid_argument for the ones the constructors only assert:
+    // an unsupported round function, a level out of range or one that does not divide the domain, an even max_message
+    // or no passes.
+    ObfuscatorParameters check_obfuscator_parameters(ObfuscatorParameters parameters);
+
+    class IdParser {
+    public:
+        using BatchSink = std::function<void(std::vector<uint64_t>&& batch)>;
+        // sink gets the ids in batches of batch_size (the last one may be shorter).
+        IdParser(IdFormat format, uint64_t max_message, BatchSink sink, std::size_t batch_size);
+        // parses the complete ids of data, throws std::runtime_error for ids that are malformed or larger than max_message.
+        void feed(const char* data, std::size_t size);
+        // parses what is left and passes the last batch on, throws std::runtime_error if binary input ends within an id.
+        void finish();
+    private:
+        // the end of the last complete id in [data, end).
+        const char* complete_end(const char* data, const char* end) const;
+        void parse(const char* data, const char* end);
+        uint64_t parse_text(const char* first, const char* last) const;
+        void add(uint64_t id);
+        void flush();
+    private:
+        IdFormat format_;
+        uint64_t max_message_;
+        BatchSink sink_;
+        std::size_t batch_size_;
+        std::vector<uint64_t> batch_;
+        std::string carry_;
+    };
+
+    // formats ids into a buffer and writes it to a file once it is full, throws std::runtime_error if that fails.
+    class IdWriter {
+    public:
+        static constexpr std::size_t default_buffer_size = 1 << 20;
+        // file stays open after close, the caller owns it.
+        IdWriter(std::FILE* file, IdFormat format, std::size_t buffer_size = default_buffer_size);
+        void write(const uint64_t* ids, std::size_t count);
+        // "plaintext cyphertext" lines, or the two binary ids of each pair.
+        void write_pairs(const PermutationPair* pairs, std::size_t count);
+        void flush();
+        // flushes the buffer and the file.
+        void close();
+    private:
+        IdFormat format_;
+        std::FILE* file_;
+        std::vector<char> buffer_;
+        std::size_t used_ = 0;
+    };
+}
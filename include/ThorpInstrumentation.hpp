@@ -0,0 +1,207 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include "ThorpRoundFunction.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// opt-in counters of what OptThorpObfuscator::encrypt/decrypt (and the batch and range variants) do.
+// build with THORP_INSTRUMENTATION=1 (xmake f --instrumentation=y) to enable them, the library and
+// everything including its headers have to agree on the flag. without it the counters compile to nothing
+// and the snapshot is all zero.
+//
+// each call counts into locals and adds them to the atomic counters of its obfuscator once at the end,
+// so the counters cost a few relaxed atomic adds per call. copies of an obfuscator start with fresh counters.
+// with cycle sampling every n-th scalar call also reads the cycle counter (rdtsc, nanoseconds off x86) around each round.
+
+#ifndef THORP_INSTRUMENTATION
+#define THORP_INSTRUMENTATION 0
+#endif
+
+namespace thorp {
+    constexpr bool instrumentation_enabled = THORP_INSTRUMENTATION != 0;
+
+    struct InstrumentationSnapshot {
+        // the parameters of the obfuscator, for labelling exported metrics.
+        uint64_t max_message;
+        uint64_t npasses;
+        uint64_t optimization_level;
+        RoundFunction round_function;
+        // messages encrypted or decrypted.
+        uint64_t operations;
+        uint64_t rounds;
+        // messages hashed by the round function, a lane kernel call hashes one per lane.
+        uint64_t hashes;
+        // rounds that took their bit from the hash of an earlier round of the opt round.
+        uint64_t cache_hits;
+        // bytes of round key (or master key) material read for the hashes.
+        uint64_t key_bytes;
+        // round keys derived from the master key (KeySchedule::derived).
+        uint64_t key_derivations;
+        // the rounds timed by cycle sampling and their cycles (nanoseconds off x86).
+        uint64_t sampled_rounds;
+        uint64_t sampled_cycles;
+        uint64_t max_round_cycles;
+
+        double cycles_per_round() const noexcept
+        {
+            return this->sampled_rounds == 0 ? 0.0 : static_cast<double>(this->sampled_cycles) / static_cast<double>(this->sampled_rounds);
+        }
+        double hashes_per_operation() const noexcept
+        {
+            return this->operations == 0 ? 0.0 : static_cast<double>(this->hashes) / static_cast<double>(this->operations);
+        }
+    };
+}
+
+namespace thorp::detail {
+    inline uint64_t cycle_counter() noexcept
+    {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+#if THORP_INSTRUMENTATION
+    // what one call did, added to the Instrumentation of the obfuscator when the call ends.
+    struct OperationCounts {
+        uint64_t operations = 0;
+        uint64_t rounds = 0;
+        uint64_t hashes = 0;
+        uint64_t cache_hits = 0;
+        uint64_t key_bytes = 0;
+        uint64_t key_derivations = 0;
+        uint64_t sampled_rounds = 0;
+        uint64_t sampled_cycles = 0;
+        uint64_t max_round_cycles = 0;
+
+        void add_operations(uint64_t count) noexcept { this->operations += count; }
+        void add_rounds(uint64_t count) noexcept { this->rounds += count; }
+        void add_cache_hits(uint64_t count) noexcept { this->cache_hits += count; }
+        // count messages hashed with one round key fetched from round_keys.
+        void add_hashes(uint64_t count, const RoundKeySource& round_keys) noexcept
+        {
+            this->hashes += count;
+            if (round_keys.keys != nullptr) {
+                this->key_bytes += round_keys.stride;
+            }
+            else {
+                this->key_bytes += master_key_size;
+                ++this->key_derivations;
+            };
+        }
+        void add_sampled_round(uint64_t cycles) noexcept
+        {
+            ++this->sampled_rounds;
+            this->sampled_cycles += cycles;
+            this->max_round_cycles = cycles > this->max_round_cycles ? cycles : this->max_round_cycles;
+        }
+    };
+
+    class Instrumentation {
+    public:
+        void record(const OperationCounts& counts) noexcept
+        {
+            this->operations_.fetch_add(counts.operations, std::memory_order_relaxed);
+            this->rounds_.fetch_add(counts.rounds, std::memory_order_relaxed);
+            this->hashes_.fetch_add(counts.hashes, std::memory_order_relaxed);
+            this->cache_hits_.fetch_add(counts.cache_hits, std::memory_order_relaxed);
+            this->key_bytes_.fetch_add(counts.key_bytes, std::memory_order_relaxed);
+            this->key_derivations_.fetch_add(counts.key_derivations, std::memory_order_relaxed);
+            if (counts.sampled_rounds > 0) {
+                this->sampled_rounds_.fetch_add(counts.sampled_rounds, std::memory_order_relaxed);
+                this->sampled_cycles_.fetch_add(counts.sampled_cycles, std::memory_order_relaxed);
+                uint64_t max_cycles = this->max_round_cycles_.load(std::memory_order_relaxed);
+                while (counts.max_round_cycles > max_cycles
+                    && !this->max_round_cycles_.compare_exchange_weak(max_cycles, counts.max_round_cycles, std::memory_order_relaxed)) {
+                };
+            };
+        }
+        // whether the calling operation is timed.
+        bool sample() noexcept
+        {
+            const uint64_t every = this->sample_every_.load(std::memory_order_relaxed);
+            return every != 0 && this->sample_tick_.fetch_add(1, std::memory_order_relaxed) % every == 0;
+        }
+        void set_sample_every(uint64_t every) noexcept { this->sample_every_.store(every, std::memory_order_relaxed); }
+        void fill(InstrumentationSnapshot& snapshot) const noexcept
+        {
+            snapshot.operations = this->operations_.load(std::memory_order_relaxed);
+            snapshot.rounds = this->rounds_.load(std::memory_order_relaxed);
+            snapshot.hashes = this->hashes_.load(std::memory_order_relaxed);
+            snapshot.cache_hits = this->cache_hits_.load(std::memory_order_relaxed);
+            snapshot.key_bytes = this->key_bytes_.load(std::memory_order_relaxed);
+            snapshot.key_derivations = this->key_derivations_.load(std::memory_order_relaxed);
+            snapshot.sampled_rounds = this->sampled_rounds_.load(std::memory_order_relaxed);
+            snapshot.sampled_cycles = this->sampled_cycles_.load(std::memory_order_relaxed);
+            snapshot.max_round_cycles = this->max_round_cycles_.load(std::memory_order_relaxed);
+        }
+        void reset() noexcept
+        {
+            for (auto* counter : { &this->operations_, &this->rounds_, &this->hashes_, &this->cache_hits_, &this->key_bytes_,
+                &this->key_derivations_, &this->sampled_rounds_, &this->sampled_cycles_, &this->max_round_cycles_ }) {
+                counter->store(0, std::memory_order_relaxed);
+            };
+        }
+    private:
+        std::atomic<uint64_t> operations_{ 0 };
+        std::atomic<uint64_t> rounds_{ 0 };
+        std::atomic<uint64_t> hashes_{ 0 };
+        std::atomic<uint64_t> cache_hits_{ 0 };
+        std::atomic<uint64_t> key_bytes_{ 0 };
+        std::atomic<uint64_t> key_derivations_{ 0 };
+        std::atomic<uint64_t> sampled_rounds_{ 0 };
+        std::atomic<uint64_t> sampled_cycles_{ 0 };
+        std::atomic<uint64_t> max_round_cycles_{ 0 };
+        std::atomic<uint64_t> sample_every_{ 0 };
+        std::atomic<uint64_t> sample_tick_{ 0 };
+    };
+
+    // the counters of one obfuscator, a copy starts over.
+    class InstrumentationHandle {
+    public:
+        InstrumentationHandle() :instrumentation_{ std::make_unique<Instrumentation>() } {}
+        InstrumentationHandle(const InstrumentationHandle&) :InstrumentationHandle{} {}
+        InstrumentationHandle(InstrumentationHandle&&) noexcept = default;
+        InstrumentationHandle& operator=(const InstrumentationHandle&) { this->instrumentation_->reset(); return *this; }
+        InstrumentationHandle& operator=(InstrumentationHandle&&) noexcept = default;
+        void record(const OperationCounts& counts) const noexcept { this->instrumentation_->record(counts); }
+        bool sample() const noexcept { return this->instrumentation_->sample(); }
+        void set_sample_every(uint64_t every) const noexcept { this->instrumentation_->set_sample_every(every); }
+        void fill(InstrumentationSnapshot& snapshot) const noexcept { this->instrumentation_->fill(snapshot); }
+        void reset() const noexcept { this->instrumentation_->reset(); }
+    private:
+        // never null, but for a moved from handle.
+        std::unique_ptr<Instrumentation> instrumentation_;
+    };
+#else
+    // without THORP_INSTRUMENTATION everything is a no-op the compiler removes.
+    struct OperationCounts {
+        void add_operations(uint64_t) noexcept {}
+        void add_rounds(uint64_t) noexcept {}
+        void add_cache_hits(uint64_t) noexcept {}
+        void add_hashes(uint64_t, const RoundKeySource&) noexcept {}
+        void add_sampled_round(uint64_t) noexcept {}
+    };
+
+    class InstrumentationHandle {
+    public:
+        void record(const OperationCounts&) const noexcept {}
+        static constexpr bool sample() noexcept { return false; }
+        void set_sample_every(uint64_t) const noexcept {}
+        void fill(InstrumentationSnapshot&) const noexcept {}
+        void reset() const noexcept {}
+    };
+#endif
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ThorpShuffler.hpp"
+
+// many keys of OptThorpObfuscators with the same domain, passes, optimization level and round function,
+// for encrypting one id under the keys of thousands of tenants.
+//
+// the round keys are stored as structure of arrays: the (prepared) keys of all key sets for opt round 0,
+// then the ones for opt round 1 and so on, in one allocation. the lanes of the round function kernel each
+// run a different key. the batch functions run one opt round for all messages before the next one, so
+// encrypt_under_all reads the keys of consecutive key sets next to each other and walks the whole set
+// front to back once, one opt round block after the other.
+// key set i gives the same results as an OptThorpObfuscator with the same keys.
+
+namespace thorp {
+    class KeySet {
+    public:
+        // round_keys_data[i] are the keys of key set i, as for the OptThorpObfuscator constructor.
+        KeySet(const std::vector<std::vector<byte_t>>& round_keys_data, uint64_t max_message, uint64_t npasses,
+            uint64_t optimization_level, RoundFunction round_function = RoundFunction::blake2b);
+        // key set i has the keys of OptThorpObfuscator::from_uint64(key_numbers[i], ...).
+        static KeySet from_uint64(const std::vector<uint64_t>& key_numbers, uint64_t max_message,
+            RoundFunction round_function = RoundFunction::blake2b);
+        static KeySet from_uint64(const std::vector<uint64_t>& key_numbers, uint64_t max_message, uint64_t npasses,
+            uint64_t optimization_level, RoundFunction round_function = RoundFunction::blake2b);
+        // the number of key sets.
+        std::size_t size() const noexcept;
+        uint64_t max_message() const noexcept;
+        uint64_t npasses() const noexcept;
+        uint64_t optimization_level() const noexcept;
+        RoundFunction round_function() const noexcept;
+        // cyphertexts[i] is plaintext encrypted under key set i, for all size() key sets.
+        void encrypt_under_all(uint64_t plaintext, uint64_t* cyphertexts) const;
+        // cyphertexts[i] is plaintexts[i] encrypted under key set key_indices[i], the arrays may be the same.
+        void encrypt_many(const std::size_t* key_indices, const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const;
+        void decrypt_many(const std::size_t* key_indices, const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const;
+    private:
+        // runs count messages through the rounds, message i under key set key_index(i).
+        template <bool Decrypt, class KeyIndex>
+        void run_lanes(const KeyIndex& key_index, const uint64_t* in, uint64_t* out, std::size_t count) const;
+    private:
+        std::size_t nkeys_;
+        uint64_t max_message_;
+        uint64_t npasses_;
+        uint64_t optimization_level_;
+        RoundFunction round_function_;
+        std::size_t hash_size_;
+        std::size_t stride_;
+        // the key of key set i for opt round r at (r * nkeys_ + i) * stride_.
+        std::vector<byte_t> round_keys_;
+    };
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "ThorpShuffler.hpp"
+
+// the whole permutation of an OptThorpObfuscator as a table on disk, encrypt and decrypt are a single lookup.
+// meant for small domains (up to about 2^28 messages, the file holds the forward and the inverse table).
+//
+// file layout (native byte order, checked with byte_order):
+//   PermutationFileHeader
+//   forward table at forward_offset: encrypt(i), entry_bytes bytes per entry
+//   inverse table at inverse_offset: decrypt(i)
+// the tables are 4 byte entries if max_message fits into 32 bits, 8 byte ones otherwise.
+
+namespace thorp {
+    struct PermutationFileHeader {
+        static constexpr std::array<char, 8> magic_value{ { 'T', 'H', 'O', 'R', 'P', 'P', 'R', 'M' } };
+        static constexpr uint32_t current_version = 1;
+        static constexpr uint64_t byte_order_value = 0x0102030405060708ull;
+
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t entry_bytes;
+        uint64_t byte_order;
+        uint64_t max_message;
+        uint64_t npasses;
+        uint64_t optimization_level;
+        uint64_t round_function;
+        std::array<byte_t, crypto_generichash_BYTES> key_fingerprint;
+        uint64_t forward_offset;
+        uint64_t inverse_offset;
+
+        // the header of the tables of obfuscator.
+        static PermutationFileHeader for_obfuscator(const OptThorpObfuscator& obfuscator);
+        // whether the header describes a file with the tables of obfuscator (or of one with the same keys and parameters).
+        bool matches(const PermutationFileHeader& expected) const noexcept;
+        uint64_t file_size() const noexcept;
+    };
+
+    // writes the tables of obfuscator to path, throws std::system_error if the file can't be written.
+    // the file is written under a unique temporary name and renamed over path, readers see the old or the new file.
+    // the forward table is computed with permute_domain (nthreads as there), the inverse one from it.
+    void write_permutation_file(const std::string& path, const OptThorpObfuscator& obfuscator, unsigned nthreads = 0);
+
+    // serves encrypt/decrypt from a mapped permutation file, or from the obfuscator
+    // if the file is missing or was not written for it.
+    // the file is mapped read only and shared, so all processes mapping it share its pages.
+    class MappedPermutation {
+    public:
+        MappedPermutation(const std::string& path, OptThorpObfuscator obfuscator);
+        MappedPermutation(MappedPermutation&& other) noexcept;
+        MappedPermutation& operator=(MappedPermutation&& other) noexcept;
+        MappedPermutation(const MappedPermutation&) = delete;
+        MappedPermutation& operator=(const MappedPermutation&) = delete;
+        ~MappedPermutation();
+        // whether the lookups are served from the file.
+        bool is_mapped() const noexcept;
+        uint64_t max_message() const noexcept;
+        uint64_t encrypt(uint64_t plaintext) const noexcept;
+        uint64_t decrypt(uint64_t cyphertext) const noexcept;
+        const OptThorpObfuscator& obfuscator() const noexcept;
+    private:
+        uint64_t lookup(uint64_t offset, uint64_t index) const noexcept;
+        void unmap() noexcept;
+    private:
+        OptThorpObfuscator obfuscator_;
+        const byte_t* mapping_{ nullptr };
+        uint64_t mapping_size_{ 0 };
+        uint64_t forward_offset_{ 0 };
+        uint64_t inverse_offset_{ 0 };
+        uint32_t entry_bytes_{ 0 };
+    };
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "ThorpShuffler.hpp"
+
+// remembers the results of an OptThorpObfuscator for skewed workloads, where a few ids are encrypted
+// and decrypted over and over: a hit skips all rounds and hashes.
+//
+// a MemoCache is a fixed table of buckets of MemoCache::ways entries that never grows beyond the memory it
+// was given. a key can only live in the bucket its hash selects, a full bucket evicts with CLOCK: every hit
+// marks its entry, the hand of the bucket skips (and unmarks) marked entries and evicts the first unmarked one.
+// the buckets are guarded by a fixed set of striped locks, so threads only contend when they hit the same stripe.
+// MemoizedObfuscator keeps one cache per direction, an encryption also fills the inverse cache for its decryption.
+
+namespace thorp {
+    struct MemoStatistics {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t insertions;
+        uint64_t evictions;
+        // the number of entries the cache can hold.
+        std::size_t capacity;
+
+        double hit_rate() const noexcept
+        {
+            return this->hits + this->misses == 0 ? 0.0 : static_cast<double>(this->hits) / static_cast<double>(this->hits + this->misses);
+        }
+    };
+
+    class MemoCache {
+    public:
+        static constexpr std::size_t ways = 8;
+        static constexpr std::size_t lock_stripes = 64;
+
+        // as many buckets as fit into memory_bytes, none (every lookup misses) if not even one fits.
+        explicit MemoCache(std::size_t memory_bytes);
+        MemoCache(const MemoCache&) = delete;
+        MemoCache& operator=(const MemoCache&) = delete;
+        // whether key is cached, marks its entry as used.
+        bool find(uint64_t key, uint64_t& value) noexcept;
+        void insert(uint64_t key, uint64_t value) noexcept;
+        void clear() noexcept;
+        std::size_t capacity() const noexcept;
+        MemoStatistics statistics() const noexcept;
+        void reset_statistics() noexcept;
+    private:
+        struct Bucket {
+            std::array<uint64_t, ways> keys;
+            std::array<uint64_t, ways> values;
+            uint8_t valid = 0;      // one bit per way
+            uint8_t referenced = 0; // one bit per way
+            uint8_t hand = 0;
+        };
+        std::size_t bucket_index(uint64_t key) const noexcept;
+    private:
+        std::vector<Bucket> buckets_;
+        std::unique_ptr<std::mutex[]> locks_;
+        std::atomic<uint64_t> hits_{ 0 };
+        std::atomic<uint64_t> misses_{ 0 };
+        std::atomic<uint64_t> insertions_{ 0 };
+        std::atomic<uint64_t> evictions_{ 0 };
+    };
+
+    class MemoizedObfuscator {
+    public:
+        // the caches of both directions share memory_bytes.
+        MemoizedObfuscator(OptThorpObfuscator obfuscator, std::size_t memory_bytes);
+        uint64_t max_message() const noexcept;
+        const OptThorpObfuscator& obfuscator() const noexcept;
+        // may be called concurrently, like the functions of the obfuscator.
+        uint64_t encrypt(uint64_t plaintext) const noexcept;
+        uint64_t decrypt(uint64_t cyphertext) const noexcept;
+        // the misses of the batch are computed with one encrypt_batch/decrypt_batch of the obfuscator.
+        void encrypt_batch(const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const;
+        void decrypt_batch(const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const;
+        // the counters of both caches added up.
+        MemoStatistics statistics() const noexcept;
+        void reset_statistics() const noexcept;
+        void clear() const noexcept;
+    private:
+        // looks the messages up in from, computes the misses with compute and remembers them in both caches.
+        template <class Compute>
+        void memoized_batch(MemoCache& from, MemoCache& to, const uint64_t* in, uint64_t* out, std::size_t count,
+            const Compute& compute) const;
+    private:
+        OptThorpObfuscator obfuscator_;
+        // encryptions and decryptions, behind pointers so the obfuscator stays movable.
+        std::unique_ptr<MemoCache> forward_;
+        std::unique_ptr<MemoCache> inverse_;
+    };
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// encrypts/decrypts large spans on all cores.
+//
+// the obfuscators are immutable after construction: all their const member functions may be called
+// concurrently from any number of threads on the same object (the only shared writes are the relaxed
+// atomics of THORP_INSTRUMENTATION). so a span is simply cut into chunks that are encrypted independently
+// with encrypt_batch.
+//
+// a chunk is parallel_chunk_size messages, the input and output of a chunk (128 KiB) stay in the L2 cache.
+// a WorkStealingPool hands each worker a contiguous slice of the chunks, so a worker touches one region of
+// the span, and only steals the far end of the slice of another worker once its own is done. the pool does
+// not decide where the pages of the caller's buffers live, that was settled when they were first touched.
+// anything else that can run tasks (tbb, a server's own pool, ...) can be passed as an Executor instead.
+
+namespace thorp {
+    constexpr std::size_t parallel_chunk_size = 1 << 13;
+
+    // runs task(0), ..., task(ntasks - 1), in any order and on any threads, and returns once all are done.
+    using Executor = std::function<void(std::size_t ntasks, const std::function<void(std::size_t itask)>& task)>;
+
+    class WorkStealingPool {
+    public:
+        // nthreads workers including the thread calling run, 0 for all hardware threads.
+        explicit WorkStealingPool(unsigned nthreads = 0);
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+        ~WorkStealingPool();
+        unsigned size() const noexcept;
+        // an Executor. runs from different threads take turns, the first exception of a task is rethrown.
+        // a task that runs the same pool again (parallel_encrypt inside a task) gets its tasks run inline on
+        // its own thread. a task of pool a running pool b whose tasks run pool a still deadlocks.
+        void run(std::size_t ntasks, const std::function<void(std::size_t itask)>& task);
+        // a pool of all hardware threads, created on first use.
+        static WorkStealingPool& shared();
+    private:
+        // the tasks [next, end) a worker has left, thieves take from the end.
+        struct alignas(64) Slice {
+            std::mutex mutex;
+            std::size_t next = 0;
+            std::size_t end = 0;
+        };
+        void worker_loop(unsigned iworker);
+        void work(unsigned iworker);
+        bool take(unsigned iworker, std::size_t& itask);
+    private:
+        unsigned nworkers_;
+        std::unique_ptr<Slice[]> slices_;
+        std::vector<std::thread> threads_;
+        std::mutex run_mutex_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        uint64_t generation_{ 0 };
+        unsigned busy_{ 0 };
+        bool stop_{ false };
+        const std::function<void(std::size_t)>* task_{ nullptr };
+        std::exception_ptr error_;
+    };
+
+    namespace detail {
+        // calls fn(first, count) for the chunks of [0, count).
+        template <class Fn>
+        void for_each_chunk(std::size_t count, const Executor& executor, const Fn& fn)
+        {
+            const std::size_t nchunks = (count + parallel_chunk_size - 1) / parallel_chunk_size;
+            executor(nchunks, [&fn, count](std::size_t ichunk) {
+                const std::size_t first = ichunk * parallel_chunk_size;
+                fn(first, std::min(parallel_chunk_size, count - first));
+                });
+        }
+
+        inline Executor pool_executor(WorkStealingPool& pool)
+        {
+            return [&pool](std::size_t ntasks, const std::function<void(std::size_t)>& task) { pool.run(ntasks, task); };
+        }
+    }
+
+    // cyphertexts[i] = obfuscator.encrypt(plaintexts[i]) for count messages, the arrays may be the same.
+    // works with every obfuscator that has encrypt_batch/decrypt_batch.
+    template <class Obfuscator>
+    void parallel_encrypt(const Obfuscator& obfuscator, const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count,
+        const Executor& executor)
+    {
+        detail::for_each_chunk(count, executor, [&](std::size_t first, std::size_t chunk) {
+            obfuscator.encrypt_batch(plaintexts + first, cyphertexts + first, chunk);
+            });
+    }
+
+    template <class Obfuscator>
+    void parallel_decrypt(const Obfuscator& obfuscator, const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count,
+        const Executor& executor)
+    {
+        detail::for_each_chunk(count, executor, [&](std::size_t first, std::size_t chunk) {
+            obfuscator.decrypt_batch(cyphertexts + first, plaintexts + first, chunk);
+            });
+    }
+
+    template <class Obfuscator>
+    void parallel_encrypt(const Obfuscator& obfuscator, const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count,
+        WorkStealingPool& pool = WorkStealingPool::shared())
+    {
+        parallel_encrypt(obfuscator, plaintexts, cyphertexts, count, detail::pool_executor(pool));
+    }
+
+    template <class Obfuscator>
+    void parallel_decrypt(const Obfuscator& obfuscator, const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count,
+        WorkStealingPool& pool = WorkStealingPool::shared())
+    {
+        parallel_decrypt(obfuscator, cyphertexts, plaintexts, count, detail::pool_executor(pool));
+    }
+}
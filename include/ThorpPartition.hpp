@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ThorpParallel.hpp"
+#include "ThorpShuffler.hpp"
+
+// the permutation of an OptThorpObfuscator cut into shards of the cyphertext domain, for shuffles spread over
+// many workers. the worker of a shard only needs the messages that land in it: it decrypts the cyphertexts of
+// its shard (decrypt_range, in parallel chunks) instead of encrypting the whole domain and filtering,
+// so its work grows with the shard and not with the domain.
+//
+// the pairs of a shard are streamed in cyphertext order in blocks of export_block_size pairs,
+// a shard never has to fit into memory.
+
+namespace thorp {
+    constexpr std::size_t export_block_size = 16 * parallel_chunk_size;
+
+    // the cyphertexts [first, last] (inclusive, so a single shard can span all 2^64 messages).
+    struct Shard {
+        uint64_t first;
+        uint64_t last;
+    };
+
+    struct PermutationPair {
+        uint64_t plaintext;
+        uint64_t cyphertext;
+    };
+
+    // receives the pairs of a shard block by block, always on the thread that called the export.
+    using PairSink = std::function<void(const PermutationPair* pairs, std::size_t count)>;
+
+    // cuts [0, max_message] into nshards consecutive shards whose sizes differ by at most one,
+    // throws std::invalid_argument if nshards is 0 or larger than the domain.
+    std::vector<Shard> partition_domain(uint64_t max_message, uint64_t nshards);
+
+    // streams the pairs whose cyphertext lies in shard to sink, decrypting the chunks of a block with executor.
+    void export_shard(const OptThorpObfuscator& obfuscator, const Shard& shard, const PairSink& sink, const Executor& executor);
+    void export_shard(const OptThorpObfuscator& obfuscator, const Shard& shard, const PairSink& sink,
+        WorkStealingPool& pool = WorkStealingPool::shared());
+
+    // the driver: splits the domain into nshards shards and exports one after the other,
+    // sink gets the index of the shard with each block.
+    void export_partition(const OptThorpObfuscator& obfuscator, uint64_t nshards,
+        const std::function<void(uint64_t ishard, const PermutationPair* pairs, std::size_t count)>& sink,
+        WorkStealingPool& pool = WorkStealingPool::shared());
+
+    // writes the pairs of shard to path as an array of PermutationPair (native byte order), throws std::system_error
+    // if the file can't be written. like write_permutation_file it writes a unique temporary file and renames it over path.
+    void write_shard_file(const std::string& path, const OptThorpObfuscator& obfuscator, const Shard& shard,
+        WorkStealingPool& pool = WorkStealingPool::shared());
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+#include "ThorpShuffler.hpp"
+
+// a concurrent cache of OptThorpObfuscators, one per tenant key and parameter set.
+// the obfuscators are immutable and shared, a lookup hands out a shared_ptr that stays valid after eviction.
+//
+// the registry is split into shards by the hash of the key, each with its own lock, so lookups of
+// different keys rarely contend. a hit takes the lock shared and only sets the reference bit of its entry
+// (a relaxed store, skipped when the bit is already set) and counts into a counter stripe of its thread.
+// a full shard evicts with CLOCK: its hand clears the bits of referenced entries and evicts the first
+// entry that was not used since the hand last passed it.
+// a miss expands the key outside of the lock, two threads missing the same key at once both expand it
+// and the second one takes the entry of the first.
+
+namespace thorp {
+    struct RegistryKey {
+        uint64_t key_number;
+        uint64_t max_message;
+        uint64_t npasses = 8;
+        // 0 for OptThorpObfuscator::optimization_level_max_for(round_function).
+        uint64_t optimization_level = 0;
+        RoundFunction round_function = RoundFunction::blake2b;
+
+        friend bool operator==(const RegistryKey& left, const RegistryKey& right) noexcept
+        {
+            return left.key_number == right.key_number && left.max_message == right.max_message && left.npasses == right.npasses
+                && left.optimization_level == right.optimization_level && left.round_function == right.round_function;
+        }
+    };
+
+    struct RegistryStats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        std::size_t size;
+    };
+
+    class ObfuscatorRegistry {
+    public:
+        // holds at most capacity obfuscators (rounded up to a multiple of nshards).
+        explicit ObfuscatorRegistry(std::size_t capacity, std::size_t nshards = 16);
+        ObfuscatorRegistry(const ObfuscatorRegistry&) = delete;
+        ObfuscatorRegistry& operator=(const ObfuscatorRegistry&) = delete;
+        // the obfuscator OptThorpObfuscator::from_uint64(key_number, max_message, npasses, optimization_level, round_function).
+        std::shared_ptr<const OptThorpObfuscator> get(const RegistryKey& key);
+        // drops every obfuscator, the counters are kept.
+        void clear();
+        RegistryStats stats() const;
+    private:
+        struct KeyHash {
+            std::size_t operator()(const RegistryKey& key) const noexcept;
+        };
+        struct Slot {
+            RegistryKey key;
+            std::shared_ptr<const OptThorpObfuscator> obfuscator;
+            // set by hits under the shared lock, cleared by the clock hand.
+            std::atomic<bool> referenced{ false };
+        };
+        // shards live on their own cache lines, so the locks of one don't slow down the others.
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex;
+            std::unordered_map<RegistryKey, std::size_t, KeyHash> index;
+            // capacity_per_shard_ slots, the first used ones are filled.
+            std::unique_ptr<Slot[]> slots;
+            std::size_t used = 0;
+            std::size_t hand = 0;
+            std::atomic<uint64_t> misses{ 0 };
+            std::atomic<uint64_t> evictions{ 0 };
+        };
+        // hits are counted per thread stripe instead of per shard, so hits on one hot key don't share a counter line.
+        struct alignas(64) HitStripe {
+            std::atomic<uint64_t> hits{ 0 };
+        };
+        static constexpr std::size_t hit_stripes = 16;
+        // the key with optimization level 0 replaced by the largest level of its round function.
+        static RegistryKey resolved(const RegistryKey& key) noexcept;
+        Shard& shard_for(const RegistryKey& key) noexcept;
+        HitStripe& hit_stripe() noexcept;
+    private:
+        std::size_t capacity_per_shard_;
+        std::vector<Shard> shards_;
+        std::unique_ptr<HitStripe[]> hit_stripes_;
+    };
+}
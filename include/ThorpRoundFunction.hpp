@@ -0,0 +1,89 @@
+#pragma once
+#include "ThorpBlake2b.hpp"
+#include <vector>
+
+// the keyed pseudo random function the rounds draw their bits from.
+// every round function takes a 16 byte round key and an 8 byte (little endian) message.
+
+namespace thorp {
+    enum class RoundFunction {
+        blake2b,  // keyed crypto_generichash, 512 bits.
+        aes128,   // AES-128 of the zero padded message, 128 bits. needs AES-NI.
+        siphash24 // crypto_shorthash, 64 bits.
+    };
+
+    constexpr uint64_t round_function_output_bits(RoundFunction round_function) noexcept
+    {
+        switch (round_function) {
+        case RoundFunction::aes128: return 128;
+        case RoundFunction::siphash24: return 64;
+        default: return 512;
+        };
+    }
+
+    // whether the round function can be evaluated on this cpu.
+    bool round_function_supported(RoundFunction round_function) noexcept;
+    // throws std::invalid_argument if the round function can not be evaluated on this cpu.
+    void require_round_function_supported(RoundFunction round_function);
+    // the fastest round function supported on this cpu.
+    RoundFunction fastest_round_function() noexcept;
+}
+
+namespace thorp::detail {
+    // the length of the round keys of all round functions.
+    constexpr std::size_t round_key_size = 16;
+
+    // bytes of prepared key material per round key, 0 if the round function uses the round key as it is.
+    // blake2b keeps the state after the key block, aes the expanded key schedule.
+    constexpr std::size_t prepared_round_key_size(RoundFunction round_function) noexcept
+    {
+        switch (round_function) {
+        case RoundFunction::aes128: return 11 * 16;
+        case RoundFunction::siphash24: return 0;
+        default: return blake2b_state_bytes;
+        };
+    }
+
+    // the largest prepared round key, the aes key schedule.
+    constexpr std::size_t prepared_round_key_size_max = 11 * 16;
+    // the length of a master key the round keys can be derived from.
+    constexpr std::size_t master_key_size = 32;
+
+    // prepares nround_keys consecutive round keys for hashes of outlen bytes,
+    // empty if the round function uses them as they are.
+    std::vector<byte_t> prepare_round_keys(RoundFunction round_function, const byte_t* round_keys, std::size_t nround_keys,
+        std::size_t outlen);
+
+    // derives the round key iround (round_key_size bytes) from a master key with crypto_kdf_derive_from_key.
+    void derive_round_key(byte_t* round_key, const byte_t* master_key, uint64_t iround) noexcept;
+
+    // where the round keys come from: stored one after the other (prepared if the round function needs it)
+    // or derived from a master key whenever they are needed.
+    struct RoundKeySource {
+        RoundFunction round_function;
+        std::size_t outlen;        // the hash length the keys are prepared for.
+        const byte_t* keys;        // nullptr if the keys are derived.
+        std::size_t stride;
+        const byte_t* master_key;  // master_key_size bytes, only used if keys is nullptr.
+
+        // the round key iround as the round function consumes it,
+        // scratch (prepared_round_key_size_max bytes) holds it if it has to be derived.
+        const byte_t* round_key(uint64_t iround, byte_t* scratch) const noexcept;
+    };
+
+    // scalar round function, key points to the prepared round key (or the round key).
+    // outlen is at most the output of the round function, blake2b hashes to a digest of outlen bytes
+    // and outlen has to be the one the key was prepared for.
+    void round_hash(RoundFunction round_function, byte_t* out, std::size_t outlen, uint64_t message, const byte_t* key) noexcept;
+    // round_hash of a 16 byte message (message_lo in the first 8 bytes, little endian), for the 128 bit domains.
+    // aes encrypts the message as the whole block, blake2b and siphash hash all 16 bytes.
+    void round_hash_wide(RoundFunction round_function, byte_t* out, std::size_t outlen, uint64_t message_lo, uint64_t message_hi,
+        const byte_t* key) noexcept;
+
+    // the widest lane kernel of the round function, keys[i] points to the prepared round key of lane i.
+    // the kernels share the calling convention of the blake2b lane kernels.
+    const Blake2bLaneKernel& round_lane_kernel(RoundFunction round_function) noexcept;
+
+    // AES-128 of one block, for the known answer tests.
+    void aes128_encrypt_block(byte_t* out, const byte_t* in, const byte_t* prepared_key) noexcept;
+}
@@ -0,0 +1,319 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <type_traits>
+#include "ThorpShuffler.hpp"
+
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+// a shuffled view of a contiguous range: view[i] is data[obfuscator.encrypt(i)].
+// the view neither owns the data nor the obfuscator, both have to outlive it.
+// the obfuscator (ThorpObfuscator or OptThorpObfuscator) has to have a domain of exactly the size of the data.
+//
+// sequential access (iterating, gather, scatter) encrypts the indices a block at a time with encrypt_batch
+// and prefetches the elements of the next block while the current one is consumed, so the loads overlap with
+// the work on the elements instead of each paying the full latency.
+
+namespace thorp::detail {
+    // a hint to the cpu to load the cache line of address, write announces a store.
+    template <bool write = false>
+    inline void prefetch(const void* address) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address, write ? 1 : 0);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+        (void)address;
+#endif
+    }
+}
+
+namespace thorp {
+    template <class Obfuscator, class T>
+    class ShuffledView {
+    public:
+        using element_type = T;
+        using value_type = std::remove_cv_t<T>;
+        using reference = T&;
+        using pointer = T*;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        // number of indices encrypted (and elements prefetched) at once.
+        static constexpr size_type block_size = 64;
+        class iterator;
+    public:
+        ShuffledView(T* data, size_type size, const Obfuscator& obfuscator);
+        size_type size() const noexcept;
+        bool empty() const noexcept;
+        reference operator[](size_type index) const;
+        iterator begin() const;
+        iterator end() const;
+        // *out++ = (*this)[i] for every i in order.
+        template <class OutputIt>
+        OutputIt gather(OutputIt out) const;
+        // (*this)[i] = *in++ for every i in order.
+        template <class InputIt>
+        InputIt scatter(InputIt in) const;
+    private:
+        // fills indices with the encrypted indices first..first+n-1 and prefetches their elements.
+        template <bool write>
+        void load_block(size_type first, size_type n, uint64_t* indices) const;
+        template <bool write, class Fn>
+        void for_each_block(Fn&& fn) const;
+    private:
+        T* data_;
+        size_type size_;
+        const Obfuscator* obfuscator_;
+    };
+
+    // random access iterator over a ShuffledView.
+    // the first dereference allocates the index blocks of a traversal, which the copies of the iterator share
+    // (an iterator is a pointer, an index and a shared_ptr). stepping into a block loads it and the one after it
+    // (before it, when walking backwards), so a sequential pass encrypts each block once, a block ahead of the
+    // consumer. jumps (as in sorting) encrypt just their index.
+    // the blocks are not synchronized, iterators sharing them are for one thread at a time.
+    template <class Obfuscator, class T>
+    class ShuffledView<Obfuscator, T>::iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::remove_cv_t<T>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T*;
+        using reference = T&;
+    public:
+        iterator() = default;
+        iterator(const ShuffledView* view, size_type index) noexcept
+            :view_{ view }
+            , index_{ index }{
+        }
+        reference operator*() const
+        {
+            if (!this->traversal_) {
+                this->traversal_ = std::make_shared<Traversal>();
+            };
+            return this->view_->data_[this->traversal_->index(*this->view_, this->index_)];
+        }
+        pointer operator->() const { return &**this; }
+        reference operator[](difference_type offset) const { return (*this->view_)[this->index_ + offset]; }
+        iterator& operator++() noexcept { ++this->index_; return *this; }
+        iterator operator++(int) noexcept { iterator old = *this; ++this->index_; return old; }
+        iterator& operator--() noexcept { --this->index_; return *this; }
+        iterator operator--(int) noexcept { iterator old = *this; --this->index_; return old; }
+        iterator& operator+=(difference_type offset) noexcept { this->index_ += offset; return *this; }
+        iterator& operator-=(difference_type offset) noexcept { this->index_ -= offset; return *this; }
+        friend iterator operator+(iterator it, difference_type offset) noexcept { return it += offset; }
+        friend iterator operator+(difference_type offset, iterator it) noexcept { return it += offset; }
+        friend iterator operator-(iterator it, difference_type offset) noexcept { return it -= offset; }
+        friend difference_type operator-(const iterator& left, const iterator& right) noexcept
+        {
+            return static_cast<difference_type>(left.index_) - static_cast<difference_type>(right.index_);
+        }
+        friend bool operator==(const iterator& left, const iterator& right) noexcept { return left.index_ == right.index_; }
+        friend bool operator!=(const iterator& left, const iterator& right) noexcept { return left.index_ != right.index_; }
+        friend bool operator<(const iterator& left, const iterator& right) noexcept { return left.index_ < right.index_; }
+        friend bool operator>(const iterator& left, const iterator& right) noexcept { return left.index_ > right.index_; }
+        friend bool operator<=(const iterator& left, const iterator& right) noexcept { return left.index_ <= right.index_; }
+        friend bool operator>=(const iterator& left, const iterator& right) noexcept { return left.index_ >= right.index_; }
+    private:
+        // the last few blocks of a traversal: the block of each position in use (two for the two ends of a partition)
+        // and the one loaded ahead of it.
+        class Traversal {
+        public:
+            // the encrypted index. a step to a neighbouring position outside of the blocks loads the block of the
+            // position and the one after it in the direction of the step, a jump only encrypts the index.
+            uint64_t index(const ShuffledView& view, size_type index)
+            {
+                const size_type first = index - index % block_size;
+                const bool backward = index < this->last_index_;
+                const bool step = this->last_index_ != no_index && (index == this->last_index_ + 1 || index + 1 == this->last_index_);
+                this->last_index_ = index;
+                Block* block = this->find(first);
+                if (block == nullptr) {
+                    if (!step) {
+                        return view.obfuscator_->encrypt(index);
+                    };
+                    block = &this->load(view, first, nullptr);
+                };
+                block->last_used = ++this->clock_;
+                if (!block->entered) {
+                    // a block loaded ahead was reached, the next one is loaded while this one is consumed.
+                    block->entered = true;
+                    if (backward && first >= block_size) {
+                        this->load_ahead(view, first - block_size, block);
+                    }
+                    else if (!backward && first + block_size < view.size_) {
+                        this->load_ahead(view, first + block_size, block);
+                    };
+                };
+                return block->indices[index - first];
+            }
+        private:
+            struct Block {
+                size_type first = std::numeric_limits<size_type>::max(); // no block yet
+                uint64_t last_used = 0;
+                // whether a position was in it, a block loaded ahead is not.
+                bool entered = false;
+                std::array<uint64_t, block_size> indices;
+            };
+            static constexpr std::size_t nblocks = 4;
+            static constexpr size_type no_index = std::numeric_limits<size_type>::max();
+
+            Block* find(size_type first) noexcept
+            {
+                for (Block& block : this->blocks_) {
+                    if (block.first == first) {
+                        return &block;
+                    };
+                };
+                return nullptr;
+            }
+            // loads the block at first into the least recently used slot other than keep.
+            Block& load(const ShuffledView& view, size_type first, const Block* keep)
+            {
+                Block* victim = nullptr;
+                for (Block& block : this->blocks_) {
+                    if (&block != keep && (victim == nullptr || block.last_used < victim->last_used)) {
+                        victim = &block;
+                    };
+                };
+                victim->first = first;
+                victim->entered = false;
+                victim->last_used = this->clock_;
+                view.template load_block<false>(first, std::min(block_size, view.size_ - first), victim->indices.data());
+                return *victim;
+            }
+            void load_ahead(const ShuffledView& view, size_type first, const Block* keep)
+            {
+                if (this->find(first) == nullptr) {
+                    this->load(view, first, keep);
+                };
+            }
+        private:
+            std::array<Block, nblocks> blocks_;
+            uint64_t clock_ = 0;
+            size_type last_index_ = no_index;
+        };
+    private:
+        const ShuffledView* view_{ nullptr };
+        size_type index_{ 0 };
+        mutable std::shared_ptr<Traversal> traversal_;
+    };
+
+    // a view of a contiguous container (anything with std::data and std::size).
+    template <class Obfuscator, class Container>
+    auto make_shuffled_view(Container& container, const Obfuscator& obfuscator)
+    {
+        using element_type = std::remove_pointer_t<decltype(std::data(container))>;
+        return ShuffledView<Obfuscator, element_type>{ std::data(container), std::size(container), obfuscator };
+    }
+}
+
+namespace thorp {
+    template <class Obfuscator, class T>
+    ShuffledView<Obfuscator, T>::ShuffledView(T* data, size_type size, const Obfuscator& obfuscator)
+        :data_{ data }
+        , size_{ size }
+        , obfuscator_{ &obfuscator }{
+        assert(obfuscator.max_message() < std::numeric_limits<uint64_t>::max()); // the domain has to fit into memory anyway.
+        assert(this->size_ == obfuscator.max_message() + 1);
+    }
+
+    template <class Obfuscator, class T>
+    auto ShuffledView<Obfuscator, T>::size() const noexcept -> size_type
+    {
+        return this->size_;
+    }
+
+    template <class Obfuscator, class T>
+    bool ShuffledView<Obfuscator, T>::empty() const noexcept
+    {
+        return this->size_ == 0;
+    }
+
+    template <class Obfuscator, class T>
+    auto ShuffledView<Obfuscator, T>::operator[](size_type index) const -> reference
+    {
+        assert(index < this->size_);
+        return this->data_[this->obfuscator_->encrypt(index)];
+    }
+
+    template <class Obfuscator, class T>
+    auto ShuffledView<Obfuscator, T>::begin() const -> iterator
+    {
+        return iterator{ this, 0 };
+    }
+
+    template <class Obfuscator, class T>
+    auto ShuffledView<Obfuscator, T>::end() const -> iterator
+    {
+        return iterator{ this, this->size_ };
+    }
+
+    template <class Obfuscator, class T>
+    template <bool write>
+    void ShuffledView<Obfuscator, T>::load_block(size_type first, size_type n, uint64_t* indices) const
+    {
+        std::iota(indices, indices + n, static_cast<uint64_t>(first));
+        this->obfuscator_->encrypt_batch(indices, indices, n);
+        for (size_type i = 0; i < n; ++i) {
+            detail::prefetch<write>(this->data_ + indices[i]);
+        };
+    }
+
+    // calls fn(first, n, indices) for every block, the next block is encrypted and prefetched
+    // before fn works on the current one.
+    template <class Obfuscator, class T>
+    template <bool write, class Fn>
+    void ShuffledView<Obfuscator, T>::for_each_block(Fn&& fn) const
+    {
+        std::array<std::array<uint64_t, block_size>, 2> blocks{};
+        if (this->size_ == 0) {
+            return;
+        };
+        this->load_block<write>(0, std::min(block_size, this->size_), blocks[0].data());
+        for (size_type first = 0, iblock = 0; first < this->size_; first += block_size, iblock ^= 1) {
+            const size_type next = first + block_size;
+            if (next < this->size_) {
+                this->load_block<write>(next, std::min(block_size, this->size_ - next), blocks[iblock ^ 1].data());
+            };
+            fn(first, std::min(block_size, this->size_ - first), blocks[iblock].data());
+        };
+    }
+
+    template <class Obfuscator, class T>
+    template <class OutputIt>
+    OutputIt ShuffledView<Obfuscator, T>::gather(OutputIt out) const
+    {
+        this->for_each_block<false>([&](size_type, size_type n, const uint64_t* indices) {
+            for (size_type i = 0; i < n; ++i) {
+                *out = this->data_[indices[i]];
+                ++out;
+            };
+            });
+        return out;
+    }
+
+    template <class Obfuscator, class T>
+    template <class InputIt>
+    InputIt ShuffledView<Obfuscator, T>::scatter(InputIt in) const
+    {
+        static_assert(!std::is_const_v<T>, "can not scatter into a view of const elements");
+        this->for_each_block<true>([&](size_type, size_type n, const uint64_t* indices) {
+            for (size_type i = 0; i < n; ++i) {
+                this->data_[indices[i]] = *in;
+                ++in;
+            };
+            });
+        return in;
+    }
+}
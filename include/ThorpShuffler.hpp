@@ -9,6 +9,8 @@
 #include <iostream>
 #include <functional>
 #include <sodium.h>
+#include "ThorpRoundFunction.hpp"
+#include "ThorpInstrumentation.hpp"
 
 //before trying to understand this code, please read the paper by
 //  Ben Morris, Phillip Rogawayand and Till Stegers "How to Encipher Messages on a Small Domain" 2009.
@@ -22,47 +24,153 @@ namespace thorp {
     constexpr inline uint64_t nrounds_per_pass(uint64_t max_message)noexcept;
 
     // Old implementation. 
+    // immutable after construction, the const member functions may be called concurrently from any threads.
     class ThorpObfuscator {
     public:
-        ThorpObfuscator(std::vector<byte_t> round_keys_data, uint64_t max_message, uint64_t npasses);
-        static ThorpObfuscator from_uint64(uint64_t key_number, uint64_t max_message);
+        // throws std::invalid_argument if the round function is not supported by this cpu.
+        ThorpObfuscator(std::vector<byte_t> round_keys_data, uint64_t max_message, uint64_t npasses,
+            RoundFunction round_function = RoundFunction::blake2b);
+        static ThorpObfuscator from_uint64(uint64_t key_number, uint64_t max_message,
+            RoundFunction round_function = RoundFunction::blake2b);
         static constexpr uint64_t round_keys_data_size(uint64_t npasses, uint64_t max_message);
-        uint64_t encrypt(uint64_t plaintext)const;
-        uint64_t decrypt(uint64_t cyphertext) const;
+        uint64_t max_message()const noexcept;
+        // neither allocates.
+        uint64_t encrypt(uint64_t plaintext)const noexcept;
+        uint64_t decrypt(uint64_t cyphertext) const noexcept;
+        // encrypts/decrypts count messages, bit-identical to calling encrypt/decrypt for each one.
+        // the messages are hashed in lockstep by a multi lane blake2b kernel. in and out may be the same array.
+        void encrypt_batch(const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const;
+        void decrypt_batch(const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const;
+        // writes encrypt(i) to out[i] for the whole domain, out has to hold max_message+1 elements.
+        // the domain is advanced round by round, so each hash is computed once per pair of messages.
+        // nthreads == 0 uses all hardware threads.
+        void permute_domain(uint64_t* out, unsigned nthreads = 0) const;
+        // writes decrypt(i) to out[i] for the whole domain.
+        void inverse_permute_domain(uint64_t* out, unsigned nthreads = 0) const;
     private:
         static constexpr std::array<byte_t, sizeof(uint64_t)> generate_message(uint64_t);
-        static bool generate_random_bit(uint64_t, const byte_t*, unsigned long long)noexcept;
+        bool generate_random_bit(uint64_t, const byte_t*)const noexcept;
+        // the round keys as the round function consumes them and the distance between two of them.
+        const byte_t* round_keys()const noexcept;
+        std::size_t round_key_stride()const noexcept;
+        // the bit is the parity of the first 16 bytes of the hash (all of it for shorter hashes).
+        static constexpr std::size_t hash_size(RoundFunction round_function) noexcept;
     private:
         std::vector<byte_t> passkeys_data_;
         uint64_t npasses_;
         uint64_t max_message_;
+        RoundFunction round_function_;
+        // the round keys in the form the round function consumes them, empty if it uses passkeys_data_ directly.
+        std::vector<byte_t> prepared_round_keys_;
     };
 
-    constexpr inline uint64_t calculate_optimization_level_max() {
+    constexpr inline uint64_t calculate_optimization_level_max(uint64_t hash_bits = crypto_generichash_BYTES_MAX * CHAR_BIT) {
         // libsodium uses blake2d wich generates up to 512 bits.
         static_assert(crypto_generichash_BYTES_MAX * CHAR_BIT == 512, "unexpected hash length");
         //the largest number such that k*2^(k-1) <= bits in the hash.
         // see the paper chaper 5.
-        return 7;
+        uint64_t level = 0;
+        while (((level + 1) << level) <= hash_bits) {
+            ++level;
+        };
+        return level;
+    };
+
+    // scratch space of OptThorpObfuscator::encrypt/decrypt: the hash of the current opt round.
+    // a context can be kept per thread and passed to every call, it lives wherever the caller puts it
+    // (stack, thread_local, ...) and is never allocated by the obfuscator. one thread at a time.
+    struct CipherContext {
+        std::array<byte_t, crypto_generichash_BYTES_MAX> hash;
+        // the round key of the opt round if it had to be derived (KeySchedule::derived).
+        std::array<byte_t, detail::prepared_round_key_size_max> round_key;
+        uint64_t opt_round = 0;
+        bool has_hash = false;
+    };
+
+    // how an OptThorpObfuscator keeps its round keys.
+    enum class KeySchedule {
+        expanded, // all round keys are derived (and prepared) up front, the fastest.
+        derived   // only the master key is kept, every opt round derives its key when it is needed.
     };
 
     // more newerimplementation, incorporates the "5x" trick (which is here a up to 7x trick).
+    // like ThorpObfuscator immutable after construction, the const member functions may be called concurrently.
     class OptThorpObfuscator {
-        static constexpr uint64_t hash_size_ = crypto_generichash_BYTES_MAX;
     public:
         static constexpr uint64_t optimization_level_max =  calculate_optimization_level_max();
+        // the maximum for a round function, derived from the width of its output.
+        static constexpr uint64_t optimization_level_max_for(RoundFunction round_function) noexcept
+        {
+            return calculate_optimization_level_max(round_function_output_bits(round_function));
+        }
     public:
-        OptThorpObfuscator(std::vector<byte_t> round_keys_data, uint64_t max_message, uint64_t npasses, uint64_t optimization_lvl);
-        static OptThorpObfuscator from_uint64(uint64_t key_number, uint64_t max_message);
+        // throws std::invalid_argument if the round function is not supported by this cpu, as do all the factories.
+        OptThorpObfuscator(std::vector<byte_t> round_keys_data, uint64_t max_message, uint64_t npasses, uint64_t optimization_lvl,
+            RoundFunction round_function = RoundFunction::blake2b);
+        // uses the largest optimization level the round function allows.
+        static OptThorpObfuscator from_uint64(uint64_t key_number, uint64_t max_message,
+            RoundFunction round_function = RoundFunction::blake2b);
+        static OptThorpObfuscator from_uint64(uint64_t key_number, uint64_t max_message, uint64_t npasses, uint64_t optimization_level,
+            RoundFunction round_function = RoundFunction::blake2b);
+        // round key i is crypto_kdf_derive_from_key(16, i, "ThorpKey", master_key), the results are the same for both schedules.
+        // a derived schedule keeps only the 32 byte master key, but every opt round costs a key derivation
+        // (and the preparation of the key) on top of its hash.
+        static OptThorpObfuscator from_master_key(const std::array<byte_t, detail::master_key_size>& master_key,
+            uint64_t max_message, uint64_t npasses, uint64_t optimization_level,
+            RoundFunction round_function = RoundFunction::blake2b, KeySchedule key_schedule = KeySchedule::derived);
         static constexpr uint64_t round_keys_data_size(uint64_t npasses, uint64_t max_message, uint64_t optimization_level);
-        uint64_t encrypt(uint64_t plaintext)const;
-        uint64_t decrypt(uint64_t cyphertext) const;
+        uint64_t max_message()const noexcept;
+        uint64_t npasses()const noexcept;
+        uint64_t optimization_level()const noexcept;
+        RoundFunction round_function()const noexcept;
+        // a hash of the round keys: equal for obfuscators with the same keys (whatever their key schedule),
+        // without giving the keys away.
+        std::array<byte_t, crypto_generichash_BYTES> key_fingerprint()const;
+        // neither allocates, the overloads without a context use one on the stack.
+        uint64_t encrypt(uint64_t plaintext)const noexcept;
+        uint64_t decrypt(uint64_t cyphertext) const noexcept;
+        uint64_t encrypt(uint64_t plaintext, CipherContext& context)const noexcept;
+        uint64_t decrypt(uint64_t cyphertext, CipherContext& context) const noexcept;
+        // same contract as ThorpObfuscator::encrypt_batch.
+        void encrypt_batch(const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const;
+        void decrypt_batch(const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const;
+        // same contract as ThorpObfuscator::permute_domain, each hash is computed once per opt round
+        // for all 2^optimization_level messages sharing it.
+        void permute_domain(uint64_t* out, unsigned nthreads = 0) const;
+        void inverse_permute_domain(uint64_t* out, unsigned nthreads = 0) const;
+        // out[i] = encrypt(first + i) (decrypt(first + i)) for count consecutive messages.
+        // every distinct hash input of an opt round is hashed once for the whole range,
+        // the more messages share a hash (long ranges, small domains) the less hashes are computed.
+        void encrypt_range(uint64_t first, std::size_t count, uint64_t* out) const;
+        void decrypt_range(uint64_t first, std::size_t count, uint64_t* out) const;
+        // the counters of encrypt/decrypt and the batch and range variants, all zero without THORP_INSTRUMENTATION.
+        InstrumentationSnapshot instrumentation() const noexcept;
+        void reset_instrumentation() const noexcept;
+        // times the rounds of every n-th scalar encrypt/decrypt, 0 turns the sampling off.
+        void set_cycle_sampling(uint64_t every) const noexcept;
+    private:
+        // encrypt_batch/decrypt_batch with the hashes shared as in encrypt_range.
+        void encrypt_shared(const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const;
+        void decrypt_shared(const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const;
+        OptThorpObfuscator(const std::array<byte_t, detail::master_key_size>& master_key, uint64_t max_message, uint64_t npasses,
+            uint64_t optimization_level, RoundFunction round_function);
+        // same as in ThorpObfuscator, there is one round key per opt round.
+        const byte_t* round_keys()const noexcept;
+        std::size_t round_key_stride()const noexcept;
+        detail::RoundKeySource round_key_source()const noexcept;
     private:
+        // only kept if the round function uses the round keys as they are.
         std::vector<byte_t> round_keys_data_;
         uint64_t npasses_;
         uint64_t max_message_;
         uint64_t optimization_level_;
-
+        RoundFunction round_function_;
+        // the round keys in the form the round function consumes them, empty if it uses round_keys_data_ directly.
+        std::vector<byte_t> prepared_round_keys_;
+        KeySchedule key_schedule_{ KeySchedule::expanded };
+        // only used by KeySchedule::derived.
+        std::array<byte_t, detail::master_key_size> master_key_{};
+        detail::InstrumentationHandle instrumentation_;
     };
 }//thorp
 
@@ -78,6 +186,38 @@ namespace thorp{
         };
         return message_out;
     }
+    inline constexpr std::size_t ThorpObfuscator::hash_size(RoundFunction round_function) noexcept
+    {
+        const std::size_t output_bytes = round_function_output_bits(round_function) / CHAR_BIT;
+        return output_bytes < crypto_generichash_BYTES_MIN ? output_bytes : crypto_generichash_BYTES_MIN;
+    }
+
+    // the largest message of the domain, the domain has max_message()+1 elements.
+    inline uint64_t ThorpObfuscator::max_message() const noexcept
+    {
+        return this->max_message_;
+    }
+
+    inline uint64_t OptThorpObfuscator::max_message() const noexcept
+    {
+        return this->max_message_;
+    }
+
+    inline uint64_t OptThorpObfuscator::npasses() const noexcept
+    {
+        return this->npasses_;
+    }
+
+    inline uint64_t OptThorpObfuscator::optimization_level() const noexcept
+    {
+        return this->optimization_level_;
+    }
+
+    inline RoundFunction OptThorpObfuscator::round_function() const noexcept
+    {
+        return this->round_function_;
+    }
+
     // calculate the minimum number of bytes the ThorpObfuscator requires upon instanciation.
     inline constexpr uint64_t ThorpObfuscator::round_keys_data_size(uint64_t npasses, uint64_t max_message)
     {
@@ -91,7 +231,7 @@ namespace thorp{
     {
         const uint64_t nrounds = nrounds_per_pass(max_message) * npasses;
         const uint64_t nopt_rounds = nrounds / optimization_level + (nrounds % optimization_level > 0 ? 1 : 0);
-        const uint64_t nroundkeys_bytes_sum = nrounds * crypto_generichash_KEYBYTES_MIN;
+        const uint64_t nroundkeys_bytes_sum = nopt_rounds * crypto_generichash_KEYBYTES_MIN;
         return nroundkeys_bytes_sum;
     }
     
@@ -0,0 +1,163 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "ThorpShuffler.hpp"
+
+// OptThorpObfuscator with the domain, the number of passes and the optimization level fixed at compile time.
+// the results are bit-identical to OptThorpObfuscator{ keys, MaxMessage, Passes, OptLevel, Rf }.
+//
+// all round counts are constants, the rounds sharing a hash (an opt round) are unrolled and every division
+// is by a constant: the compiler turns the ones by powers of two into shifts and masks and the others
+// into a multiplication by the reciprocal. the round keys live in the object, encrypt and decrypt don't allocate.
+
+namespace thorp {
+    template <uint64_t MaxMessage, uint64_t Passes, uint64_t OptLevel, RoundFunction Rf = RoundFunction::blake2b>
+    class StaticOptThorpObfuscator {
+    public:
+        static constexpr uint64_t max_message_value = MaxMessage;
+        static constexpr uint64_t npasses = Passes;
+        static constexpr uint64_t optimization_level = OptLevel;
+        static constexpr RoundFunction round_function = Rf;
+        static constexpr uint64_t nrounds = nrounds_per_pass(MaxMessage) * Passes;
+        static constexpr uint64_t nopt_rounds = nrounds / OptLevel + (nrounds % OptLevel > 0 ? 1 : 0);
+    private:
+        static constexpr uint64_t half_max = MaxMessage / 2 + 1;
+        static constexpr uint64_t projector = half_max >> (OptLevel - 1);          // equiv N/32
+        static constexpr uint64_t selector_bits = 1ull << (OptLevel - 1);
+        static constexpr std::size_t hash_size = round_function_output_bits(Rf) / CHAR_BIT;
+        static constexpr std::size_t round_key_stride = detail::prepared_round_key_size(Rf) > 0
+            ? detail::prepared_round_key_size(Rf) : detail::round_key_size;
+
+        static_assert(MaxMessage % 2 == 1, "Thorpe can only handle even message_spaces");
+        static_assert(OptLevel > 0 && OptLevel <= OptThorpObfuscator::optimization_level_max_for(Rf),
+            "the optimization level is not supported by the round function");
+        // every selector has to fit into the 2^(OptLevel-1) bits a round takes from the hash.
+        static_assert(half_max % selector_bits == 0, "half of the domain has to be divisible by 2^(OptLevel-1)");
+    public:
+        explicit StaticOptThorpObfuscator(const std::vector<byte_t>& round_keys_data);
+        // same keys as OptThorpObfuscator::from_uint64 derives for these parameters.
+        static StaticOptThorpObfuscator from_uint64(uint64_t key_number);
+        static constexpr uint64_t max_message() noexcept { return MaxMessage; }
+        uint64_t encrypt(uint64_t plaintext) const noexcept;
+        uint64_t decrypt(uint64_t cyphertext) const noexcept;
+    private:
+        using Hash = std::array<byte_t, hash_size>;
+        Hash opt_round_hash(uint64_t remainder, uint64_t iopt_round) const noexcept;
+        template <uint64_t iopt_pass>
+        static uint64_t random_bit(const Hash& hash, uint64_t remainder) noexcept;
+        template <std::size_t... iopt_pass>
+        uint64_t encrypt_opt_round(uint64_t message, uint64_t iopt_round, std::index_sequence<iopt_pass...>) const noexcept;
+        template <std::size_t... iopt_pass>
+        uint64_t decrypt_opt_round(uint64_t message, uint64_t iopt_round, std::index_sequence<iopt_pass...>) const noexcept;
+    private:
+        // one round key per opt round, in the form the round function consumes them.
+        std::array<byte_t, nopt_rounds * round_key_stride> round_keys_{};
+    };
+}
+
+namespace thorp {
+    template <uint64_t MaxMessage, uint64_t Passes, uint64_t OptLevel, RoundFunction Rf>
+    StaticOptThorpObfuscator<MaxMessage, Passes, OptLevel, Rf>::StaticOptThorpObfuscator(const std::vector<byte_t>& round_keys_data)
+    {
+        assert(round_keys_data.size() >= nopt_rounds * detail::round_key_size);
+        require_round_function_supported(Rf);
+        if constexpr (detail::prepared_round_key_size(Rf) > 0) {
+            const std::vector<byte_t> prepared = detail::prepare_round_keys(Rf, round_keys_data.data(), nopt_rounds, hash_size);
+            std::copy(prepared.begin(), prepared.end(), this->round_keys_.begin());
+        }
+        else {
+            std::copy_n(round_keys_data.begin(), this->round_keys_.size(), this->round_keys_.begin());
+        };
+    }
+
+    template <uint64_t MaxMessage, uint64_t Passes, uint64_t OptLevel, RoundFunction Rf>
+    auto StaticOptThorpObfuscator<MaxMessage, Passes, OptLevel, Rf>::from_uint64(uint64_t key_number) -> StaticOptThorpObfuscator
+    {
+        std::array<byte_t, randombytes_SEEDBYTES> key{};
+        static_assert(randombytes_SEEDBYTES >= 8, "too short key length");
+        for (int ibyte = 0; ibyte < 8; ++ibyte) {
+            key[ibyte] = static_cast<byte_t>(key_number >> 8 * ibyte);
+        };
+        std::vector<byte_t> round_keys_data(OptThorpObfuscator::round_keys_data_size(Passes, MaxMessage, OptLevel), 0);
+        randombytes_buf_deterministic(round_keys_data.data(), round_keys_data.size(), key.data());
+        return StaticOptThorpObfuscator{ round_keys_data };
+    }
+
+    template <uint64_t MaxMessage, uint64_t Passes, uint64_t OptLevel, RoundFunction Rf>
+    auto StaticOptThorpObfuscator<MaxMessage, Passes, OptLevel, Rf>::opt_round_hash(uint64_t remainder, uint64_t iopt_round) const noexcept
+        -> Hash
+    {
+        Hash hash;
+        detail::round_hash(Rf, hash.data(), hash.size(), remainder, this->round_keys_.data() + iopt_round * round_key_stride);
+        return hash;
+    }
+
+    // the bit of the round iopt_pass of an opt round for a message with the given remainder, see OptimizedBitGenerator.
+    template <uint64_t MaxMessage, uint64_t Passes, uint64_t OptLevel, RoundFunction Rf>
+    template <uint64_t iopt_pass>
+    uint64_t StaticOptThorpObfuscator<MaxMessage, Passes, OptLevel, Rf>::random_bit(const Hash& hash, uint64_t remainder) noexcept
+    {
+        const uint64_t hi = (remainder >> iopt_pass) / projector;             // equiv hi
+        const uint64_t lo = remainder % (1ull << iopt_pass);                   // equiv lo
+        const uint64_t selector = (hi << iopt_pass) + lo;                      // equiv b
+        assert(selector < selector_bits);
+        const uint64_t ibit = iopt_pass * selector_bits + selector;
+        return (hash[ibit / 8] >> (ibit % 8)) & 1;
+    }
+
+    // the rounds 0..sizeof...(iopt_pass)-1 of the opt round iopt_round, the last opt round may be shorter.
+    // the remainder a, and with it the hash, is the same for all rounds of an opt round.
+    template <uint64_t MaxMessage, uint64_t Passes, uint64_t OptLevel, RoundFunction Rf>
+    template <std::size_t... iopt_pass>
+    uint64_t StaticOptThorpObfuscator<MaxMessage, Passes, OptLevel, Rf>::encrypt_opt_round(uint64_t message, uint64_t iopt_round,
+        std::index_sequence<iopt_pass...>) const noexcept
+    {
+        const Hash hash = this->opt_round_hash((message % half_max) % projector, iopt_round);
+        ((message = (message % half_max) * 2 + (random_bit<iopt_pass>(hash, message % half_max) ^ message / half_max)), ...);
+        return message;
+    }
+
+    template <uint64_t MaxMessage, uint64_t Passes, uint64_t OptLevel, RoundFunction Rf>
+    template <std::size_t... iopt_pass>
+    uint64_t StaticOptThorpObfuscator<MaxMessage, Passes, OptLevel, Rf>::decrypt_opt_round(uint64_t message, uint64_t iopt_round,
+        std::index_sequence<iopt_pass...>) const noexcept
+    {
+        // the rounds are undone from the last one of the opt round to the first one.
+        constexpr uint64_t last_pass = sizeof...(iopt_pass) - 1;
+        const Hash hash = this->opt_round_hash(((message / 2) >> last_pass) % projector, iopt_round);
+        ((message = message / 2 + half_max * (random_bit<last_pass - iopt_pass>(hash, message / 2) ^ message % 2)), ...);
+        return message;
+    }
+
+    template <uint64_t MaxMessage, uint64_t Passes, uint64_t OptLevel, RoundFunction Rf>
+    uint64_t StaticOptThorpObfuscator<MaxMessage, Passes, OptLevel, Rf>::encrypt(uint64_t plaintext) const noexcept
+    {
+        constexpr uint64_t nfull_opt_rounds = nrounds / OptLevel;
+        uint64_t message = plaintext;
+        for (uint64_t iopt_round = 0; iopt_round < nfull_opt_rounds; ++iopt_round) {
+            message = this->encrypt_opt_round(message, iopt_round, std::make_index_sequence<OptLevel>{});
+        };
+        if constexpr (nrounds % OptLevel > 0) {
+            message = this->encrypt_opt_round(message, nfull_opt_rounds, std::make_index_sequence<nrounds % OptLevel>{});
+        };
+        return message;
+    }
+
+    template <uint64_t MaxMessage, uint64_t Passes, uint64_t OptLevel, RoundFunction Rf>
+    uint64_t StaticOptThorpObfuscator<MaxMessage, Passes, OptLevel, Rf>::decrypt(uint64_t cyphertext) const noexcept
+    {
+        constexpr uint64_t nfull_opt_rounds = nrounds / OptLevel;
+        uint64_t message = cyphertext;
+        if constexpr (nrounds % OptLevel > 0) {
+            message = this->decrypt_opt_round(message, nfull_opt_rounds, std::make_index_sequence<nrounds % OptLevel>{});
+        };
+        for (uint64_t iopt_round = nfull_opt_rounds; iopt_round-- > 0;) {
+            message = this->decrypt_opt_round(message, iopt_round, std::make_index_sequence<OptLevel>{});
+        };
+        return message;
+    }
+}
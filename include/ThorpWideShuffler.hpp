@@ -0,0 +1,243 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "ThorpShuffler.hpp"
+
+// OptThorpObfuscator with the message type as template parameter, for domains beyond 2^64 (uuids).
+// BasicOptThorpObfuscator<uint64_t> is bit-identical to OptThorpObfuscator with the same keys and parameters,
+// OptThorpObfuscator128 runs on native unsigned __int128 arithmetic and hashes 16 byte messages
+// (detail::round_hash_wide), one call enciphers a whole 128 bit id.
+//
+// only encrypt and decrypt are provided, the batch, range and domain functions stay with OptThorpObfuscator.
+// the domain splits in halves of half_max = max_message/2+1 and the opt rounds in 2^(optimization_level-1) parts
+// of it, for the usual domains of 2^n messages both are powers of two and the wide divisions become shifts and masks.
+
+namespace thorp {
+#if defined(__SIZEOF_INT128__)
+#define THORP_HAS_INT128 1
+    using uint128_t = unsigned __int128;
+#else
+#define THORP_HAS_INT128 0
+#endif
+
+    namespace detail {
+        // divides by a fixed divisor, with shifts and masks if it is a power of two.
+        template <class Message>
+        class DomainDivisor {
+        public:
+            explicit DomainDivisor(Message divisor) noexcept
+                :divisor_{ divisor }
+                , power_of_two_{ divisor != 0 && (divisor & (divisor - 1)) == 0 }{
+                while (this->power_of_two_ && (Message{ 1 } << this->shift_) != divisor) {
+                    ++this->shift_;
+                };
+            }
+            Message quotient(Message value) const noexcept
+            {
+                return this->power_of_two_ ? value >> this->shift_ : value / this->divisor_;
+            }
+            Message remainder(Message value) const noexcept
+            {
+                return this->power_of_two_ ? value & (this->divisor_ - 1) : value % this->divisor_;
+            }
+            Message divisor() const noexcept { return this->divisor_; }
+        private:
+            Message divisor_;
+            bool power_of_two_;
+            unsigned shift_ = 0;
+        };
+
+        // ceil(log_2(max_message + 1)), the number of bits of max_message.
+        template <class Message>
+        constexpr uint64_t nrounds_per_pass_of(Message max_message) noexcept
+        {
+            if constexpr (sizeof(Message) <= sizeof(uint64_t)) {
+                return nrounds_per_pass(static_cast<uint64_t>(max_message));
+            }
+            else {
+                uint64_t nbits = 0;
+                for (; max_message > 0; max_message >>= 1) {
+                    ++nbits;
+                };
+                return nbits;
+            };
+        }
+    }
+
+    template <class Message>
+    class BasicOptThorpObfuscator {
+        static_assert(std::is_unsigned<Message>::value || sizeof(Message) == 16, "the messages have to be unsigned integers");
+        static_assert(sizeof(Message) == sizeof(uint64_t) || sizeof(Message) == 2 * sizeof(uint64_t), "64 or 128 bit messages");
+    public:
+        using message_type = Message;
+
+        BasicOptThorpObfuscator(std::vector<byte_t> round_keys_data, Message max_message, uint64_t npasses, uint64_t optimization_level,
+            RoundFunction round_function = RoundFunction::blake2b);
+        // the keys OptThorpObfuscator::from_uint64 derives: 8 passes and the largest optimization level.
+        static BasicOptThorpObfuscator from_uint64(uint64_t key_number, Message max_message,
+            RoundFunction round_function = RoundFunction::blake2b);
+        static BasicOptThorpObfuscator from_uint64(uint64_t key_number, Message max_message, uint64_t npasses, uint64_t optimization_level,
+            RoundFunction round_function = RoundFunction::blake2b);
+        static constexpr uint64_t round_keys_data_size(uint64_t npasses, Message max_message, uint64_t optimization_level) noexcept;
+        Message max_message() const noexcept { return this->max_message_; }
+        uint64_t npasses() const noexcept { return this->npasses_; }
+        uint64_t optimization_level() const noexcept { return this->optimization_level_; }
+        // neither allocates.
+        Message encrypt(Message plaintext) const noexcept;
+        Message decrypt(Message cyphertext) const noexcept;
+    private:
+        using Hash = std::array<byte_t, crypto_generichash_BYTES_MAX>;
+        void opt_round_hash(Hash& hash, Message remainder, uint64_t iopt_round) const noexcept;
+        uint64_t random_bit(const Hash& hash, Message remainder, uint64_t iopt_pass) const noexcept;
+        const byte_t* round_key(uint64_t iopt_round) const noexcept;
+    private:
+        std::vector<byte_t> round_keys_;
+        std::size_t round_key_stride_;
+        Message max_message_;
+        uint64_t npasses_;
+        uint64_t optimization_level_;
+        RoundFunction round_function_;
+        std::size_t hash_size_;
+        uint64_t nrounds_;
+        detail::DomainDivisor<Message> half_max_;
+        detail::DomainDivisor<Message> projector_;
+    };
+
+#if THORP_HAS_INT128
+    using OptThorpObfuscator128 = BasicOptThorpObfuscator<uint128_t>;
+#endif
+}
+
+namespace thorp {
+    template <class Message>
+    constexpr uint64_t BasicOptThorpObfuscator<Message>::round_keys_data_size(uint64_t npasses, Message max_message,
+        uint64_t optimization_level) noexcept
+    {
+        const uint64_t nrounds = detail::nrounds_per_pass_of(max_message) * npasses;
+        return (nrounds + optimization_level - 1) / optimization_level * detail::round_key_size;
+    }
+
+    template <class Message>
+    BasicOptThorpObfuscator<Message>::BasicOptThorpObfuscator(std::vector<byte_t> round_keys_data, Message max_message,
+        uint64_t npasses, uint64_t optimization_level, RoundFunction round_function)
+        :round_key_stride_{ detail::prepared_round_key_size(round_function) > 0 ? detail::prepared_round_key_size(round_function)
+            : detail::round_key_size }
+        , max_message_{ max_message }
+        , npasses_{ npasses }
+        , optimization_level_{ optimization_level }
+        , round_function_{ round_function }
+        , hash_size_{ round_function_output_bits(round_function) / CHAR_BIT }
+        , nrounds_{ detail::nrounds_per_pass_of(max_message) * npasses }
+        , half_max_{ max_message / 2 + 1 }
+        , projector_{ (max_message / 2 + 1) >> (optimization_level - 1) }{
+        assert(optimization_level > 0 && optimization_level <= OptThorpObfuscator::optimization_level_max_for(round_function));
+        assert(max_message % 2 == 1); // Thorpe can only handle even message_spaces
+        assert(this->half_max_.divisor() % (Message{ 1 } << (optimization_level - 1)) == 0);
+        require_round_function_supported(round_function);
+        const uint64_t nopt_rounds = (this->nrounds_ + optimization_level - 1) / optimization_level;
+        assert(round_keys_data.size() >= nopt_rounds * detail::round_key_size);
+        this->round_keys_ = detail::prepare_round_keys(round_function, round_keys_data.data(), nopt_rounds, this->hash_size_);
+        if (this->round_keys_.empty()) {
+            round_keys_data.resize(nopt_rounds * detail::round_key_size);
+            this->round_keys_ = std::move(round_keys_data);
+        }
+        else {
+            sodium_memzero(round_keys_data.data(), round_keys_data.size());
+        };
+    }
+
+    template <class Message>
+    auto BasicOptThorpObfuscator<Message>::from_uint64(uint64_t key_number, Message max_message, RoundFunction round_function)
+        -> BasicOptThorpObfuscator
+    {
+        return from_uint64(key_number, max_message, 8, OptThorpObfuscator::optimization_level_max_for(round_function), round_function);
+    }
+
+    template <class Message>
+    auto BasicOptThorpObfuscator<Message>::from_uint64(uint64_t key_number, Message max_message, uint64_t npasses,
+        uint64_t optimization_level, RoundFunction round_function) -> BasicOptThorpObfuscator
+    {
+        std::array<byte_t, randombytes_SEEDBYTES> key{};
+        static_assert(randombytes_SEEDBYTES >= 8, "too short key length");
+        for (int ibyte = 0; ibyte < 8; ++ibyte) {
+            key[ibyte] = static_cast<byte_t>(key_number >> 8 * ibyte);
+        };
+        std::vector<byte_t> round_keys_data(round_keys_data_size(npasses, max_message, optimization_level), 0);
+        randombytes_buf_deterministic(round_keys_data.data(), round_keys_data.size(), key.data());
+        return BasicOptThorpObfuscator{ std::move(round_keys_data), max_message, npasses, optimization_level, round_function };
+    }
+
+    template <class Message>
+    const byte_t* BasicOptThorpObfuscator<Message>::round_key(uint64_t iopt_round) const noexcept
+    {
+        return this->round_keys_.data() + iopt_round * this->round_key_stride_;
+    }
+
+    // the hash of the remainder a of an opt round, 8 byte messages for 64 bit domains and 16 byte ones for wider domains.
+    template <class Message>
+    void BasicOptThorpObfuscator<Message>::opt_round_hash(Hash& hash, Message remainder, uint64_t iopt_round) const noexcept
+    {
+        if constexpr (sizeof(Message) == sizeof(uint64_t)) {
+            detail::round_hash(this->round_function_, hash.data(), this->hash_size_, remainder, this->round_key(iopt_round));
+        }
+        else {
+            detail::round_hash_wide(this->round_function_, hash.data(), this->hash_size_, static_cast<uint64_t>(remainder),
+                static_cast<uint64_t>(remainder >> 64), this->round_key(iopt_round));
+        };
+    }
+
+    // see OptimizedBitGenerator::generate_bit
+    template <class Message>
+    uint64_t BasicOptThorpObfuscator<Message>::random_bit(const Hash& hash, Message remainder, uint64_t iopt_pass) const noexcept
+    {
+        const uint64_t hi = static_cast<uint64_t>(this->projector_.quotient(remainder >> iopt_pass));  // equiv hi
+        const uint64_t lo = static_cast<uint64_t>(remainder) % (1ull << iopt_pass);                  // equiv lo
+        const uint64_t selector = (hi << iopt_pass) + lo;                                             // equiv b
+        assert(selector < (1ull << (this->optimization_level_ - 1)));
+        const uint64_t ibit = iopt_pass * (1ull << (this->optimization_level_ - 1)) + selector;
+        return (hash[ibit / 8] >> (ibit % 8)) & 1;
+    }
+
+    template <class Message>
+    Message BasicOptThorpObfuscator<Message>::encrypt(Message plaintext) const noexcept
+    {
+        Message message = plaintext;
+        Hash hash;
+        for (uint64_t first_round = 0; first_round < this->nrounds_; first_round += this->optimization_level_) {
+            const uint64_t npasses = std::min(this->optimization_level_, this->nrounds_ - first_round);
+            // the remainder a, and with it the hash, is the same for all rounds of an opt round.
+            this->opt_round_hash(hash, this->projector_.remainder(this->half_max_.remainder(message)), first_round / this->optimization_level_);
+            for (uint64_t iopt_pass = 0; iopt_pass < npasses; ++iopt_pass) {
+                const Message remainder = this->half_max_.remainder(message);
+                const Message leading_bit = this->half_max_.quotient(message);
+                message = remainder * 2 + (static_cast<Message>(this->random_bit(hash, remainder, iopt_pass)) ^ leading_bit);
+            };
+        };
+        return message;
+    }
+
+    template <class Message>
+    Message BasicOptThorpObfuscator<Message>::decrypt(Message cyphertext) const noexcept
+    {
+        Message message = cyphertext;
+        Hash hash;
+        const uint64_t nopt_rounds = (this->nrounds_ + this->optimization_level_ - 1) / this->optimization_level_;
+        for (uint64_t iopt_round = nopt_rounds; iopt_round-- > 0;) {
+            const uint64_t first_round = iopt_round * this->optimization_level_;
+            const uint64_t npasses = std::min(this->optimization_level_, this->nrounds_ - first_round);
+            // the rounds are undone from the last one of the opt round to the first one.
+            this->opt_round_hash(hash, this->projector_.remainder((message / 2) >> (npasses - 1)), iopt_round);
+            for (uint64_t iopt_pass = npasses; iopt_pass-- > 0;) {
+                const Message remainder = message / 2;
+                const Message trailing_bit = message % 2;
+                message = remainder + this->half_max_.divisor() * (static_cast<Message>(this->random_bit(hash, remainder, iopt_pass)) ^ trailing_bit);
+            };
+        };
+        return message;
+    }
+}
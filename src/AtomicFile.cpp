@@ -0,0 +1,92 @@
+#include "AtomicFile.hpp"
+#include <atomic>
+#include <cerrno>
+#include <system_error>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // creates a new file path.XXXXXX and opens it for writing, nullptr (with errno set) if that fails.
+    std::FILE* create_temporary(const std::string& path, std::string& temporary_path) noexcept
+    {
+#if defined(_WIN32)
+        // the process id and a counter make the name unique, "x" fails if the file exists anyway.
+        static std::atomic<unsigned> next_temporary{ 0 };
+        temporary_path = path + "." + std::to_string(GetCurrentProcessId()) + "-"
+            + std::to_string(next_temporary.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+        return std::fopen(temporary_path.c_str(), "wbx");
+#else
+        temporary_path = path + ".XXXXXX";
+        const int descriptor = ::mkstemp(&temporary_path[0]);
+        if (descriptor < 0) {
+            return nullptr;
+        };
+        // mkstemp creates the file for the owner only, the tables are meant to be read by other processes.
+        ::fchmod(descriptor, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        std::FILE* const file = ::fdopen(descriptor, "wb");
+        if (file == nullptr) {
+            const int error = errno;
+            ::close(descriptor);
+            std::remove(temporary_path.c_str());
+            errno = error;
+        };
+        return file;
+#endif
+    }
+
+    // replaces to with from, both on the same file system.
+    bool replace_file(const std::string& from, const std::string& to) noexcept
+    {
+#if defined(_WIN32)
+        // rename fails on windows if the target exists.
+        return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        // rename replaces the target in one step.
+        return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+    }
+}
+
+namespace thorp::detail {
+    void write_file_atomically(const std::string& path,
+        const std::function<void(std::FILE* file, const std::string& temporary_path)>& write)
+    {
+        std::string temporary_path;
+        std::FILE* const file = create_temporary(path, temporary_path);
+        if (file == nullptr) {
+            throw std::system_error(errno, std::generic_category(), "can not create a temporary file for " + path);
+        };
+        try {
+            write(file, temporary_path);
+        }
+        catch (...) {
+            std::fclose(file);
+            std::remove(temporary_path.c_str());
+            throw;
+        };
+        if (std::fclose(file) != 0) {
+            const int error = errno;
+            std::remove(temporary_path.c_str());
+            throw std::system_error(error, std::generic_category(), "can not write " + temporary_path);
+        };
+        if (!replace_file(temporary_path, path)) {
+#if defined(_WIN32)
+            const int error = static_cast<int>(GetLastError());
+            std::remove(temporary_path.c_str());
+            throw std::system_error(error, std::system_category(), "can not rename " + temporary_path);
+#else
+            const int error = errno;
+            std::remove(temporary_path.c_str());
+            throw std::system_error(error, std::generic_category(), "can not rename " + temporary_path);
+#endif
+        };
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdio>
+#include <functional>
+#include <string>
+
+// replaces a file in one step, readers of path see the old file or the new one but never a partial one.
+namespace thorp::detail {
+    // write gets a file next to path under a unique temporary name (so concurrent writers of the same path
+    // don't share it), which is renamed over path once write returned and the file was closed.
+    // throws std::system_error if the file can't be created, written or renamed, the temporary file is removed then.
+    // write can report its errors with the temporary name it is given.
+    void write_file_atomically(const std::string& path,
+        const std::function<void(std::FILE* file, const std::string& temporary_path)>& write);
+}
@@ -0,0 +1,45 @@
+#include "CpuFeatures.hpp"
+
+#if THORP_X86 && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+    thorp::detail::CpuFeatures detect_cpu_features() noexcept
+    {
+        thorp::detail::CpuFeatures features{};
+#if THORP_X86 && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        features.avx2 = __builtin_cpu_supports("avx2");
+        features.avx512f = __builtin_cpu_supports("avx512f");
+        features.aes = __builtin_cpu_supports("aes");
+#elif THORP_X86 && defined(_MSC_VER)
+        int regs[4]{};
+        __cpuid(regs, 0);
+        const int max_leaf = regs[0];
+        __cpuid(regs, 1);
+        const bool osxsave = (regs[2] & (1 << 27)) != 0;
+        features.aes = (regs[2] & (1 << 25)) != 0;
+        if (!osxsave || max_leaf < 7) {
+            return features;
+        };
+        // the os has to save the ymm (and zmm) registers on a context switch.
+        const unsigned long long xcr0 = _xgetbv(0);
+        const bool ymm_enabled = (xcr0 & 0x06) == 0x06;
+        const bool zmm_enabled = (xcr0 & 0xe6) == 0xe6;
+        __cpuidex(regs, 7, 0);
+        features.avx2 = ymm_enabled && (regs[1] & (1 << 5)) != 0;
+        features.avx512f = zmm_enabled && (regs[1] & (1 << 16)) != 0;
+#endif
+        return features;
+    }
+}
+
+namespace thorp::detail {
+    const CpuFeatures& cpu_features() noexcept
+    {
+        static const CpuFeatures features = detect_cpu_features();
+        return features;
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// runtime detection of the instruction set extensions the kernels can use.
+namespace thorp::detail {
+    struct CpuFeatures {
+        bool avx2{ false };
+        bool avx512f{ false };
+        bool aes{ false };
+    };
+
+    const CpuFeatures& cpu_features() noexcept;
+}
+
+// marks a function to be compiled for a specific instruction set extension,
+// the caller is responsible to only call it if cpu_features() reports it.
+#if defined(__GNUC__) || defined(__clang__)
+#define THORP_TARGET(isa) __attribute__((target(isa)))
+#else
+#define THORP_TARGET(isa)
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define THORP_X86 1
+#else
+#define THORP_X86 0
+#endif
@@ -0,0 +1,131 @@
+#include "ThorpRoundFunction.hpp"
+#include "CpuFeatures.hpp"
+#include <cassert>
+
+#if THORP_X86
+#include <immintrin.h>
+#endif
+
+// AES-128 round function on AES-NI.
+// the 8 byte message is zero padded to a block, the encrypted block is the output.
+// the round keys are expanded once (prepare_round_keys) to the 11 keys of the schedule.
+// every function here carries its target attribute, the dispatch in ThorpRoundFunction.cpp
+// makes sure they are only called on cpus that support them.
+
+#if THORP_X86
+namespace {
+    using thorp::byte_t;
+    constexpr std::size_t aes_lanes = thorp::detail::blake2b_lanes_max;
+
+    THORP_TARGET("aes") inline __m128i expand_step(__m128i key, __m128i assist) noexcept
+    {
+        assist = _mm_shuffle_epi32(assist, _MM_SHUFFLE(3, 3, 3, 3));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        return _mm_xor_si128(key, assist);
+    }
+
+    THORP_TARGET("aes") inline __m128i load_message(uint64_t message) noexcept
+    {
+        return _mm_set_epi64x(0, static_cast<long long>(message));
+    }
+}
+
+namespace thorp::detail {
+    THORP_TARGET("aes") void aes128_expand_key(const byte_t* key, byte_t* prepared_key) noexcept
+    {
+        __m128i schedule[11];
+        schedule[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+        // the round constant of _mm_aeskeygenassist_si128 has to be an immediate.
+        schedule[1] = expand_step(schedule[0], _mm_aeskeygenassist_si128(schedule[0], 0x01));
+        schedule[2] = expand_step(schedule[1], _mm_aeskeygenassist_si128(schedule[1], 0x02));
+        schedule[3] = expand_step(schedule[2], _mm_aeskeygenassist_si128(schedule[2], 0x04));
+        schedule[4] = expand_step(schedule[3], _mm_aeskeygenassist_si128(schedule[3], 0x08));
+        schedule[5] = expand_step(schedule[4], _mm_aeskeygenassist_si128(schedule[4], 0x10));
+        schedule[6] = expand_step(schedule[5], _mm_aeskeygenassist_si128(schedule[5], 0x20));
+        schedule[7] = expand_step(schedule[6], _mm_aeskeygenassist_si128(schedule[6], 0x40));
+        schedule[8] = expand_step(schedule[7], _mm_aeskeygenassist_si128(schedule[7], 0x80));
+        schedule[9] = expand_step(schedule[8], _mm_aeskeygenassist_si128(schedule[8], 0x1b));
+        schedule[10] = expand_step(schedule[9], _mm_aeskeygenassist_si128(schedule[9], 0x36));
+        for (int iround = 0; iround < 11; ++iround) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(prepared_key + 16 * iround), schedule[iround]);
+        };
+    }
+
+    THORP_TARGET("aes") void aes128_encrypt_block(byte_t* out, const byte_t* in, const byte_t* prepared_key) noexcept
+    {
+        const __m128i* schedule = reinterpret_cast<const __m128i*>(prepared_key);
+        __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), _mm_loadu_si128(schedule));
+        for (int iround = 1; iround < 10; ++iround) {
+            block = _mm_aesenc_si128(block, _mm_loadu_si128(schedule + iround));
+        };
+        block = _mm_aesenclast_si128(block, _mm_loadu_si128(schedule + 10));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), block);
+    }
+
+    THORP_TARGET("aes") void aes128_hash(byte_t* out, std::size_t outlen, uint64_t message, const byte_t* prepared_key) noexcept
+    {
+        assert(outlen <= 16);
+        byte_t in[16]{};
+        for (int ibyte = 0; ibyte < 8; ++ibyte) {
+            in[ibyte] = static_cast<byte_t>(message >> 8 * ibyte);
+        };
+        byte_t block[16];
+        aes128_encrypt_block(block, in, prepared_key);
+        for (std::size_t ibyte = 0; ibyte < outlen; ++ibyte) {
+            out[ibyte] = block[ibyte];
+        };
+    }
+
+    // the lanes are independent, so the aesenc of all lanes are in flight at the same time.
+    THORP_TARGET("aes") void aes128_hash_lanes(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* keys, std::size_t) noexcept
+    {
+        assert(outlen > 0 && outlen <= 16 && outlen % 8 == 0);
+        __m128i blocks[aes_lanes];
+        for (std::size_t ilane = 0; ilane < aes_lanes; ++ilane) {
+            blocks[ilane] = _mm_xor_si128(load_message(messages[ilane]),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys[ilane])));
+        };
+        for (int iround = 1; iround < 10; ++iround) {
+            for (std::size_t ilane = 0; ilane < aes_lanes; ++ilane) {
+                blocks[ilane] = _mm_aesenc_si128(blocks[ilane],
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys[ilane] + 16 * iround)));
+            };
+        };
+        for (std::size_t ilane = 0; ilane < aes_lanes; ++ilane) {
+            blocks[ilane] = _mm_aesenclast_si128(blocks[ilane],
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys[ilane] + 16 * 10)));
+            uint64_t words[2];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(words), blocks[ilane]);
+            for (std::size_t iword = 0; iword < outlen / 8; ++iword) {
+                out_words[iword * aes_lanes + ilane] = words[iword];
+            };
+        };
+    }
+}
+#else
+namespace thorp::detail {
+    // never selected on cpus without AES-NI.
+    void aes128_expand_key(const byte_t*, byte_t*) noexcept
+    {
+        assert(false);
+    }
+
+    void aes128_encrypt_block(byte_t*, const byte_t*, const byte_t*) noexcept
+    {
+        assert(false);
+    }
+
+    void aes128_hash(byte_t*, std::size_t, uint64_t, const byte_t*) noexcept
+    {
+        assert(false);
+    }
+
+    void aes128_hash_lanes(uint64_t*, std::size_t, const uint64_t*, const byte_t* const*, std::size_t) noexcept
+    {
+        assert(false);
+    }
+}
+#endif
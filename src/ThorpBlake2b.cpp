@@ -0,0 +1,261 @@
+#include "ThorpBlake2b.hpp"
+#include "CpuFeatures.hpp"
+#include <cassert>
+#include <utility>
+
+namespace thorp::detail {
+    // defined in ThorpBlake2bSimd.cpp
+    void blake2b_keyed_hash_avx2(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* keys, std::size_t keylen) noexcept;
+    void blake2b_keyed_hash_avx512(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* keys, std::size_t keylen) noexcept;
+    void blake2b_compress_avx2(uint64_t* h, const uint64_t* m, uint64_t counter, bool last_block) noexcept;
+    void blake2b_hash_from_state_avx2(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* states, std::size_t) noexcept;
+    void blake2b_hash_from_state_avx512(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* states, std::size_t) noexcept;
+}
+
+namespace {
+    using thorp::byte_t;
+    using thorp::detail::blake2b_state_words;
+
+    constexpr uint64_t rotr64(uint64_t word, unsigned shift) noexcept
+    {
+        return (word >> shift) | (word << (64 - shift));
+    }
+
+    inline void mix(uint64_t* v, std::size_t a, std::size_t b, std::size_t c, std::size_t d, uint64_t x, uint64_t y) noexcept
+    {
+        v[a] = v[a] + v[b] + x;
+        v[d] = rotr64(v[d] ^ v[a], 32);
+        v[c] = v[c] + v[d];
+        v[b] = rotr64(v[b] ^ v[c], 24);
+        v[a] = v[a] + v[b] + y;
+        v[d] = rotr64(v[d] ^ v[a], 16);
+        v[c] = v[c] + v[d];
+        v[b] = rotr64(v[b] ^ v[c], 63);
+    }
+
+    // the message schedule is a compile time constant, so the compiler can keep v and m in registers.
+    template <std::size_t iround>
+    inline void round(uint64_t* v, const uint64_t* m) noexcept
+    {
+        constexpr auto s = thorp::detail::blake2b_sigma[iround];
+        mix(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+        mix(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+        mix(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+        mix(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+        mix(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+        mix(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        mix(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+        mix(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+
+    template <std::size_t... irounds>
+    inline void rounds(uint64_t* v, const uint64_t* m, std::index_sequence<irounds...>) noexcept
+    {
+        (round<irounds>(v, m), ...);
+    }
+
+    void compress(uint64_t* h, const uint64_t* m, uint64_t counter, bool last_block) noexcept
+    {
+        using thorp::detail::blake2b_iv;
+        uint64_t v[16];
+        for (std::size_t i = 0; i < 8; ++i) {
+            v[i] = h[i];
+            v[i + 8] = blake2b_iv[i];
+        };
+        v[12] ^= counter; // the high word of the counter is always 0 for our message lengths
+        if (last_block) {
+            v[14] = ~v[14];
+        };
+        rounds(v, m, std::make_index_sequence<12>{});
+        for (std::size_t i = 0; i < 8; ++i) {
+            h[i] ^= v[i] ^ v[i + 8];
+        };
+    }
+
+    // a single message, on avx2 the rows of the working vector are processed at once.
+    void compress_single(uint64_t* h, const uint64_t* m, uint64_t counter, bool last_block) noexcept
+    {
+        static const bool use_avx2 = THORP_X86 && thorp::detail::cpu_features().avx2;
+        if (use_avx2) {
+            thorp::detail::blake2b_compress_avx2(h, m, counter, last_block);
+        }
+        else {
+            compress(h, m, counter, last_block);
+        };
+    }
+
+    // hashes the key block, returns the number of bytes hashed.
+    uint64_t key_state_words(uint64_t* h, std::size_t outlen, const byte_t* key, std::size_t keylen) noexcept
+    {
+        assert(outlen > 0 && outlen <= 64);
+        assert(keylen <= 64);
+        for (std::size_t i = 0; i < blake2b_state_words; ++i) {
+            h[i] = thorp::detail::blake2b_iv[i];
+        };
+        h[0] ^= thorp::detail::blake2b_param_word(outlen, keylen);
+        if (keylen == 0) {
+            return 0;
+        };
+        // the key is padded to a full block and hashed as the first block.
+        uint64_t block[16]{};
+        for (std::size_t iword = 0; iword * 8 < keylen; ++iword) {
+            block[iword] = thorp::detail::blake2b_load_word(key + iword * 8, keylen - iword * 8);
+        };
+        compress_single(h, block, 128, false);
+        return 128;
+    }
+
+    void message_words(uint64_t* h, uint64_t counter, uint64_t message) noexcept
+    {
+        uint64_t block[16]{};
+        block[0] = message;
+        compress_single(h, block, counter + sizeof(uint64_t), true);
+    }
+
+    void keyed_hash_words(uint64_t* h, std::size_t outlen, uint64_t message, const byte_t* key, std::size_t keylen) noexcept
+    {
+        const uint64_t counter = key_state_words(h, outlen, key, keylen);
+        message_words(h, counter, message);
+    }
+
+    void load_state(uint64_t* h, const byte_t* state) noexcept
+    {
+        for (std::size_t i = 0; i < blake2b_state_words; ++i) {
+            h[i] = thorp::detail::blake2b_load_word(state + 8 * i, 8);
+        };
+    }
+
+    // portable fallback, hashes the lanes one after the other.
+    void keyed_hash_portable(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* keys, std::size_t keylen) noexcept
+    {
+        constexpr std::size_t lanes = 4;
+        for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+            uint64_t h[blake2b_state_words];
+            keyed_hash_words(h, outlen, messages[ilane], keys[ilane], keylen);
+            for (std::size_t iword = 0; iword < outlen / 8; ++iword) {
+                out_words[iword * lanes + ilane] = h[iword];
+            };
+        };
+    }
+
+    void hash_from_state_portable(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* states, std::size_t) noexcept
+    {
+        constexpr std::size_t lanes = 4;
+        for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+            uint64_t h[blake2b_state_words];
+            load_state(h, states[ilane]);
+            message_words(h, 128, messages[ilane]);
+            for (std::size_t iword = 0; iword < outlen / 8; ++iword) {
+                out_words[iword * lanes + ilane] = h[iword];
+            };
+        };
+    }
+
+    constexpr thorp::detail::Blake2bLaneKernel portable_kernel{ "portable", 4, &keyed_hash_portable };
+    constexpr thorp::detail::Blake2bLaneKernel avx2_kernel{ "avx2", 4, &thorp::detail::blake2b_keyed_hash_avx2 };
+    constexpr thorp::detail::Blake2bLaneKernel avx512_kernel{ "avx512", 8, &thorp::detail::blake2b_keyed_hash_avx512 };
+    constexpr thorp::detail::Blake2bLaneKernel portable_state_kernel{ "portable", 4, &hash_from_state_portable };
+    constexpr thorp::detail::Blake2bLaneKernel avx2_state_kernel{ "avx2", 4, &thorp::detail::blake2b_hash_from_state_avx2 };
+    constexpr thorp::detail::Blake2bLaneKernel avx512_state_kernel{ "avx512", 8, &thorp::detail::blake2b_hash_from_state_avx512 };
+
+    // the supported ones of the three kernels, from the narrowest to the widest.
+    std::size_t supported_kernels(const thorp::detail::Blake2bLaneKernel* const (&kernels)[3],
+        const thorp::detail::Blake2bLaneKernel** kernels_out, std::size_t max_kernels) noexcept
+    {
+        const thorp::detail::CpuFeatures& features = thorp::detail::cpu_features();
+        std::size_t nkernels = 0;
+        auto push = [&](const thorp::detail::Blake2bLaneKernel* kernel) {
+            if (nkernels < max_kernels) kernels_out[nkernels] = kernel;
+            ++nkernels;
+        };
+        push(kernels[0]);
+        if (THORP_X86 && features.avx2) push(kernels[1]);
+        if (THORP_X86 && features.avx512f) push(kernels[2]);
+        return nkernels < max_kernels ? nkernels : max_kernels;
+    }
+}
+
+namespace thorp::detail {
+    void blake2b_keyed_hash(byte_t* out, std::size_t outlen, uint64_t message, const byte_t* key, std::size_t keylen) noexcept
+    {
+        uint64_t h[blake2b_state_words];
+        keyed_hash_words(h, outlen, message, key, keylen);
+        for (std::size_t ibyte = 0; ibyte < outlen; ++ibyte) {
+            out[ibyte] = static_cast<byte_t>(h[ibyte / 8] >> (8 * (ibyte % 8)));
+        };
+    }
+
+    std::size_t blake2b_lane_kernels(const Blake2bLaneKernel** kernels_out, std::size_t max_kernels) noexcept
+    {
+        static const Blake2bLaneKernel* const kernels[3]{ &portable_kernel, &avx2_kernel, &avx512_kernel };
+        return supported_kernels(kernels, kernels_out, max_kernels);
+    }
+
+    std::size_t blake2b_state_lane_kernels(const Blake2bLaneKernel** kernels_out, std::size_t max_kernels) noexcept
+    {
+        static const Blake2bLaneKernel* const kernels[3]{ &portable_state_kernel, &avx2_state_kernel, &avx512_state_kernel };
+        return supported_kernels(kernels, kernels_out, max_kernels);
+    }
+
+    void blake2b_key_state(byte_t* state, std::size_t outlen, const byte_t* key, std::size_t keylen) noexcept
+    {
+        assert(keylen > 0); // without a key there is no key block to skip.
+        uint64_t h[blake2b_state_words];
+        key_state_words(h, outlen, key, keylen);
+        for (std::size_t ibyte = 0; ibyte < blake2b_state_bytes; ++ibyte) {
+            state[ibyte] = static_cast<byte_t>(h[ibyte / 8] >> (8 * (ibyte % 8)));
+        };
+    }
+
+    void blake2b_hash_from_state(byte_t* out, std::size_t outlen, uint64_t message, const byte_t* state) noexcept
+    {
+        assert(outlen > 0 && outlen <= 64);
+        uint64_t h[blake2b_state_words];
+        load_state(h, state);
+        message_words(h, 128, message);
+        for (std::size_t ibyte = 0; ibyte < outlen; ++ibyte) {
+            out[ibyte] = static_cast<byte_t>(h[ibyte / 8] >> (8 * (ibyte % 8)));
+        };
+    }
+
+    void blake2b_hash_from_state_wide(byte_t* out, std::size_t outlen, uint64_t message_lo, uint64_t message_hi,
+        const byte_t* state) noexcept
+    {
+        assert(outlen > 0 && outlen <= 64);
+        uint64_t h[blake2b_state_words];
+        load_state(h, state);
+        uint64_t block[16]{};
+        block[0] = message_lo;
+        block[1] = message_hi;
+        compress_single(h, block, 128 + 2 * sizeof(uint64_t), true);
+        for (std::size_t ibyte = 0; ibyte < outlen; ++ibyte) {
+            out[ibyte] = static_cast<byte_t>(h[ibyte / 8] >> (8 * (ibyte % 8)));
+        };
+    }
+
+    const Blake2bLaneKernel& blake2b_lane_kernel() noexcept
+    {
+        static const Blake2bLaneKernel* const kernel = []() {
+            const Blake2bLaneKernel* kernels[3]{};
+            const std::size_t nkernels = blake2b_lane_kernels(kernels, 3);
+            return kernels[nkernels - 1];
+        }();
+        return *kernel;
+    }
+
+    const Blake2bLaneKernel& blake2b_state_lane_kernel() noexcept
+    {
+        static const Blake2bLaneKernel* const kernel = []() {
+            const Blake2bLaneKernel* kernels[3]{};
+            const std::size_t nkernels = blake2b_state_lane_kernels(kernels, 3);
+            return kernels[nkernels - 1];
+        }();
+        return *kernel;
+    }
+}
@@ -0,0 +1,338 @@
+#include "ThorpBlake2b.hpp"
+#include "CpuFeatures.hpp"
+#include <cassert>
+#include <utility>
+
+#if THORP_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+// gcc reports the _mm512_undefined_epi32() inside of _mm512_ror_epi64 as uninitialized.
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#endif
+
+// the lane kernels keep word i of all lanes in one vector register,
+// so the G function runs on 4 (AVX2) or 8 (AVX-512) independent messages at once.
+// every function here carries its target attribute, the dispatch in ThorpBlake2b.cpp
+// makes sure they are only called on cpus that support them.
+
+#if THORP_X86
+namespace {
+    using thorp::byte_t;
+
+    // ---- AVX2, 4 lanes ----
+    THORP_TARGET("avx2") inline __m256i rotr32(__m256i x) noexcept
+    {
+        return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+    }
+
+    THORP_TARGET("avx2") inline __m256i rotr24(__m256i x) noexcept
+    {
+        const __m256i mask = _mm256_setr_epi8(
+            3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+            3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+        return _mm256_shuffle_epi8(x, mask);
+    }
+
+    THORP_TARGET("avx2") inline __m256i rotr16(__m256i x) noexcept
+    {
+        const __m256i mask = _mm256_setr_epi8(
+            2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+            2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+        return _mm256_shuffle_epi8(x, mask);
+    }
+
+    THORP_TARGET("avx2") inline __m256i rotr63(__m256i x) noexcept
+    {
+        return _mm256_or_si256(_mm256_srli_epi64(x, 63), _mm256_add_epi64(x, x));
+    }
+
+    THORP_TARGET("avx2") inline void mix_avx2(__m256i* v, int a, int b, int c, int d, __m256i x, __m256i y) noexcept
+    {
+        v[a] = _mm256_add_epi64(_mm256_add_epi64(v[a], v[b]), x);
+        v[d] = rotr32(_mm256_xor_si256(v[d], v[a]));
+        v[c] = _mm256_add_epi64(v[c], v[d]);
+        v[b] = rotr24(_mm256_xor_si256(v[b], v[c]));
+        v[a] = _mm256_add_epi64(_mm256_add_epi64(v[a], v[b]), y);
+        v[d] = rotr16(_mm256_xor_si256(v[d], v[a]));
+        v[c] = _mm256_add_epi64(v[c], v[d]);
+        v[b] = rotr63(_mm256_xor_si256(v[b], v[c]));
+    }
+
+    THORP_TARGET("avx2") void compress_avx2(__m256i* h, const __m256i* m, uint64_t counter, bool last_block) noexcept
+    {
+        using thorp::detail::blake2b_iv;
+        using thorp::detail::blake2b_sigma;
+        __m256i v[16];
+        for (int i = 0; i < 8; ++i) {
+            v[i] = h[i];
+            v[i + 8] = _mm256_set1_epi64x(static_cast<long long>(blake2b_iv[i]));
+        };
+        v[12] = _mm256_xor_si256(v[12], _mm256_set1_epi64x(static_cast<long long>(counter)));
+        if (last_block) {
+            v[14] = _mm256_xor_si256(v[14], _mm256_set1_epi64x(-1));
+        };
+        for (int iround = 0; iround < 12; ++iround) {
+            const auto& s = blake2b_sigma[iround];
+            mix_avx2(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+            mix_avx2(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+            mix_avx2(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+            mix_avx2(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+            mix_avx2(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+            mix_avx2(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            mix_avx2(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+            mix_avx2(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+        };
+        for (int i = 0; i < 8; ++i) {
+            h[i] = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i + 8]));
+        };
+    }
+
+    // ---- AVX2, a single message ----
+    // the rows of the working vector are held in one register each, the diagonal step rotates
+    // the rows into columns and back (as in the reference sse/avx implementations).
+    THORP_TARGET("avx2") inline void mix_rows_avx2(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i x, __m256i y) noexcept
+    {
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b), x);
+        d = rotr32(_mm256_xor_si256(d, a));
+        c = _mm256_add_epi64(c, d);
+        b = rotr24(_mm256_xor_si256(b, c));
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b), y);
+        d = rotr16(_mm256_xor_si256(d, a));
+        c = _mm256_add_epi64(c, d);
+        b = rotr63(_mm256_xor_si256(b, c));
+    }
+
+    THORP_TARGET("avx2") inline __m256i message_row(const uint64_t* m, int i0, int i1, int i2, int i3) noexcept
+    {
+        return _mm256_setr_epi64x(static_cast<long long>(m[i0]), static_cast<long long>(m[i1]),
+            static_cast<long long>(m[i2]), static_cast<long long>(m[i3]));
+    }
+
+    template <std::size_t iround>
+    THORP_TARGET("avx2") inline void round_rows_avx2(__m256i& a, __m256i& b, __m256i& c, __m256i& d, const uint64_t* m) noexcept
+    {
+        constexpr auto s = thorp::detail::blake2b_sigma[iround];
+        mix_rows_avx2(a, b, c, d, message_row(m, s[0], s[2], s[4], s[6]), message_row(m, s[1], s[3], s[5], s[7]));
+        b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(0, 3, 2, 1));
+        c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+        d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(2, 1, 0, 3));
+        mix_rows_avx2(a, b, c, d, message_row(m, s[8], s[10], s[12], s[14]), message_row(m, s[9], s[11], s[13], s[15]));
+        b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 1, 0, 3));
+        c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+        d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(0, 3, 2, 1));
+    }
+
+    template <std::size_t... irounds>
+    THORP_TARGET("avx2") inline void rounds_rows_avx2(__m256i& a, __m256i& b, __m256i& c, __m256i& d, const uint64_t* m,
+        std::index_sequence<irounds...>) noexcept
+    {
+        (round_rows_avx2<irounds>(a, b, c, d, m), ...);
+    }
+
+    // ---- AVX-512, 8 lanes ----
+    THORP_TARGET("avx512f") inline void mix_avx512(__m512i* v, int a, int b, int c, int d, __m512i x, __m512i y) noexcept
+    {
+        v[a] = _mm512_add_epi64(_mm512_add_epi64(v[a], v[b]), x);
+        v[d] = _mm512_ror_epi64(_mm512_xor_si512(v[d], v[a]), 32);
+        v[c] = _mm512_add_epi64(v[c], v[d]);
+        v[b] = _mm512_ror_epi64(_mm512_xor_si512(v[b], v[c]), 24);
+        v[a] = _mm512_add_epi64(_mm512_add_epi64(v[a], v[b]), y);
+        v[d] = _mm512_ror_epi64(_mm512_xor_si512(v[d], v[a]), 16);
+        v[c] = _mm512_add_epi64(v[c], v[d]);
+        v[b] = _mm512_ror_epi64(_mm512_xor_si512(v[b], v[c]), 63);
+    }
+
+    THORP_TARGET("avx512f") void compress_avx512(__m512i* h, const __m512i* m, uint64_t counter, bool last_block) noexcept
+    {
+        using thorp::detail::blake2b_iv;
+        using thorp::detail::blake2b_sigma;
+        __m512i v[16];
+        for (int i = 0; i < 8; ++i) {
+            v[i] = h[i];
+            v[i + 8] = _mm512_set1_epi64(static_cast<long long>(blake2b_iv[i]));
+        };
+        v[12] = _mm512_xor_si512(v[12], _mm512_set1_epi64(static_cast<long long>(counter)));
+        if (last_block) {
+            v[14] = _mm512_xor_si512(v[14], _mm512_set1_epi64(-1));
+        };
+        for (int iround = 0; iround < 12; ++iround) {
+            const auto& s = blake2b_sigma[iround];
+            mix_avx512(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+            mix_avx512(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+            mix_avx512(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+            mix_avx512(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+            mix_avx512(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+            mix_avx512(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            mix_avx512(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+            mix_avx512(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+        };
+        for (int i = 0; i < 8; ++i) {
+            h[i] = _mm512_xor_si512(h[i], _mm512_xor_si512(v[i], v[i + 8]));
+        };
+    }
+
+    // word iword of the (zero padded) key of every lane.
+    template<std::size_t lanes>
+    void gather_key_words(uint64_t(&words)[lanes], const byte_t* const* keys, std::size_t keylen, std::size_t iword) noexcept
+    {
+        for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+            words[ilane] = iword * 8 < keylen
+                ? thorp::detail::blake2b_load_word(keys[ilane] + iword * 8, keylen - iword * 8)
+                : 0;
+        };
+    }
+}
+
+namespace thorp::detail {
+    THORP_TARGET("avx2") void blake2b_keyed_hash_avx2(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* keys, std::size_t keylen) noexcept
+    {
+        assert(outlen > 0 && outlen <= 64 && outlen % 8 == 0);
+        assert(keylen <= 64);
+        __m256i h[8];
+        for (int i = 0; i < 8; ++i) {
+            h[i] = _mm256_set1_epi64x(static_cast<long long>(blake2b_iv[i]));
+        };
+        h[0] = _mm256_xor_si256(h[0], _mm256_set1_epi64x(static_cast<long long>(blake2b_param_word(outlen, keylen))));
+        __m256i m[16];
+        uint64_t counter = 0;
+        if (keylen > 0) {
+            for (std::size_t iword = 0; iword < 16; ++iword) {
+                uint64_t words[4];
+                gather_key_words(words, keys, keylen, iword);
+                m[iword] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+            };
+            counter += 128;
+            compress_avx2(h, m, counter, false);
+        };
+        m[0] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(messages));
+        for (int i = 1; i < 16; ++i) {
+            m[i] = _mm256_setzero_si256();
+        };
+        counter += sizeof(uint64_t);
+        compress_avx2(h, m, counter, true);
+        for (std::size_t iword = 0; iword < outlen / 8; ++iword) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out_words + 4 * iword), h[iword]);
+        };
+    }
+
+    THORP_TARGET("avx512f") void blake2b_keyed_hash_avx512(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* keys, std::size_t keylen) noexcept
+    {
+        assert(outlen > 0 && outlen <= 64 && outlen % 8 == 0);
+        assert(keylen <= 64);
+        __m512i h[8];
+        for (int i = 0; i < 8; ++i) {
+            h[i] = _mm512_set1_epi64(static_cast<long long>(blake2b_iv[i]));
+        };
+        h[0] = _mm512_xor_si512(h[0], _mm512_set1_epi64(static_cast<long long>(blake2b_param_word(outlen, keylen))));
+        __m512i m[16];
+        uint64_t counter = 0;
+        if (keylen > 0) {
+            for (std::size_t iword = 0; iword < 16; ++iword) {
+                uint64_t words[8];
+                gather_key_words(words, keys, keylen, iword);
+                m[iword] = _mm512_loadu_si512(words);
+            };
+            counter += 128;
+            compress_avx512(h, m, counter, false);
+        };
+        m[0] = _mm512_loadu_si512(messages);
+        for (int i = 1; i < 16; ++i) {
+            m[i] = _mm512_setzero_si512();
+        };
+        counter += sizeof(uint64_t);
+        compress_avx512(h, m, counter, true);
+        for (std::size_t iword = 0; iword < outlen / 8; ++iword) {
+            _mm512_storeu_si512(out_words + 8 * iword, h[iword]);
+        };
+    }
+
+    THORP_TARGET("avx2") void blake2b_compress_avx2(uint64_t* h, const uint64_t* m, uint64_t counter, bool last_block) noexcept
+    {
+        const __m256i h_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h));
+        const __m256i h_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + 4));
+        __m256i a = h_lo;
+        __m256i b = h_hi;
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blake2b_iv.data()));
+        __m256i d = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(blake2b_iv.data() + 4)),
+            _mm256_setr_epi64x(static_cast<long long>(counter), 0, last_block ? -1 : 0, 0));
+        rounds_rows_avx2(a, b, c, d, m, std::make_index_sequence<12>{});
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(h), _mm256_xor_si256(h_lo, _mm256_xor_si256(a, c)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(h + 4), _mm256_xor_si256(h_hi, _mm256_xor_si256(b, d)));
+    }
+
+    // the states are the chaining values after the key block, only the message block is left.
+    THORP_TARGET("avx2") void blake2b_hash_from_state_avx2(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* states, std::size_t) noexcept
+    {
+        assert(outlen > 0 && outlen <= 64 && outlen % 8 == 0);
+        __m256i h[8];
+        for (std::size_t iword = 0; iword < 8; ++iword) {
+            uint64_t words[4];
+            gather_key_words(words, states, blake2b_state_bytes, iword);
+            h[iword] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+        };
+        __m256i m[16];
+        m[0] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(messages));
+        for (int i = 1; i < 16; ++i) {
+            m[i] = _mm256_setzero_si256();
+        };
+        compress_avx2(h, m, 128 + sizeof(uint64_t), true);
+        for (std::size_t iword = 0; iword < outlen / 8; ++iword) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out_words + 4 * iword), h[iword]);
+        };
+    }
+
+    THORP_TARGET("avx512f") void blake2b_hash_from_state_avx512(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* states, std::size_t) noexcept
+    {
+        assert(outlen > 0 && outlen <= 64 && outlen % 8 == 0);
+        __m512i h[8];
+        for (std::size_t iword = 0; iword < 8; ++iword) {
+            uint64_t words[8];
+            gather_key_words(words, states, blake2b_state_bytes, iword);
+            h[iword] = _mm512_loadu_si512(words);
+        };
+        __m512i m[16];
+        m[0] = _mm512_loadu_si512(messages);
+        for (int i = 1; i < 16; ++i) {
+            m[i] = _mm512_setzero_si512();
+        };
+        compress_avx512(h, m, 128 + sizeof(uint64_t), true);
+        for (std::size_t iword = 0; iword < outlen / 8; ++iword) {
+            _mm512_storeu_si512(out_words + 8 * iword, h[iword]);
+        };
+    }
+}
+#else
+namespace thorp::detail {
+    // never selected on cpus without these extensions.
+    void blake2b_keyed_hash_avx2(uint64_t*, std::size_t, const uint64_t*, const byte_t* const*, std::size_t) noexcept
+    {
+        assert(false);
+    }
+
+    void blake2b_keyed_hash_avx512(uint64_t*, std::size_t, const uint64_t*, const byte_t* const*, std::size_t) noexcept
+    {
+        assert(false);
+    }
+
+    void blake2b_compress_avx2(uint64_t*, const uint64_t*, uint64_t, bool) noexcept
+    {
+        assert(false);
+    }
+
+    void blake2b_hash_from_state_avx2(uint64_t*, std::size_t, const uint64_t*, const byte_t* const*, std::size_t) noexcept
+    {
+        assert(false);
+    }
+
+    void blake2b_hash_from_state_avx512(uint64_t*, std::size_t, const uint64_t*, const byte_t* const*, std::size_t) noexcept
+    {
+        assert(false);
+    }
+}
+#endif
@@ -0,0 +1,123 @@
+#include "ThorpCycleWalking.hpp"
+#include <cassert>
+#include <utility>
+
+namespace thorp {
+    CycleWalkingObfuscator::CycleWalkingObfuscator(OptThorpObfuscator cover, uint64_t max_message)
+        :cover_{ std::move(cover) }
+        , max_message_{ max_message }{
+        assert(this->max_message_ <= this->cover_.max_message());
+    }
+
+    CycleWalkingObfuscator CycleWalkingObfuscator::from_uint64(uint64_t key_number, uint64_t max_message, RoundFunction round_function)
+    {
+        // a higher level needs fewer hashes per pass but a coarser cover domain and so more walks: take the level
+        // with the fewest expected hashes per message, (cover+1)/(max_message+1) encryptions of ceil(nrounds/level) hashes.
+        constexpr uint64_t npasses = 8;
+        uint64_t optimization_level = 1;
+        long double hashes_min = 0;
+        for (uint64_t level = 1; level <= OptThorpObfuscator::optimization_level_max_for(round_function); ++level) {
+            const uint64_t cover = cover_max_message(max_message, level);
+            const uint64_t nrounds = nrounds_per_pass(cover) * npasses;
+            const long double hashes = (static_cast<long double>(cover) + 1) / (static_cast<long double>(max_message) + 1)
+                * static_cast<long double>((nrounds + level - 1) / level);
+            if (level == 1 || hashes <= hashes_min) {
+                optimization_level = level;
+                hashes_min = hashes;
+            };
+        };
+        return from_uint64(key_number, max_message, npasses, optimization_level, round_function);
+    }
+
+    CycleWalkingObfuscator CycleWalkingObfuscator::from_uint64(uint64_t key_number, uint64_t max_message, uint64_t npasses,
+        uint64_t optimization_level, RoundFunction round_function)
+    {
+        return CycleWalkingObfuscator{ OptThorpObfuscator::from_uint64(key_number, cover_max_message(max_message, optimization_level),
+            npasses, optimization_level, round_function), max_message };
+    }
+
+    uint64_t CycleWalkingObfuscator::cover_max_message(uint64_t max_message, uint64_t optimization_level) noexcept
+    {
+        assert(optimization_level > 0 && optimization_level < 64);
+        // max_message + 1 rounded up to a multiple of 2^optimization_level, minus one.
+        return max_message | ((1ull << optimization_level) - 1);
+    }
+
+    uint64_t CycleWalkingObfuscator::max_message() const noexcept
+    {
+        return this->max_message_;
+    }
+
+    const OptThorpObfuscator& CycleWalkingObfuscator::cover() const noexcept
+    {
+        return this->cover_;
+    }
+
+    uint64_t CycleWalkingObfuscator::encrypt(uint64_t plaintext) const noexcept
+    {
+        assert(plaintext <= this->max_message_);
+        CipherContext context;
+        uint64_t cyphertext = this->cover_.encrypt(plaintext, context);
+        while (cyphertext > this->max_message_) {
+            cyphertext = this->cover_.encrypt(cyphertext, context);
+        };
+        return cyphertext;
+    }
+
+    uint64_t CycleWalkingObfuscator::decrypt(uint64_t cyphertext) const noexcept
+    {
+        assert(cyphertext <= this->max_message_);
+        CipherContext context;
+        uint64_t plaintext = this->cover_.decrypt(cyphertext, context);
+        while (plaintext > this->max_message_) {
+            plaintext = this->cover_.decrypt(plaintext, context);
+        };
+        return plaintext;
+    }
+
+    void CycleWalkingObfuscator::encrypt_batch(const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const
+    {
+        this->cover_.encrypt_batch(plaintexts, cyphertexts, count);
+        this->walk(cyphertexts, count, false);
+    }
+
+    void CycleWalkingObfuscator::decrypt_batch(const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const
+    {
+        this->cover_.decrypt_batch(cyphertexts, plaintexts, count);
+        this->walk(plaintexts, count, true);
+    }
+
+    void CycleWalkingObfuscator::walk(uint64_t* values, std::size_t count, bool decrypt) const
+    {
+        std::vector<std::size_t> pending;
+        std::vector<uint64_t> walking;
+        for (std::size_t ivalue = 0; ivalue < count; ++ivalue) {
+            if (values[ivalue] > this->max_message_) {
+                pending.push_back(ivalue);
+                walking.push_back(values[ivalue]);
+            };
+        };
+        // each pass is one batch of the messages still outside, the ones that landed inside drop out.
+        while (!pending.empty()) {
+            if (decrypt) {
+                this->cover_.decrypt_batch(walking.data(), walking.data(), walking.size());
+            }
+            else {
+                this->cover_.encrypt_batch(walking.data(), walking.data(), walking.size());
+            };
+            std::size_t nkept = 0;
+            for (std::size_t iwalking = 0; iwalking < walking.size(); ++iwalking) {
+                if (walking[iwalking] <= this->max_message_) {
+                    values[pending[iwalking]] = walking[iwalking];
+                }
+                else {
+                    pending[nkept] = pending[iwalking];
+                    walking[nkept] = walking[iwalking];
+                    ++nkept;
+                };
+            };
+            pending.resize(nkept);
+            walking.resize(nkept);
+        };
+    }
+}
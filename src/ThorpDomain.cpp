@@ -0,0 +1,228 @@
+#include "ThorpShuffler.hpp"
+#include "ThorpBlake2b.hpp"
+#include <algorithm>
+#include <thread>
+
+// materializes the whole permutation at once.
+// instead of following single messages through the rounds we keep an array indexed by the
+// current value of the messages and move every entry to its position after the round.
+// in a round the messages r and r+half_max (encrypt) or 2r and 2r+1 (decrypt) share
+// the remainder r and therefore the hash, so each hash is computed once per pair.
+// starting with the identity:
+//  * the encrypt rounds leave at position c the plaintext that encrypts to c, i.e. decrypt(c).
+//  * the decrypt rounds (in reverse order) leave at position p the cyphertext that decrypts to p, i.e. encrypt(p).
+
+namespace {
+    using thorp::byte_t;
+    // remainders are handed to the bit functions in blocks of this size.
+    constexpr std::size_t block_size = thorp::detail::blake2b_lanes_max;
+    // below this number of remainders per thread starting a thread costs more than it saves.
+    constexpr uint64_t min_items_per_thread = 1ull << 14;
+
+    unsigned thread_count(unsigned nthreads, uint64_t nitems)
+    {
+        if (nthreads == 0) {
+            nthreads = std::max(1u, std::thread::hardware_concurrency());
+        };
+        const uint64_t max_threads = std::max<uint64_t>(1, nitems / min_items_per_thread);
+        return static_cast<unsigned>(std::min<uint64_t>(nthreads, max_threads));
+    }
+
+    // calls fn(begin, end) on nthreads disjoint ranges covering [0, count), each aligned to block_size.
+    template <class Fn>
+    void parallel_for(uint64_t count, unsigned nthreads, const Fn& fn)
+    {
+        if (nthreads <= 1) {
+            fn(uint64_t{ 0 }, count);
+            return;
+        };
+        const uint64_t nblocks = (count + block_size - 1) / block_size;
+        const uint64_t blocks_per_thread = (nblocks + nthreads - 1) / nthreads;
+        std::vector<std::thread> threads;
+        threads.reserve(nthreads - 1);
+        for (unsigned ithread = 1; ithread < nthreads; ++ithread) {
+            const uint64_t begin = std::min(count, ithread * blocks_per_thread * block_size);
+            const uint64_t end = std::min(count, (ithread + 1) * blocks_per_thread * block_size);
+            if (begin < end) {
+                threads.emplace_back([&fn, begin, end]() { fn(begin, end); });
+            };
+        };
+        fn(uint64_t{ 0 }, std::min(count, blocks_per_thread * block_size));
+        for (auto& thread : threads) {
+            thread.join();
+        };
+    }
+
+    // one round over the value indexed array in, written to out.
+    // bits_fn(first, n, bits) writes the round bits of the remainders first..first+n-1 to bits.
+    template <bool encrypt_round, class BitsFn>
+    void apply_round(const uint64_t* in, uint64_t* out, uint64_t half_max, unsigned nthreads, const BitsFn& bits_fn)
+    {
+        parallel_for(half_max, nthreads, [&](uint64_t begin, uint64_t end) {
+            std::array<byte_t, block_size> bits{};
+            for (uint64_t first = begin; first < end; first += block_size) {
+                const std::size_t n = static_cast<std::size_t>(std::min<uint64_t>(block_size, end - first));
+                bits_fn(first, n, bits.data());
+                for (std::size_t i = 0; i < n; ++i) {
+                    const uint64_t remainder = first + i;
+                    const uint64_t bit = bits[i];
+                    if (encrypt_round) {
+                        // x = remainder + leading_bit * half_max  --> remainder * 2 + (leading_bit ^ bit)
+                        out[remainder * 2 + bit] = in[remainder];
+                        out[remainder * 2 + (bit ^ 1)] = in[remainder + half_max];
+                    }
+                    else {
+                        // x = remainder * 2 + trailing_bit  --> remainder + (trailing_bit ^ bit) * half_max
+                        out[remainder + bit * half_max] = in[remainder * 2];
+                        out[remainder + (bit ^ 1) * half_max] = in[remainder * 2 + 1];
+                    };
+                };
+            };
+            });
+    }
+
+    // round_bits(iround) returns the bits_fn for round iround.
+    template <class RoundBitsFn>
+    void permute_rounds(uint64_t* out, uint64_t max_message, uint64_t nrounds, bool inverse, unsigned nthreads, RoundBitsFn&& round_bits)
+    {
+        assert(max_message < std::numeric_limits<uint64_t>::max()); // the domain has to fit into memory anyway.
+        const uint64_t domain_size = max_message + 1;
+        const uint64_t half_max = max_message / 2 + 1;
+        std::vector<uint64_t> scratch(domain_size);
+        std::iota(out, out + domain_size, uint64_t{ 0 });
+        uint64_t* current = out;
+        uint64_t* next = scratch.data();
+        for (uint64_t istep = 0; istep < nrounds; ++istep) {
+            if (inverse) {
+                apply_round<true>(current, next, half_max, nthreads, round_bits(istep));
+            }
+            else {
+                apply_round<false>(current, next, half_max, nthreads, round_bits(nrounds - 1 - istep));
+            };
+            std::swap(current, next);
+        };
+        if (current != out) {
+            std::copy(current, current + domain_size, out);
+        };
+    }
+
+    // hash_size is the part of the hash the ThorpObfuscator reduces to its bit.
+    void thorp_permute(thorp::RoundFunction round_function, const byte_t* round_keys, std::size_t round_key_stride,
+        std::size_t hash_size, uint64_t max_message, uint64_t npasses, uint64_t* out, bool inverse, unsigned nthreads)
+    {
+        const thorp::detail::Blake2bLaneKernel& kernel = thorp::detail::round_lane_kernel(round_function);
+        const uint64_t half_max = max_message / 2 + 1;
+        const uint64_t nrounds = thorp::nrounds_per_pass(max_message) * npasses;
+        nthreads = thread_count(nthreads, half_max);
+        permute_rounds(out, max_message, nrounds, inverse, nthreads, [&](uint64_t iround) {
+            const byte_t* const key = round_keys + iround * round_key_stride;
+            return [&kernel, key, hash_size](uint64_t first, std::size_t n, byte_t* bits) {
+                const std::size_t lanes = kernel.lanes;
+                std::array<uint64_t, thorp::detail::blake2b_lanes_max> remainders{};
+                std::array<uint64_t, 2 * thorp::detail::blake2b_lanes_max> hash_words{};
+                std::array<const byte_t*, thorp::detail::blake2b_lanes_max> keys{};
+                keys.fill(key);
+                for (std::size_t ifirst = 0; ifirst < n; ifirst += lanes) {
+                    for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                        remainders[ilane] = first + ifirst + ilane;
+                    };
+                    kernel.keyed_hash(hash_words.data(), hash_size,
+                        remainders.data(), keys.data(), thorp::detail::round_key_size);
+                    for (std::size_t ilane = 0; ilane < lanes && ifirst + ilane < n; ++ilane) {
+                        bits[ifirst + ilane] = static_cast<byte_t>(thorp::detail::parity(
+                            hash_words[ilane] ^ (hash_size > 8 ? hash_words[lanes + ilane] : 0)));
+                    };
+                };
+            };
+            });
+    }
+
+    // the OptThorpObfuscator hashes a = (remainder >> j) % projector once per opt round,
+    // all 2^optimization_level messages with the same a take their bits from that hash.
+    // we hash every a once per opt round into a table and keep only the bits that are used.
+    void opt_thorp_permute(const thorp::detail::RoundKeySource& round_keys,
+        uint64_t max_message, uint64_t npasses, uint64_t optimization_level, uint64_t* out, bool inverse, unsigned nthreads)
+    {
+        constexpr std::size_t hash_words_max = crypto_generichash_BYTES_MAX / sizeof(uint64_t);
+        const std::size_t hash_size = round_keys.outlen;
+        const thorp::detail::Blake2bLaneKernel& kernel = thorp::detail::round_lane_kernel(round_keys.round_function);
+        const uint64_t half_max = max_message / 2 + 1;
+        const uint64_t nrounds = thorp::nrounds_per_pass(max_message) * npasses;
+        const uint64_t selectors = 1ull << (optimization_level - 1);
+        const uint64_t projector = half_max >> (optimization_level - 1); // equiv N/32
+        const std::size_t words_per_hash = static_cast<std::size_t>((optimization_level * selectors + 63) / 64);
+        assert(words_per_hash * sizeof(uint64_t) <= hash_size);
+        std::vector<uint64_t> table(projector * words_per_hash);
+        uint64_t table_opt_round = nrounds; // none
+        nthreads = thread_count(nthreads, half_max);
+
+        std::array<byte_t, thorp::detail::prepared_round_key_size_max> round_key_scratch{};
+        auto fill_table = [&](uint64_t iopt_round) {
+            const byte_t* const key = round_keys.round_key(iopt_round, round_key_scratch.data());
+            parallel_for(projector, thread_count(nthreads, projector), [&](uint64_t begin, uint64_t end) {
+                const std::size_t lanes = kernel.lanes;
+                std::array<uint64_t, thorp::detail::blake2b_lanes_max> remainders{};
+                std::array<uint64_t, hash_words_max * thorp::detail::blake2b_lanes_max> hash_words{};
+                std::array<const byte_t*, thorp::detail::blake2b_lanes_max> keys{};
+                keys.fill(key);
+                for (uint64_t first = begin; first < end; first += lanes) {
+                    for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                        remainders[ilane] = first + ilane;
+                    };
+                    kernel.keyed_hash(hash_words.data(), hash_size, remainders.data(), keys.data(), thorp::detail::round_key_size);
+                    for (std::size_t ilane = 0; ilane < lanes && first + ilane < end; ++ilane) {
+                        for (std::size_t iword = 0; iword < words_per_hash; ++iword) {
+                            table[(first + ilane) * words_per_hash + iword] = hash_words[iword * lanes + ilane];
+                        };
+                    };
+                };
+                });
+        };
+
+        permute_rounds(out, max_message, nrounds, inverse, nthreads, [&](uint64_t iround) {
+            const uint64_t iopt_pass = iround % optimization_level; // equivalent to j in  Fig.6
+            const uint64_t iopt_round = iround / optimization_level; // equivalent to i in  Fig.6
+            if (table_opt_round != iopt_round) {
+                fill_table(iopt_round);
+                table_opt_round = iopt_round;
+            };
+            const uint64_t* const table_data = table.data();
+            return [=](uint64_t first, std::size_t n, byte_t* bits) {
+                for (std::size_t i = 0; i < n; ++i) {
+                    const uint64_t remainder = first + i;
+                    const uint64_t a = (remainder >> iopt_pass) % projector;
+                    const uint64_t hi = (remainder >> iopt_pass) / projector;
+                    const uint64_t lo = remainder % (1ull << iopt_pass);
+                    const uint64_t selector = (hi << iopt_pass) + lo;
+                    assert(selector < selectors);
+                    const uint64_t ibit = iopt_pass * selectors + selector;
+                    bits[i] = static_cast<byte_t>((table_data[a * words_per_hash + ibit / 64] >> (ibit % 64)) & 1);
+                };
+            };
+            });
+    }
+}
+
+namespace thorp {
+    void ThorpObfuscator::permute_domain(uint64_t* out, unsigned nthreads) const
+    {
+        thorp_permute(this->round_function_, this->round_keys(), this->round_key_stride(), hash_size(this->round_function_),
+            this->max_message_, this->npasses_, out, false, nthreads);
+    }
+
+    void ThorpObfuscator::inverse_permute_domain(uint64_t* out, unsigned nthreads) const
+    {
+        thorp_permute(this->round_function_, this->round_keys(), this->round_key_stride(), hash_size(this->round_function_),
+            this->max_message_, this->npasses_, out, true, nthreads);
+    }
+
+    void OptThorpObfuscator::permute_domain(uint64_t* out, unsigned nthreads) const
+    {
+        opt_thorp_permute(this->round_key_source(), this->max_message_, this->npasses_, this->optimization_level_, out, false, nthreads);
+    }
+
+    void OptThorpObfuscator::inverse_permute_domain(uint64_t* out, unsigned nthreads) const
+    {
+        opt_thorp_permute(this->round_key_source(), this->max_message_, this->npasses_, this->optimization_level_, out, true, nthreads);
+    }
+}
@@ -0,0 +1,142 @@
+#include "ThorpIdGenerator.hpp"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace thorp::detail {
+    // the pre encrypted ids of one block of one generator in one thread.
+    struct IdRing {
+        uint64_t instance = 0;
+        std::vector<uint64_t> ids;
+        std::size_t next = 0;
+    };
+}
+
+namespace {
+    using thorp::detail::IdRing;
+    std::atomic<uint64_t> next_instance{ 1 };
+    // rings a thread keeps, the rings of destroyed generators are only dropped when this is exceeded.
+    constexpr std::size_t rings_per_thread_max = 8;
+
+    // a thread usually draws from a single generator, the ring of the last one is checked first.
+    struct ThreadRings {
+        std::vector<std::unique_ptr<IdRing>> rings;
+        IdRing* last = nullptr;
+    };
+    thread_local ThreadRings thread_rings;
+
+    uint64_t saturating_add(uint64_t left, uint64_t right) noexcept
+    {
+        return left > std::numeric_limits<uint64_t>::max() - right ? std::numeric_limits<uint64_t>::max() : left + right;
+    }
+}
+
+namespace thorp {
+    IdsExhausted::IdsExhausted()
+        :std::out_of_range{ "all ids of the domain have been issued" }{
+    }
+
+    ObfuscatedIdGenerator::ObfuscatedIdGenerator(OptThorpObfuscator obfuscator, uint64_t first_counter,
+        std::size_t block_size, IdPersistence persistence)
+        :obfuscator_{ std::move(obfuscator) }
+        , block_size_{ std::max<std::size_t>(block_size, 1) }
+        , persistence_{ std::move(persistence) }
+        , instance_{ next_instance.fetch_add(1, std::memory_order_relaxed) }
+        , next_counter_{ first_counter }
+        , high_water_mark_{ this->persistence_.persist ? first_counter : std::numeric_limits<uint64_t>::max() }{
+        assert(this->persistence_.lease > 0);
+    }
+
+    uint64_t ObfuscatedIdGenerator::next_id()
+    {
+        IdRing* ring = thread_rings.last;
+        if (ring != nullptr && ring->instance == this->instance_ && ring->next < ring->ids.size()) {
+            return ring->ids[ring->next++];
+        };
+        if (ring == nullptr || ring->instance != this->instance_) {
+            const auto found = std::find_if(thread_rings.rings.begin(), thread_rings.rings.end(),
+                [this](const auto& candidate) { return candidate->instance == this->instance_; });
+            if (found != thread_rings.rings.end()) {
+                ring = found->get();
+            }
+            else {
+                if (thread_rings.rings.size() >= rings_per_thread_max) {
+                    thread_rings.rings.erase(thread_rings.rings.begin());
+                };
+                thread_rings.rings.push_back(std::make_unique<IdRing>());
+                ring = thread_rings.rings.back().get();
+                ring->instance = this->instance_;
+            };
+            thread_rings.last = ring;
+            if (ring->next < ring->ids.size()) {
+                return ring->ids[ring->next++];
+            };
+        };
+        return this->refill(*ring);
+    }
+
+    uint64_t ObfuscatedIdGenerator::refill(detail::IdRing& ring)
+    {
+        const uint64_t max_message = this->obfuscator_.max_message();
+        uint64_t first = this->next_counter_.load(std::memory_order_relaxed);
+        std::size_t count = 0;
+        for (;;) {
+            if (first > max_message || this->exhausted_.load(std::memory_order_relaxed)) {
+                throw IdsExhausted{};
+            };
+            if (max_message - first >= this->block_size_) {
+                // a full block, the counter never moves past max_message + 1.
+                if (this->next_counter_.compare_exchange_weak(first, first + this->block_size_, std::memory_order_relaxed)) {
+                    count = this->block_size_;
+                    break;
+                };
+                continue;
+            };
+            // the last (possibly partial) block ends at max_message, where max_message + 1 may not fit the counter.
+            // once the counter got here it does not move anymore, the one thread that latches the flag takes the block.
+            if (this->exhausted_.exchange(true, std::memory_order_relaxed)) {
+                throw IdsExhausted{};
+            };
+            count = static_cast<std::size_t>(max_message - first + 1);
+            break;
+        };
+        const uint64_t end = saturating_add(first, count);
+        if (end > this->high_water_mark_.load(std::memory_order_acquire)) {
+            this->persist_up_to(end);
+        };
+        ring.ids.resize(count);
+        this->obfuscator_.encrypt_range(first, count, ring.ids.data());
+        ring.next = 1;
+        return ring.ids[0];
+    }
+
+    void ObfuscatedIdGenerator::persist_up_to(uint64_t end)
+    {
+        std::lock_guard<std::mutex> lock{ this->persist_mutex_ };
+        const uint64_t mark = this->high_water_mark_.load(std::memory_order_relaxed);
+        if (end <= mark) {
+            return; // another thread moved the mark while we waited.
+        };
+        const uint64_t new_mark = saturating_add(end, this->persistence_.lease);
+        this->persistence_.persist(new_mark);
+        this->high_water_mark_.store(new_mark, std::memory_order_release);
+    }
+
+    uint64_t ObfuscatedIdGenerator::reserved_counters() const noexcept
+    {
+        const uint64_t next = this->next_counter_.load(std::memory_order_relaxed);
+        const bool exhausted = this->exhausted_.load(std::memory_order_relaxed) || next > this->obfuscator_.max_message();
+        return exhausted ? saturating_add(this->obfuscator_.max_message(), 1) : next;
+    }
+
+    uint64_t ObfuscatedIdGenerator::high_water_mark() const noexcept
+    {
+        const uint64_t mark = this->high_water_mark_.load(std::memory_order_acquire);
+        return this->persistence_.persist ? mark : this->reserved_counters();
+    }
+
+    const OptThorpObfuscator& ObfuscatedIdGenerator::obfuscator() const noexcept
+    {
+        return this->obfuscator_;
+    }
+}
@@ -0,0 +1,230 @@
+#include "ThorpIdStream.hpp"
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+    // the longest text id is 20 decimal digits, the longest pair two of them, a blank and the newline.
+    constexpr std::size_t id_size_max = 21;
+    constexpr std::size_t pair_size_max = 42;
+
+    void write_binary(char* out, uint64_t id) noexcept
+    {
+        for (std::size_t ibyte = 0; ibyte < sizeof(uint64_t); ++ibyte) {
+            out[ibyte] = static_cast<char>((id >> (8 * ibyte)) & 0xff);
+        };
+    }
+}
+
+namespace thorp {
+    IdFormat parse_id_format(const std::string& name)
+    {
+        if (name == "binary") return IdFormat::binary;
+        if (name == "decimal") return IdFormat::decimal;
+        if (name == "hex") return IdFormat::hex;
+        throw std::invalid_argument("unknown format " + name);
+    }
+
+    ObfuscatorParameters check_obfuscator_parameters(ObfuscatorParameters parameters)
+    {
+        if (!round_function_supported(parameters.round_function)) {
+            throw std::invalid_argument("--round-function is not supported by this cpu (aes128 needs AES-NI)");
+        };
+        const uint64_t level_max = OptThorpObfuscator::optimization_level_max_for(parameters.round_function);
+        if (parameters.optimization_level == 0) {
+            parameters.optimization_level = level_max;
+        };
+        if (parameters.optimization_level > level_max) {
+            throw std::invalid_argument("--level has to be between 1 and " + std::to_string(level_max) + " for this round function");
+        };
+        if (parameters.max_message % 2 == 0) {
+            throw std::invalid_argument("--max-message has to be odd (an even number of ids), "
+                "CycleWalkingObfuscator handles domains of any size");
+        };
+        if (parameters.npasses == 0) {
+            throw std::invalid_argument("--passes has to be at least 1");
+        };
+        if ((parameters.max_message / 2 + 1) % (1ull << (parameters.optimization_level - 1)) != 0) {
+            throw std::invalid_argument("half of the domain has to be divisible by 2^(level-1), pick a smaller --level");
+        };
+        return parameters;
+    }
+
+    IdParser::IdParser(IdFormat format, uint64_t max_message, BatchSink sink, std::size_t batch_size)
+        :format_{ format }
+        , max_message_{ max_message }
+        , sink_{ std::move(sink) }
+        , batch_size_{ std::max<std::size_t>(batch_size, 1) }{
+        this->batch_.reserve(this->batch_size_);
+    }
+
+    void IdParser::feed(const char* data, std::size_t size)
+    {
+        const char* const end = data + size;
+        if (!this->carry_.empty()) {
+            // complete the carried id first.
+            const char* const piece_end = this->format_ == IdFormat::binary
+                ? data + std::min<std::size_t>(size, sizeof(uint64_t) - this->carry_.size())
+                : std::find(data, end, '\n');
+            this->carry_.append(data, piece_end);
+            if (piece_end == end && !(this->format_ == IdFormat::binary && this->carry_.size() == sizeof(uint64_t))) {
+                return;
+            };
+            this->parse(this->carry_.data(), this->carry_.data() + this->carry_.size());
+            this->carry_.clear();
+            data = this->format_ == IdFormat::binary ? piece_end : piece_end + 1;
+        };
+        const char* const complete_end = this->complete_end(data, end);
+        this->parse(data, complete_end);
+        this->carry_.assign(complete_end, end);
+    }
+
+    void IdParser::finish()
+    {
+        if (!this->carry_.empty()) {
+            if (this->format_ == IdFormat::binary) {
+                throw std::runtime_error("the input ends within an id, binary input has to be a multiple of 8 bytes");
+            };
+            this->parse(this->carry_.data(), this->carry_.data() + this->carry_.size());
+            this->carry_.clear();
+        };
+        this->flush();
+    }
+
+    const char* IdParser::complete_end(const char* data, const char* end) const
+    {
+        if (this->format_ == IdFormat::binary) {
+            return data + (end - data) / sizeof(uint64_t) * sizeof(uint64_t);
+        };
+        for (const char* last = end; last != data; --last) {
+            if (last[-1] == '\n') return last;
+        };
+        return data;
+    }
+
+    void IdParser::parse(const char* data, const char* end)
+    {
+        if (this->format_ == IdFormat::binary) {
+            for (; data + sizeof(uint64_t) <= end; data += sizeof(uint64_t)) {
+                uint64_t id = 0;
+                for (std::size_t ibyte = 0; ibyte < sizeof(uint64_t); ++ibyte) {
+                    id |= static_cast<uint64_t>(static_cast<unsigned char>(data[ibyte])) << (8 * ibyte);
+                };
+                this->add(id);
+            };
+            return;
+        };
+        while (data < end) {
+            const char* line_end = std::find(data, end, '\n');
+            const char* token_end = line_end;
+            while (token_end != data && (token_end[-1] == '\r' || token_end[-1] == ' ' || token_end[-1] == '\t')) --token_end;
+            while (data != token_end && (*data == ' ' || *data == '\t')) ++data;
+            if (data != token_end) {
+                this->add(this->parse_text(data, token_end));
+            };
+            data = line_end == end ? end : line_end + 1;
+        };
+    }
+
+    uint64_t IdParser::parse_text(const char* first, const char* last) const
+    {
+        int base = 10;
+        if (this->format_ == IdFormat::hex) {
+            base = 16;
+            if (last - first > 2 && first[0] == '0' && (first[1] == 'x' || first[1] == 'X')) first += 2;
+        };
+        uint64_t id = 0;
+        const auto [ptr, error] = std::from_chars(first, last, id, base);
+        if (error != std::errc{} || ptr != last) {
+            throw std::runtime_error("not an id: " + std::string(first, last));
+        };
+        return id;
+    }
+
+    void IdParser::add(uint64_t id)
+    {
+        if (id > this->max_message_) {
+            throw std::runtime_error("id " + std::to_string(id) + " is larger than --max-message");
+        };
+        this->batch_.push_back(id);
+        if (this->batch_.size() == this->batch_size_) {
+            this->flush();
+        };
+    }
+
+    void IdParser::flush()
+    {
+        if (this->batch_.empty()) return;
+        this->sink_(std::move(this->batch_));
+        this->batch_ = {};
+        this->batch_.reserve(this->batch_size_);
+    }
+
+    IdWriter::IdWriter(std::FILE* file, IdFormat format, std::size_t buffer_size)
+        :format_{ format }
+        , file_{ file }
+        , buffer_(std::max(buffer_size, pair_size_max)){
+        assert(file != nullptr);
+    }
+
+    void IdWriter::write(const uint64_t* ids, std::size_t count)
+    {
+        for (std::size_t iid = 0; iid < count; ++iid) {
+            if (this->used_ + id_size_max > this->buffer_.size()) {
+                this->flush();
+            };
+            char* const out = this->buffer_.data() + this->used_;
+            if (this->format_ == IdFormat::binary) {
+                write_binary(out, ids[iid]);
+                this->used_ += sizeof(uint64_t);
+            }
+            else {
+                char* const end = std::to_chars(out, out + id_size_max, ids[iid], this->format_ == IdFormat::hex ? 16 : 10).ptr;
+                *end = '\n';
+                this->used_ += static_cast<std::size_t>(end + 1 - out);
+            };
+        };
+    }
+
+    void IdWriter::write_pairs(const PermutationPair* pairs, std::size_t count)
+    {
+        for (std::size_t ipair = 0; ipair < count; ++ipair) {
+            if (this->used_ + pair_size_max > this->buffer_.size()) {
+                this->flush();
+            };
+            char* const out = this->buffer_.data() + this->used_;
+            if (this->format_ == IdFormat::binary) {
+                write_binary(out, pairs[ipair].plaintext);
+                write_binary(out + sizeof(uint64_t), pairs[ipair].cyphertext);
+                this->used_ += 2 * sizeof(uint64_t);
+            }
+            else {
+                const int base = this->format_ == IdFormat::hex ? 16 : 10;
+                char* end = std::to_chars(out, out + pair_size_max, pairs[ipair].plaintext, base).ptr;
+                *end++ = ' ';
+                end = std::to_chars(end, out + pair_size_max, pairs[ipair].cyphertext, base).ptr;
+                *end = '\n';
+                this->used_ += static_cast<std::size_t>(end + 1 - out);
+            };
+        };
+    }
+
+    void IdWriter::flush()
+    {
+        if (this->used_ > 0 && std::fwrite(this->buffer_.data(), 1, this->used_, this->file_) != this->used_) {
+            throw std::runtime_error("can not write the output");
+        };
+        this->used_ = 0;
+    }
+
+    void IdWriter::close()
+    {
+        this->flush();
+        if (std::fflush(this->file_) != 0) {
+            throw std::runtime_error("can not write the output");
+        };
+    }
+}
@@ -0,0 +1,175 @@
+#include "ThorpKeySet.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <climits>
+
+namespace {
+    using thorp::byte_t;
+
+    // the round keys data OptThorpObfuscator::from_uint64 derives from key_number.
+    std::vector<byte_t> uint64_round_keys_data(uint64_t key_number, std::size_t size)
+    {
+        std::array<byte_t, randombytes_SEEDBYTES> key{};
+        static_assert(randombytes_SEEDBYTES >= 8, "too short key length");
+        for (int ibyte = 0; ibyte < 8; ++ibyte) {
+            key[ibyte] = static_cast<byte_t>(key_number >> 8 * ibyte);
+        };
+        std::vector<byte_t> round_keys_data(size, 0);
+        randombytes_buf_deterministic(round_keys_data.data(), round_keys_data.size(), key.data());
+        return round_keys_data;
+    }
+}
+
+namespace thorp {
+    KeySet::KeySet(const std::vector<std::vector<byte_t>>& round_keys_data, uint64_t max_message, uint64_t npasses,
+        uint64_t optimization_level, RoundFunction round_function)
+        :nkeys_{ round_keys_data.size() }
+        , max_message_{ max_message }
+        , npasses_{ npasses }
+        , optimization_level_{ optimization_level }
+        , round_function_{ round_function }
+        , hash_size_{ round_function_output_bits(round_function) / CHAR_BIT }
+        , stride_{ detail::prepared_round_key_size(round_function) > 0 ? detail::prepared_round_key_size(round_function)
+            : detail::round_key_size }{
+        assert(optimization_level > 0 && optimization_level <= OptThorpObfuscator::optimization_level_max_for(round_function));
+        assert(max_message % 2 == 1); // Thorpe can only handle even message_spaces
+        assert((max_message / 2 + 1) % (1ull << (optimization_level - 1)) == 0);
+        require_round_function_supported(round_function);
+        const uint64_t nrounds = nrounds_per_pass(max_message) * npasses;
+        const uint64_t nopt_rounds = (nrounds + optimization_level - 1) / optimization_level;
+        this->round_keys_.resize(nopt_rounds * this->nkeys_ * this->stride_);
+        for (std::size_t ikey = 0; ikey < this->nkeys_; ++ikey) {
+            assert(round_keys_data[ikey].size() >= nopt_rounds * detail::round_key_size);
+            std::vector<byte_t> prepared = detail::prepare_round_keys(round_function, round_keys_data[ikey].data(), nopt_rounds,
+                this->hash_size_);
+            const byte_t* const keys = prepared.empty() ? round_keys_data[ikey].data() : prepared.data();
+            for (uint64_t iopt_round = 0; iopt_round < nopt_rounds; ++iopt_round) {
+                std::copy_n(keys + iopt_round * this->stride_, this->stride_,
+                    this->round_keys_.begin() + (iopt_round * this->nkeys_ + ikey) * this->stride_);
+            };
+            sodium_memzero(prepared.data(), prepared.size());
+        };
+    }
+
+    KeySet KeySet::from_uint64(const std::vector<uint64_t>& key_numbers, uint64_t max_message, RoundFunction round_function)
+    {
+        return from_uint64(key_numbers, max_message, 8, OptThorpObfuscator::optimization_level_max_for(round_function), round_function);
+    }
+
+    KeySet KeySet::from_uint64(const std::vector<uint64_t>& key_numbers, uint64_t max_message, uint64_t npasses,
+        uint64_t optimization_level, RoundFunction round_function)
+    {
+        const std::size_t size = OptThorpObfuscator::round_keys_data_size(npasses, max_message, optimization_level);
+        std::vector<std::vector<byte_t>> round_keys_data;
+        round_keys_data.reserve(key_numbers.size());
+        for (uint64_t key_number : key_numbers) {
+            round_keys_data.push_back(uint64_round_keys_data(key_number, size));
+        };
+        KeySet key_set{ round_keys_data, max_message, npasses, optimization_level, round_function };
+        for (std::vector<byte_t>& data : round_keys_data) {
+            sodium_memzero(data.data(), data.size());
+        };
+        return key_set;
+    }
+
+    std::size_t KeySet::size() const noexcept
+    {
+        return this->nkeys_;
+    }
+
+    uint64_t KeySet::max_message() const noexcept
+    {
+        return this->max_message_;
+    }
+
+    uint64_t KeySet::npasses() const noexcept
+    {
+        return this->npasses_;
+    }
+
+    uint64_t KeySet::optimization_level() const noexcept
+    {
+        return this->optimization_level_;
+    }
+
+    RoundFunction KeySet::round_function() const noexcept
+    {
+        return this->round_function_;
+    }
+
+    // like OptThorpObfuscator::encrypt_batch, but every lane hashes with the round key of its own key set.
+    // the hash of an opt round is computed once at its first round (the last one for decryption) for all lanes.
+    // the opt rounds are the outer loop and the messages are kept in out between them, so every opt round
+    // reads the keys of its block of round_keys_ in one sweep over the lane groups.
+    template <bool Decrypt, class KeyIndex>
+    void KeySet::run_lanes(const KeyIndex& key_index, const uint64_t* in, uint64_t* out, std::size_t count) const
+    {
+        const detail::Blake2bLaneKernel& kernel = detail::round_lane_kernel(this->round_function_);
+        const std::size_t lanes = kernel.lanes;
+        const uint64_t half_max = this->max_message_ / 2 + 1;
+        const uint64_t projector = half_max >> (this->optimization_level_ - 1);
+        const uint64_t nrounds = nrounds_per_pass(this->max_message_) * this->npasses_;
+        const uint64_t nopt_rounds = (nrounds + this->optimization_level_ - 1) / this->optimization_level_;
+        std::array<uint64_t, detail::blake2b_lanes_max> messages{};
+        std::array<uint64_t, detail::blake2b_lanes_max> remainders{};
+        std::array<const byte_t*, detail::blake2b_lanes_max> keys{};
+        std::array<uint64_t, crypto_generichash_BYTES_MAX / sizeof(uint64_t) * detail::blake2b_lanes_max> hash_words{};
+        if (in != out) {
+            std::copy_n(in, count, out);
+        };
+        for (uint64_t istep = 0; istep < nopt_rounds; ++istep) {
+            const uint64_t iopt_round = Decrypt ? nopt_rounds - 1 - istep : istep;
+            const uint64_t first_round = iopt_round * this->optimization_level_;
+            const uint64_t npasses = std::min(this->optimization_level_, nrounds - first_round);
+            const byte_t* const round_keys = this->round_keys_.data() + iopt_round * this->nkeys_ * this->stride_;
+            for (std::size_t ifirst = 0; ifirst < count; ifirst += lanes) {
+                const std::size_t nlanes = std::min(lanes, count - ifirst);
+                for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                    // the unused lanes of the last group repeat its first message.
+                    const std::size_t imessage = ifirst + (ilane < nlanes ? ilane : 0);
+                    const std::size_t ikey = key_index(imessage);
+                    assert(ikey < this->nkeys_);
+                    messages[ilane] = out[imessage];
+                    // the remainder a, the hash input of all rounds of the opt round.
+                    remainders[ilane] = Decrypt ? ((messages[ilane] / 2) >> (npasses - 1)) % projector : messages[ilane] % half_max % projector;
+                    keys[ilane] = round_keys + ikey * this->stride_;
+                };
+                kernel.keyed_hash(hash_words.data(), this->hash_size_, remainders.data(), keys.data(), detail::round_key_size);
+                for (uint64_t ipass = 0; ipass < npasses; ++ipass) {
+                    const uint64_t iopt_pass = Decrypt ? npasses - 1 - ipass : ipass;
+                    for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                        const uint64_t remainder = Decrypt ? messages[ilane] / 2 : messages[ilane] % half_max;
+                        const uint64_t hi = (remainder >> iopt_pass) / projector;
+                        const uint64_t lo = remainder % (1ull << iopt_pass);
+                        const uint64_t ibit = iopt_pass * (1ull << (this->optimization_level_ - 1)) + (hi << iopt_pass) + lo;
+                        const uint64_t random_bit = (hash_words[(ibit / 64) * lanes + ilane] >> (ibit % 64)) & 1;
+                        if (Decrypt) {
+                            messages[ilane] = remainder + half_max * (random_bit ^ (messages[ilane] % 2));
+                        }
+                        else {
+                            messages[ilane] = remainder * 2 + (random_bit ^ (messages[ilane] / half_max));
+                        };
+                    };
+                };
+                std::copy_n(messages.begin(), nlanes, out + ifirst);
+            };
+        };
+    }
+
+    void KeySet::encrypt_under_all(uint64_t plaintext, uint64_t* cyphertexts) const
+    {
+        std::fill_n(cyphertexts, this->nkeys_, plaintext);
+        this->run_lanes<false>([](std::size_t imessage) { return imessage; }, cyphertexts, cyphertexts, this->nkeys_);
+    }
+
+    void KeySet::encrypt_many(const std::size_t* key_indices, const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const
+    {
+        this->run_lanes<false>([key_indices](std::size_t imessage) { return key_indices[imessage]; }, plaintexts, cyphertexts, count);
+    }
+
+    void KeySet::decrypt_many(const std::size_t* key_indices, const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const
+    {
+        this->run_lanes<true>([key_indices](std::size_t imessage) { return key_indices[imessage]; }, cyphertexts, plaintexts, count);
+    }
+}
@@ -0,0 +1,248 @@
+#include "ThorpMappedPermutation.hpp"
+#include "AtomicFile.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <system_error>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    using thorp::byte_t;
+    // the tables start on their own cache line.
+    constexpr uint64_t table_alignment = 64;
+
+    constexpr uint64_t align_up(uint64_t value) noexcept
+    {
+        return (value + table_alignment - 1) / table_alignment * table_alignment;
+    }
+
+    // maps the whole file read only, nullptr if it can't be opened or mapped.
+    const byte_t* map_file(const std::string& path, uint64_t& size) noexcept
+    {
+#if defined(_WIN32)
+        const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        };
+        LARGE_INTEGER file_size{};
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+            CloseHandle(file);
+            return nullptr;
+        };
+        const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) {
+            return nullptr;
+        };
+        void* const view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping); // the view keeps the mapping alive.
+        size = static_cast<uint64_t>(file_size.QuadPart);
+        return static_cast<const byte_t*>(view);
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        };
+        struct stat file_stat {};
+        if (::fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+            ::close(fd);
+            return nullptr;
+        };
+        void* const view = ::mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // the mapping keeps the file alive.
+        if (view == MAP_FAILED) {
+            return nullptr;
+        };
+        size = static_cast<uint64_t>(file_stat.st_size);
+        return static_cast<const byte_t*>(view);
+#endif
+    }
+
+    void unmap_file(const byte_t* view, uint64_t size) noexcept
+    {
+#if defined(_WIN32)
+        (void)size;
+        UnmapViewOfFile(view);
+#else
+        ::munmap(const_cast<byte_t*>(view), static_cast<std::size_t>(size));
+#endif
+    }
+
+    template <class Entry>
+    void write_tables(std::FILE* file, const thorp::PermutationFileHeader& header, const std::vector<uint64_t>& forward)
+    {
+        auto check = [](bool ok) {
+            if (!ok) throw std::system_error(errno, std::generic_category(), "can not write the permutation file");
+        };
+        std::vector<Entry> entries(forward.size());
+        std::vector<byte_t> padding(table_alignment, 0);
+        check(std::fwrite(&header, sizeof(header), 1, file) == 1);
+        check(std::fwrite(padding.data(), 1, header.forward_offset - sizeof(header), file) == header.forward_offset - sizeof(header));
+        for (std::size_t message = 0; message < forward.size(); ++message) {
+            entries[message] = static_cast<Entry>(forward[message]);
+        };
+        check(std::fwrite(entries.data(), sizeof(Entry), entries.size(), file) == entries.size());
+        const uint64_t forward_end = header.forward_offset + forward.size() * sizeof(Entry);
+        check(std::fwrite(padding.data(), 1, header.inverse_offset - forward_end, file) == header.inverse_offset - forward_end);
+        for (std::size_t message = 0; message < forward.size(); ++message) {
+            entries[forward[message]] = static_cast<Entry>(message);
+        };
+        check(std::fwrite(entries.data(), sizeof(Entry), entries.size(), file) == entries.size());
+    }
+}
+
+namespace thorp {
+    PermutationFileHeader PermutationFileHeader::for_obfuscator(const OptThorpObfuscator& obfuscator)
+    {
+        PermutationFileHeader header{};
+        header.magic = magic_value;
+        header.version = current_version;
+        header.entry_bytes = obfuscator.max_message() <= std::numeric_limits<uint32_t>::max() ? 4 : 8;
+        header.byte_order = byte_order_value;
+        header.max_message = obfuscator.max_message();
+        header.npasses = obfuscator.npasses();
+        header.optimization_level = obfuscator.optimization_level();
+        header.round_function = static_cast<uint64_t>(obfuscator.round_function());
+        header.key_fingerprint = obfuscator.key_fingerprint();
+        header.forward_offset = align_up(sizeof(PermutationFileHeader));
+        header.inverse_offset = align_up(header.forward_offset + (header.max_message + 1) * header.entry_bytes);
+        return header;
+    }
+
+    bool PermutationFileHeader::matches(const PermutationFileHeader& expected) const noexcept
+    {
+        return this->magic == expected.magic && this->version == expected.version && this->entry_bytes == expected.entry_bytes
+            && this->byte_order == expected.byte_order && this->max_message == expected.max_message
+            && this->npasses == expected.npasses && this->optimization_level == expected.optimization_level
+            && this->round_function == expected.round_function && this->key_fingerprint == expected.key_fingerprint
+            && this->forward_offset == expected.forward_offset && this->inverse_offset == expected.inverse_offset;
+    }
+
+    uint64_t PermutationFileHeader::file_size() const noexcept
+    {
+        return this->inverse_offset + (this->max_message + 1) * this->entry_bytes;
+    }
+
+    void write_permutation_file(const std::string& path, const OptThorpObfuscator& obfuscator, unsigned nthreads)
+    {
+        assert(obfuscator.max_message() < std::numeric_limits<uint64_t>::max()); // the tables have to fit into memory anyway.
+        const PermutationFileHeader header = PermutationFileHeader::for_obfuscator(obfuscator);
+        std::vector<uint64_t> forward(obfuscator.max_message() + 1);
+        obfuscator.permute_domain(forward.data(), nthreads);
+        // written next to the target and renamed, so readers never see a half written file.
+        detail::write_file_atomically(path, [&](std::FILE* file, const std::string&) {
+            if (header.entry_bytes == 4) {
+                write_tables<uint32_t>(file, header, forward);
+            }
+            else {
+                write_tables<uint64_t>(file, header, forward);
+            };
+            });
+    }
+
+    MappedPermutation::MappedPermutation(const std::string& path, OptThorpObfuscator obfuscator)
+        :obfuscator_{ std::move(obfuscator) }{
+        uint64_t size = 0;
+        const byte_t* const mapping = map_file(path, size);
+        if (mapping == nullptr) {
+            return;
+        };
+        const PermutationFileHeader expected = PermutationFileHeader::for_obfuscator(this->obfuscator_);
+        PermutationFileHeader header{};
+        if (size < sizeof(header)) {
+            unmap_file(mapping, size);
+            return;
+        };
+        std::memcpy(&header, mapping, sizeof(header));
+        if (!header.matches(expected) || size < expected.file_size()) {
+            unmap_file(mapping, size);
+            return;
+        };
+        this->mapping_ = mapping;
+        this->mapping_size_ = size;
+        this->forward_offset_ = header.forward_offset;
+        this->inverse_offset_ = header.inverse_offset;
+        this->entry_bytes_ = header.entry_bytes;
+    }
+
+    MappedPermutation::MappedPermutation(MappedPermutation&& other) noexcept
+        :obfuscator_{ std::move(other.obfuscator_) }
+        , mapping_{ std::exchange(other.mapping_, nullptr) }
+        , mapping_size_{ std::exchange(other.mapping_size_, 0) }
+        , forward_offset_{ other.forward_offset_ }
+        , inverse_offset_{ other.inverse_offset_ }
+        , entry_bytes_{ other.entry_bytes_ }{
+    }
+
+    MappedPermutation& MappedPermutation::operator=(MappedPermutation&& other) noexcept
+    {
+        if (this != &other) {
+            this->unmap();
+            this->obfuscator_ = std::move(other.obfuscator_);
+            this->mapping_ = std::exchange(other.mapping_, nullptr);
+            this->mapping_size_ = std::exchange(other.mapping_size_, 0);
+            this->forward_offset_ = other.forward_offset_;
+            this->inverse_offset_ = other.inverse_offset_;
+            this->entry_bytes_ = other.entry_bytes_;
+        };
+        return *this;
+    }
+
+    MappedPermutation::~MappedPermutation()
+    {
+        this->unmap();
+    }
+
+    void MappedPermutation::unmap() noexcept
+    {
+        if (this->mapping_ != nullptr) {
+            unmap_file(this->mapping_, this->mapping_size_);
+            this->mapping_ = nullptr;
+        };
+    }
+
+    bool MappedPermutation::is_mapped() const noexcept
+    {
+        return this->mapping_ != nullptr;
+    }
+
+    uint64_t MappedPermutation::max_message() const noexcept
+    {
+        return this->obfuscator_.max_message();
+    }
+
+    const OptThorpObfuscator& MappedPermutation::obfuscator() const noexcept
+    {
+        return this->obfuscator_;
+    }
+
+    uint64_t MappedPermutation::lookup(uint64_t offset, uint64_t index) const noexcept
+    {
+        assert(index <= this->obfuscator_.max_message());
+        if (this->entry_bytes_ == 4) {
+            return reinterpret_cast<const uint32_t*>(this->mapping_ + offset)[index];
+        };
+        return reinterpret_cast<const uint64_t*>(this->mapping_ + offset)[index];
+    }
+
+    uint64_t MappedPermutation::encrypt(uint64_t plaintext) const noexcept
+    {
+        return this->mapping_ != nullptr ? this->lookup(this->forward_offset_, plaintext) : this->obfuscator_.encrypt(plaintext);
+    }
+
+    uint64_t MappedPermutation::decrypt(uint64_t cyphertext) const noexcept
+    {
+        return this->mapping_ != nullptr ? this->lookup(this->inverse_offset_, cyphertext) : this->obfuscator_.decrypt(cyphertext);
+    }
+}
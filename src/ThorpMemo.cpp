@@ -0,0 +1,200 @@
+#include "ThorpMemo.hpp"
+#include <cassert>
+#include <utility>
+
+namespace thorp {
+    MemoCache::MemoCache(std::size_t memory_bytes)
+        :buckets_(memory_bytes / sizeof(Bucket))
+        , locks_{ std::make_unique<std::mutex[]>(lock_stripes) }{
+    }
+
+    std::size_t MemoCache::bucket_index(uint64_t key) const noexcept
+    {
+        // a multiplicative hash, consecutive ids spread over all buckets.
+        const uint64_t hash = (key ^ (key >> 29)) * 0x9e3779b97f4a7c15ull;
+        return static_cast<std::size_t>((hash >> 32 ^ hash) % this->buckets_.size());
+    }
+
+    bool MemoCache::find(uint64_t key, uint64_t& value) noexcept
+    {
+        if (this->buckets_.empty()) {
+            this->misses_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        };
+        const std::size_t ibucket = this->bucket_index(key);
+        Bucket& bucket = this->buckets_[ibucket];
+        {
+            std::lock_guard<std::mutex> lock{ this->locks_[ibucket % lock_stripes] };
+            for (std::size_t iway = 0; iway < ways; ++iway) {
+                if ((bucket.valid >> iway & 1) != 0 && bucket.keys[iway] == key) {
+                    value = bucket.values[iway];
+                    bucket.referenced = static_cast<uint8_t>(bucket.referenced | 1u << iway);
+                    this->hits_.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                };
+            };
+        };
+        this->misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void MemoCache::insert(uint64_t key, uint64_t value) noexcept
+    {
+        if (this->buckets_.empty()) {
+            return;
+        };
+        const std::size_t ibucket = this->bucket_index(key);
+        Bucket& bucket = this->buckets_[ibucket];
+        std::lock_guard<std::mutex> lock{ this->locks_[ibucket % lock_stripes] };
+        std::size_t iway = 0;
+        // another thread may have inserted it since the miss.
+        for (; iway < ways; ++iway) {
+            if ((bucket.valid >> iway & 1) != 0 && bucket.keys[iway] == key) {
+                return;
+            };
+        };
+        for (iway = 0; iway < ways && (bucket.valid >> iway & 1) != 0; ++iway) {
+        };
+        if (iway == ways) {
+            // the clock: the hand gives every marked entry a second chance.
+            while ((bucket.referenced >> bucket.hand & 1) != 0) {
+                bucket.referenced = static_cast<uint8_t>(bucket.referenced & ~(1u << bucket.hand));
+                bucket.hand = static_cast<uint8_t>((bucket.hand + 1) % ways);
+            };
+            iway = bucket.hand;
+            bucket.hand = static_cast<uint8_t>((bucket.hand + 1) % ways);
+            this->evictions_.fetch_add(1, std::memory_order_relaxed);
+        };
+        bucket.keys[iway] = key;
+        bucket.values[iway] = value;
+        bucket.valid = static_cast<uint8_t>(bucket.valid | 1u << iway);
+        bucket.referenced = static_cast<uint8_t>(bucket.referenced & ~(1u << iway));
+        this->insertions_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void MemoCache::clear() noexcept
+    {
+        for (std::size_t ibucket = 0; ibucket < this->buckets_.size(); ++ibucket) {
+            std::lock_guard<std::mutex> lock{ this->locks_[ibucket % lock_stripes] };
+            this->buckets_[ibucket].valid = 0;
+            this->buckets_[ibucket].referenced = 0;
+        };
+    }
+
+    std::size_t MemoCache::capacity() const noexcept
+    {
+        return this->buckets_.size() * ways;
+    }
+
+    MemoStatistics MemoCache::statistics() const noexcept
+    {
+        return MemoStatistics{ this->hits_.load(std::memory_order_relaxed), this->misses_.load(std::memory_order_relaxed),
+            this->insertions_.load(std::memory_order_relaxed), this->evictions_.load(std::memory_order_relaxed), this->capacity() };
+    }
+
+    void MemoCache::reset_statistics() noexcept
+    {
+        for (auto* counter : { &this->hits_, &this->misses_, &this->insertions_, &this->evictions_ }) {
+            counter->store(0, std::memory_order_relaxed);
+        };
+    }
+
+    MemoizedObfuscator::MemoizedObfuscator(OptThorpObfuscator obfuscator, std::size_t memory_bytes)
+        :obfuscator_{ std::move(obfuscator) }
+        , forward_{ std::make_unique<MemoCache>(memory_bytes / 2) }
+        , inverse_{ std::make_unique<MemoCache>(memory_bytes / 2) }{
+    }
+
+    uint64_t MemoizedObfuscator::max_message() const noexcept
+    {
+        return this->obfuscator_.max_message();
+    }
+
+    const OptThorpObfuscator& MemoizedObfuscator::obfuscator() const noexcept
+    {
+        return this->obfuscator_;
+    }
+
+    uint64_t MemoizedObfuscator::encrypt(uint64_t plaintext) const noexcept
+    {
+        uint64_t cyphertext = 0;
+        if (!this->forward_->find(plaintext, cyphertext)) {
+            cyphertext = this->obfuscator_.encrypt(plaintext);
+            this->forward_->insert(plaintext, cyphertext);
+            this->inverse_->insert(cyphertext, plaintext);
+        };
+        return cyphertext;
+    }
+
+    uint64_t MemoizedObfuscator::decrypt(uint64_t cyphertext) const noexcept
+    {
+        uint64_t plaintext = 0;
+        if (!this->inverse_->find(cyphertext, plaintext)) {
+            plaintext = this->obfuscator_.decrypt(cyphertext);
+            this->inverse_->insert(cyphertext, plaintext);
+            this->forward_->insert(plaintext, cyphertext);
+        };
+        return plaintext;
+    }
+
+    template <class Compute>
+    void MemoizedObfuscator::memoized_batch(MemoCache& from, MemoCache& to, const uint64_t* in, uint64_t* out, std::size_t count,
+        const Compute& compute) const
+    {
+        std::vector<std::size_t> missed;
+        std::vector<uint64_t> messages;
+        for (std::size_t imessage = 0; imessage < count; ++imessage) {
+            uint64_t result = 0;
+            const uint64_t message = in[imessage];
+            if (from.find(message, result)) {
+                out[imessage] = result;
+            }
+            else {
+                missed.push_back(imessage);
+                messages.push_back(message);
+            };
+        };
+        if (missed.empty()) {
+            return;
+        };
+        std::vector<uint64_t> results(messages.size());
+        compute(messages.data(), results.data(), messages.size());
+        for (std::size_t imissed = 0; imissed < missed.size(); ++imissed) {
+            out[missed[imissed]] = results[imissed];
+            from.insert(messages[imissed], results[imissed]);
+            to.insert(results[imissed], messages[imissed]);
+        };
+    }
+
+    void MemoizedObfuscator::encrypt_batch(const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const
+    {
+        this->memoized_batch(*this->forward_, *this->inverse_, plaintexts, cyphertexts, count,
+            [this](const uint64_t* in, uint64_t* out, std::size_t n) { this->obfuscator_.encrypt_batch(in, out, n); });
+    }
+
+    void MemoizedObfuscator::decrypt_batch(const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const
+    {
+        this->memoized_batch(*this->inverse_, *this->forward_, cyphertexts, plaintexts, count,
+            [this](const uint64_t* in, uint64_t* out, std::size_t n) { this->obfuscator_.decrypt_batch(in, out, n); });
+    }
+
+    MemoStatistics MemoizedObfuscator::statistics() const noexcept
+    {
+        const MemoStatistics forward = this->forward_->statistics();
+        const MemoStatistics inverse = this->inverse_->statistics();
+        return MemoStatistics{ forward.hits + inverse.hits, forward.misses + inverse.misses,
+            forward.insertions + inverse.insertions, forward.evictions + inverse.evictions, forward.capacity + inverse.capacity };
+    }
+
+    void MemoizedObfuscator::reset_statistics() const noexcept
+    {
+        this->forward_->reset_statistics();
+        this->inverse_->reset_statistics();
+    }
+
+    void MemoizedObfuscator::clear() const noexcept
+    {
+        this->forward_->clear();
+        this->inverse_->clear();
+    }
+}
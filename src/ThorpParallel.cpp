@@ -0,0 +1,189 @@
+#include "ThorpParallel.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace {
+    // the pools whose tasks the calling thread is running, innermost first.
+    struct RunningPool {
+        const thorp::WorkStealingPool* pool;
+        const RunningPool* outer;
+    };
+    thread_local const RunningPool* running_pools = nullptr;
+
+    // marks the calling thread as running tasks of pool for its lifetime.
+    class EnterPool {
+    public:
+        explicit EnterPool(const thorp::WorkStealingPool* pool) noexcept
+            :running_{ pool, running_pools }{
+            running_pools = &this->running_;
+        }
+        EnterPool(const EnterPool&) = delete;
+        EnterPool& operator=(const EnterPool&) = delete;
+        ~EnterPool()
+        {
+            running_pools = this->running_.outer;
+        }
+    private:
+        RunningPool running_;
+    };
+
+    bool runs_task_of(const thorp::WorkStealingPool* pool) noexcept
+    {
+        for (const RunningPool* running = running_pools; running != nullptr; running = running->outer) {
+            if (running->pool == pool) {
+                return true;
+            };
+        };
+        return false;
+    }
+}
+
+namespace thorp {
+    WorkStealingPool::WorkStealingPool(unsigned nthreads)
+        :nworkers_{ nthreads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : nthreads }
+        , slices_{ std::make_unique<Slice[]>(this->nworkers_) }{
+        // worker 0 is the thread calling run.
+        this->threads_.reserve(this->nworkers_ - 1);
+        for (unsigned iworker = 1; iworker < this->nworkers_; ++iworker) {
+            this->threads_.emplace_back([this, iworker]() { this->worker_loop(iworker); });
+        };
+    }
+
+    WorkStealingPool::~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{ this->mutex_ };
+            this->stop_ = true;
+        };
+        this->wake_.notify_all();
+        for (auto& thread : this->threads_) {
+            thread.join();
+        };
+    }
+
+    unsigned WorkStealingPool::size() const noexcept
+    {
+        return this->nworkers_;
+    }
+
+    WorkStealingPool& WorkStealingPool::shared()
+    {
+        static WorkStealingPool pool{};
+        return pool;
+    }
+
+    void WorkStealingPool::run(std::size_t ntasks, const std::function<void(std::size_t)>& task)
+    {
+        if (ntasks == 0) {
+            return;
+        };
+        // a task of this pool running the pool again would wait for itself, it runs the tasks inline.
+        if (runs_task_of(this)) {
+            for (std::size_t itask = 0; itask < ntasks; ++itask) {
+                task(itask);
+            };
+            return;
+        };
+        std::lock_guard<std::mutex> run_lock{ this->run_mutex_ };
+        if (this->nworkers_ == 1 || ntasks == 1) {
+            const EnterPool enter{ this };
+            for (std::size_t itask = 0; itask < ntasks; ++itask) {
+                task(itask);
+            };
+            return;
+        };
+        // contiguous slices, worker i starts at the i-th part of the tasks.
+        for (unsigned iworker = 0; iworker < this->nworkers_; ++iworker) {
+            Slice& slice = this->slices_[iworker];
+            std::lock_guard<std::mutex> lock{ slice.mutex };
+            slice.next = ntasks * iworker / this->nworkers_;
+            slice.end = ntasks * (iworker + 1) / this->nworkers_;
+        };
+        {
+            std::lock_guard<std::mutex> lock{ this->mutex_ };
+            this->task_ = &task;
+            this->error_ = nullptr;
+            this->busy_ = this->nworkers_ - 1;
+            ++this->generation_;
+        };
+        this->wake_.notify_all();
+        this->work(0);
+        std::unique_lock<std::mutex> lock{ this->mutex_ };
+        this->done_.wait(lock, [this]() { return this->busy_ == 0; });
+        this->task_ = nullptr;
+        if (this->error_) {
+            std::rethrow_exception(std::exchange(this->error_, nullptr));
+        };
+    }
+
+    void WorkStealingPool::worker_loop(unsigned iworker)
+    {
+        uint64_t seen_generation = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock{ this->mutex_ };
+                this->wake_.wait(lock, [&]() { return this->stop_ || this->generation_ != seen_generation; });
+                if (this->stop_) {
+                    return;
+                };
+                seen_generation = this->generation_;
+            };
+            this->work(iworker);
+            std::lock_guard<std::mutex> lock{ this->mutex_ };
+            if (--this->busy_ == 0) {
+                this->done_.notify_one();
+            };
+        };
+    }
+
+    void WorkStealingPool::work(unsigned iworker)
+    {
+        const EnterPool enter{ this };
+        std::size_t itask = 0;
+        while (this->take(iworker, itask)) {
+            try {
+                (*this->task_)(itask);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock{ this->mutex_ };
+                if (!this->error_) {
+                    this->error_ = std::current_exception();
+                };
+            };
+        };
+    }
+
+    bool WorkStealingPool::take(unsigned iworker, std::size_t& itask)
+    {
+        Slice& own = this->slices_[iworker];
+        {
+            std::lock_guard<std::mutex> lock{ own.mutex };
+            if (own.next < own.end) {
+                itask = own.next++;
+                return true;
+            };
+        };
+        // steal the upper half of the next slice that has tasks left, starting with the neighbour.
+        for (unsigned ioffset = 1; ioffset < this->nworkers_; ++ioffset) {
+            Slice& victim = this->slices_[(iworker + ioffset) % this->nworkers_];
+            std::size_t first = 0;
+            std::size_t end = 0;
+            {
+                std::lock_guard<std::mutex> lock{ victim.mutex };
+                const std::size_t left = victim.end - victim.next;
+                if (left == 0) {
+                    continue;
+                };
+                end = victim.end;
+                first = end - (left + 1) / 2;
+                victim.end = first;
+            };
+            std::lock_guard<std::mutex> lock{ own.mutex };
+            itask = first;
+            own.next = first + 1;
+            own.end = end;
+            return true;
+        };
+        return false;
+    }
+}
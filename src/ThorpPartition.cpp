@@ -0,0 +1,78 @@
+#include "ThorpPartition.hpp"
+#include "AtomicFile.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include <system_error>
+
+namespace thorp {
+    std::vector<Shard> partition_domain(uint64_t max_message, uint64_t nshards)
+    {
+        if (nshards == 0 || nshards - 1 > max_message) {
+            throw std::invalid_argument("the domain can not be cut into " + std::to_string(nshards) + " shards");
+        };
+        // the domain has max_message + 1 messages, which may not fit into 64 bits.
+        const uint64_t base_size = max_message / nshards + (max_message % nshards + 1 == nshards ? 1 : 0);
+        const uint64_t nlarger = max_message % nshards + 1 == nshards ? 0 : max_message % nshards + 1;
+        std::vector<Shard> shards;
+        shards.reserve(nshards);
+        uint64_t first = 0;
+        for (uint64_t ishard = 0; ishard < nshards; ++ishard) {
+            const uint64_t size = base_size + (ishard < nlarger ? 1 : 0);
+            shards.push_back(Shard{ first, first + (size - 1) });
+            first += size;
+        };
+        return shards;
+    }
+
+    void export_shard(const OptThorpObfuscator& obfuscator, const Shard& shard, const PairSink& sink, const Executor& executor)
+    {
+        assert(shard.first <= shard.last && shard.last <= obfuscator.max_message());
+        std::vector<uint64_t> plaintexts(export_block_size);
+        std::vector<PermutationPair> pairs(export_block_size);
+        uint64_t first = shard.first;
+        for (;;) {
+            const std::size_t count = static_cast<std::size_t>(std::min<uint64_t>(export_block_size - 1, shard.last - first) + 1);
+            detail::for_each_chunk(count, executor, [&](std::size_t chunk_first, std::size_t chunk_count) {
+                obfuscator.decrypt_range(first + chunk_first, chunk_count, plaintexts.data() + chunk_first);
+                });
+            for (std::size_t ipair = 0; ipair < count; ++ipair) {
+                pairs[ipair] = PermutationPair{ plaintexts[ipair], first + ipair };
+            };
+            sink(pairs.data(), count);
+            if (shard.last - first < export_block_size) {
+                break;
+            };
+            first += export_block_size;
+        };
+    }
+
+    void export_shard(const OptThorpObfuscator& obfuscator, const Shard& shard, const PairSink& sink, WorkStealingPool& pool)
+    {
+        export_shard(obfuscator, shard, sink, detail::pool_executor(pool));
+    }
+
+    void export_partition(const OptThorpObfuscator& obfuscator, uint64_t nshards,
+        const std::function<void(uint64_t ishard, const PermutationPair* pairs, std::size_t count)>& sink, WorkStealingPool& pool)
+    {
+        const std::vector<Shard> shards = partition_domain(obfuscator.max_message(), nshards);
+        for (uint64_t ishard = 0; ishard < nshards; ++ishard) {
+            export_shard(obfuscator, shards[ishard], [&](const PermutationPair* pairs, std::size_t count) {
+                sink(ishard, pairs, count);
+                }, pool);
+        };
+    }
+
+    void write_shard_file(const std::string& path, const OptThorpObfuscator& obfuscator, const Shard& shard, WorkStealingPool& pool)
+    {
+        detail::write_file_atomically(path, [&](std::FILE* file, const std::string& temporary_path) {
+            export_shard(obfuscator, shard, [&](const PermutationPair* pairs, std::size_t count) {
+                if (std::fwrite(pairs, sizeof(PermutationPair), count, file) != count) {
+                    throw std::system_error(errno, std::generic_category(), "can not write " + temporary_path);
+                };
+                }, pool);
+            });
+    }
+}
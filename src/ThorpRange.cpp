@@ -0,0 +1,221 @@
+#include "ThorpShuffler.hpp"
+#include "ThorpBlake2b.hpp"
+#include <algorithm>
+
+// encrypts many messages at once and hashes every distinct input of an opt round only once.
+// in an opt round the bits of a message come from the hash of a = (remainder >> j) % projector,
+// which is the same for all rounds of the opt round. messages whose a agree share the hash, so
+// per opt round we collect the distinct a of all messages (in a table indexed by a), hash them with
+// the lane kernel and let every message look its bits up.
+// with far more possible a than messages (large domains) nothing is shared and encrypt_batch is used.
+
+namespace {
+    using thorp::byte_t;
+    constexpr std::size_t hash_words_max = crypto_generichash_BYTES_MAX / sizeof(uint64_t);
+    // sharing pays off once there is one message for this many possible hash inputs.
+    constexpr uint64_t shared_inputs_per_message = 4;
+
+    class SharedHashRounds {
+    public:
+        SharedHashRounds(const thorp::detail::RoundKeySource& round_keys, uint64_t max_message, uint64_t npasses,
+            uint64_t optimization_level, thorp::detail::OperationCounts& counts)
+            :round_keys_{ round_keys }
+            , kernel_{ thorp::detail::round_lane_kernel(round_keys.round_function) }
+            , half_max_{ max_message / 2 + 1 }
+            , nrounds_{ thorp::nrounds_per_pass(max_message) * npasses }
+            , optimization_level_{ optimization_level }
+            , selectors_{ 1ull << (optimization_level - 1) }
+            , projector_{ (max_message / 2 + 1) >> (optimization_level - 1) }
+            , words_per_hash_{ static_cast<std::size_t>((optimization_level * (1ull << (optimization_level - 1)) + 63) / 64) }
+            , counts_{ counts }{
+            assert(this->words_per_hash_ <= hash_words_max);
+            assert(this->words_per_hash_ * sizeof(uint64_t) <= round_keys.outlen);
+        }
+
+        // whether count messages share enough hashes to beat encrypt_batch. projector_ is the number of
+        // distinct inputs of an opt round, with far less messages than that hardly any hash is shared.
+        bool shares_hashes(std::size_t count) const noexcept
+        {
+            return this->projector_ / shared_inputs_per_message <= count;
+        }
+
+        void encrypt(uint64_t* messages, std::size_t count)
+        {
+            const uint64_t nopt_rounds = (this->nrounds_ + this->optimization_level_ - 1) / this->optimization_level_;
+            for (uint64_t iopt_round = 0; iopt_round < nopt_rounds; ++iopt_round) {
+                const uint64_t first_round = iopt_round * this->optimization_level_;
+                const uint64_t npasses = std::min(this->optimization_level_, this->nrounds_ - first_round);
+                // the remainder of the first round, a does not change during the opt round.
+                this->hash_opt_round(messages, count, iopt_round, [this](uint64_t message) {
+                    return (message % this->half_max_) % this->projector_;
+                    });
+                for (std::size_t i = 0; i < count; ++i) {
+                    const uint64_t* const hash = this->hash_of(i);
+                    uint64_t message = messages[i];
+                    for (uint64_t iopt_pass = 0; iopt_pass < npasses; ++iopt_pass) {
+                        const uint64_t remainder = message % this->half_max_;
+                        const uint64_t bit = this->bit(hash, remainder, iopt_pass);
+                        message = remainder * 2 + (bit ^ message / this->half_max_);
+                    };
+                    messages[i] = message;
+                };
+            };
+        }
+
+        void decrypt(uint64_t* messages, std::size_t count)
+        {
+            const uint64_t nopt_rounds = (this->nrounds_ + this->optimization_level_ - 1) / this->optimization_level_;
+            for (uint64_t iopt_round = nopt_rounds; iopt_round-- > 0;) {
+                const uint64_t first_round = iopt_round * this->optimization_level_;
+                const uint64_t npasses = std::min(this->optimization_level_, this->nrounds_ - first_round);
+                // the remainder of the last round of the opt round, the first one that is undone.
+                this->hash_opt_round(messages, count, iopt_round, [this, npasses](uint64_t message) {
+                    return ((message / 2) >> (npasses - 1)) % this->projector_;
+                    });
+                for (std::size_t i = 0; i < count; ++i) {
+                    const uint64_t* const hash = this->hash_of(i);
+                    uint64_t message = messages[i];
+                    for (uint64_t iopt_pass = npasses; iopt_pass-- > 0;) {
+                        const uint64_t remainder = message / 2;
+                        const uint64_t bit = this->bit(hash, remainder, iopt_pass);
+                        message = remainder + this->half_max_ * (bit ^ message % 2);
+                    };
+                    messages[i] = message;
+                };
+            };
+        }
+
+    private:
+        // fills hashes_ and slots_ such that hash_of(i) is the hash of message i in the opt round.
+        template <class RemainderFn>
+        void hash_opt_round(const uint64_t* messages, std::size_t count, uint64_t iopt_round, RemainderFn&& opt_remainder)
+        {
+            constexpr std::size_t no_slot = std::numeric_limits<std::size_t>::max();
+            this->inputs_.clear();
+            this->slot_of_input_.assign(static_cast<std::size_t>(this->projector_), no_slot);
+            this->slots_.resize(count);
+            for (std::size_t i = 0; i < count; ++i) {
+                const uint64_t input = opt_remainder(messages[i]);
+                std::size_t& slot = this->slot_of_input_[static_cast<std::size_t>(input)];
+                if (slot == no_slot) {
+                    slot = this->inputs_.size();
+                    this->inputs_.push_back(input);
+                };
+                this->slots_[i] = slot;
+            };
+            this->hash_inputs(iopt_round);
+            // every other message of the opt round takes its bits from a shared hash, in every round.
+            const uint64_t first_round = iopt_round * this->optimization_level_;
+            const uint64_t npasses = std::min(this->optimization_level_, this->nrounds_ - first_round);
+            this->counts_.add_cache_hits(count * npasses - this->inputs_.size());
+        }
+
+        void hash_inputs(uint64_t iopt_round)
+        {
+            const std::size_t lanes = this->kernel_.lanes;
+            std::array<uint64_t, thorp::detail::blake2b_lanes_max> remainders{};
+            std::array<uint64_t, hash_words_max * thorp::detail::blake2b_lanes_max> hash_words{};
+            std::array<const byte_t*, thorp::detail::blake2b_lanes_max> keys{};
+            keys.fill(this->round_keys_.round_key(iopt_round, this->round_key_scratch_.data()));
+            this->hashes_.resize(this->inputs_.size() * this->words_per_hash_);
+            for (std::size_t first = 0; first < this->inputs_.size(); first += lanes) {
+                const std::size_t nlanes = std::min(lanes, this->inputs_.size() - first);
+                std::copy_n(this->inputs_.begin() + first, nlanes, remainders.begin());
+                this->kernel_.keyed_hash(hash_words.data(), this->round_keys_.outlen, remainders.data(), keys.data(),
+                    thorp::detail::round_key_size);
+                for (std::size_t ilane = 0; ilane < nlanes; ++ilane) {
+                    for (std::size_t iword = 0; iword < this->words_per_hash_; ++iword) {
+                        this->hashes_[(first + ilane) * this->words_per_hash_ + iword] = hash_words[iword * lanes + ilane];
+                    };
+                };
+            };
+            this->counts_.add_hashes(this->inputs_.size(), this->round_keys_);
+        }
+
+        const uint64_t* hash_of(std::size_t index) const noexcept
+        {
+            return this->hashes_.data() + this->slots_[index] * this->words_per_hash_;
+        }
+
+        // see OptimizedBitGenerator::generate_bit
+        uint64_t bit(const uint64_t* hash, uint64_t remainder, uint64_t iopt_pass) const noexcept
+        {
+            const uint64_t hi = (remainder >> iopt_pass) / this->projector_;
+            const uint64_t lo = remainder % (1ull << iopt_pass);
+            const uint64_t selector = (hi << iopt_pass) + lo;
+            assert(selector < this->selectors_);
+            const uint64_t ibit = iopt_pass * this->selectors_ + selector;
+            return (hash[ibit / 64] >> (ibit % 64)) & 1;
+        }
+
+    private:
+        const thorp::detail::RoundKeySource& round_keys_;
+        const thorp::detail::Blake2bLaneKernel& kernel_;
+        uint64_t half_max_;
+        uint64_t nrounds_;
+        uint64_t optimization_level_;
+        uint64_t selectors_;
+        uint64_t projector_;
+        std::size_t words_per_hash_;
+        thorp::detail::OperationCounts& counts_;
+        std::array<byte_t, thorp::detail::prepared_round_key_size_max> round_key_scratch_{};
+        // the distinct a of the opt round and their hashes (words_per_hash_ words each).
+        std::vector<uint64_t> inputs_;
+        std::vector<uint64_t> hashes_;
+        // message i takes its hash from slots_[i], the input a from slot_of_input_[a].
+        std::vector<std::size_t> slots_;
+        std::vector<std::size_t> slot_of_input_;
+    };
+}
+
+namespace thorp {
+    void OptThorpObfuscator::encrypt_range(uint64_t first, std::size_t count, uint64_t* out) const
+    {
+        assert(count == 0 || (first <= this->max_message_ && count - 1 <= this->max_message_ - first));
+        std::iota(out, out + count, first);
+        this->encrypt_shared(out, out, count);
+    }
+
+    void OptThorpObfuscator::decrypt_range(uint64_t first, std::size_t count, uint64_t* out) const
+    {
+        assert(count == 0 || (first <= this->max_message_ && count - 1 <= this->max_message_ - first));
+        std::iota(out, out + count, first);
+        this->decrypt_shared(out, out, count);
+    }
+
+    void OptThorpObfuscator::encrypt_shared(const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const
+    {
+        const detail::RoundKeySource round_keys = this->round_key_source();
+        detail::OperationCounts counts;
+        SharedHashRounds rounds{ round_keys, this->max_message_, this->npasses_, this->optimization_level_, counts };
+        if (!rounds.shares_hashes(count)) {
+            this->encrypt_batch(plaintexts, cyphertexts, count);
+            return;
+        };
+        if (plaintexts != cyphertexts) {
+            std::copy_n(plaintexts, count, cyphertexts);
+        };
+        rounds.encrypt(cyphertexts, count);
+        counts.add_operations(count);
+        counts.add_rounds(count * nrounds_per_pass(this->max_message_) * this->npasses_);
+        this->instrumentation_.record(counts);
+    }
+
+    void OptThorpObfuscator::decrypt_shared(const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const
+    {
+        const detail::RoundKeySource round_keys = this->round_key_source();
+        detail::OperationCounts counts;
+        SharedHashRounds rounds{ round_keys, this->max_message_, this->npasses_, this->optimization_level_, counts };
+        if (!rounds.shares_hashes(count)) {
+            this->decrypt_batch(cyphertexts, plaintexts, count);
+            return;
+        };
+        if (cyphertexts != plaintexts) {
+            std::copy_n(cyphertexts, count, plaintexts);
+        };
+        rounds.decrypt(plaintexts, count);
+        counts.add_operations(count);
+        counts.add_rounds(count * nrounds_per_pass(this->max_message_) * this->npasses_);
+        this->instrumentation_.record(counts);
+    }
+}
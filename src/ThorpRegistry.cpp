@@ -0,0 +1,142 @@
+#include "ThorpRegistry.hpp"
+#include <algorithm>
+#include <mutex>
+
+namespace {
+    // splitmix64 finalizer
+    uint64_t mix(uint64_t value) noexcept
+    {
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9ull;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111ebull;
+        value ^= value >> 31;
+        return value;
+    }
+
+    std::atomic<std::size_t> next_thread_stripe{ 0 };
+    // the threads take the hit stripes round robin.
+    thread_local const std::size_t thread_stripe = next_thread_stripe.fetch_add(1, std::memory_order_relaxed);
+}
+
+namespace thorp {
+    std::size_t ObfuscatorRegistry::KeyHash::operator()(const RegistryKey& key) const noexcept
+    {
+        uint64_t hash = mix(key.key_number);
+        hash = mix(hash ^ key.max_message);
+        hash = mix(hash ^ (key.npasses << 8 ^ key.optimization_level << 4 ^ static_cast<uint64_t>(key.round_function)));
+        return static_cast<std::size_t>(hash);
+    }
+
+    ObfuscatorRegistry::ObfuscatorRegistry(std::size_t capacity, std::size_t nshards)
+        :capacity_per_shard_{ (capacity + std::max<std::size_t>(nshards, 1) - 1) / std::max<std::size_t>(nshards, 1) }
+        , shards_(std::max<std::size_t>(nshards, 1))
+        , hit_stripes_{ std::make_unique<HitStripe[]>(hit_stripes) }{
+        assert(capacity > 0);
+        for (Shard& shard : this->shards_) {
+            shard.slots = std::make_unique<Slot[]>(this->capacity_per_shard_);
+            shard.index.reserve(this->capacity_per_shard_);
+        };
+    }
+
+    RegistryKey ObfuscatorRegistry::resolved(const RegistryKey& key) noexcept
+    {
+        RegistryKey resolved_key = key;
+        if (resolved_key.optimization_level == 0) {
+            resolved_key.optimization_level = OptThorpObfuscator::optimization_level_max_for(key.round_function);
+        };
+        return resolved_key;
+    }
+
+    auto ObfuscatorRegistry::shard_for(const RegistryKey& key) noexcept -> Shard&
+    {
+        // the low bits pick the bucket inside the shard, the high ones the shard.
+        const uint64_t hash = KeyHash{}(key);
+        return this->shards_[(hash >> 32) % this->shards_.size()];
+    }
+
+    auto ObfuscatorRegistry::hit_stripe() noexcept -> HitStripe&
+    {
+        return this->hit_stripes_[thread_stripe % hit_stripes];
+    }
+
+    std::shared_ptr<const OptThorpObfuscator> ObfuscatorRegistry::get(const RegistryKey& requested)
+    {
+        const RegistryKey key = resolved(requested);
+        Shard& shard = this->shard_for(key);
+        {
+            std::shared_lock<std::shared_mutex> lock{ shard.mutex };
+            const auto found = shard.index.find(key);
+            if (found != shard.index.end()) {
+                Slot& slot = shard.slots[found->second];
+                // a hot entry is already marked, reading the bit keeps its line shared between the cores.
+                if (!slot.referenced.load(std::memory_order_relaxed)) {
+                    slot.referenced.store(true, std::memory_order_relaxed);
+                };
+                this->hit_stripe().hits.fetch_add(1, std::memory_order_relaxed);
+                return slot.obfuscator;
+            };
+        };
+        shard.misses.fetch_add(1, std::memory_order_relaxed);
+        auto obfuscator = std::make_shared<const OptThorpObfuscator>(OptThorpObfuscator::from_uint64(
+            key.key_number, key.max_message, key.npasses, key.optimization_level, key.round_function));
+
+        std::unique_lock<std::shared_mutex> lock{ shard.mutex };
+        const auto found = shard.index.find(key);
+        if (found != shard.index.end()) {
+            Slot& slot = shard.slots[found->second];
+            slot.referenced.store(true, std::memory_order_relaxed);
+            return slot.obfuscator;
+        };
+        std::size_t islot = shard.used;
+        if (shard.used < this->capacity_per_shard_) {
+            ++shard.used;
+        }
+        else {
+            // the clock: every referenced entry gets a second chance, the hand stops at the first one that was not.
+            while (shard.slots[shard.hand].referenced.load(std::memory_order_relaxed)) {
+                shard.slots[shard.hand].referenced.store(false, std::memory_order_relaxed);
+                shard.hand = (shard.hand + 1) % this->capacity_per_shard_;
+            };
+            islot = shard.hand;
+            shard.hand = (shard.hand + 1) % this->capacity_per_shard_;
+            shard.index.erase(shard.slots[islot].key);
+            shard.evictions.fetch_add(1, std::memory_order_relaxed);
+        };
+        Slot& slot = shard.slots[islot];
+        slot.key = key;
+        slot.obfuscator = obfuscator;
+        slot.referenced.store(false, std::memory_order_relaxed);
+        shard.index.emplace(key, islot);
+        return obfuscator;
+    }
+
+    void ObfuscatorRegistry::clear()
+    {
+        for (Shard& shard : this->shards_) {
+            std::unique_lock<std::shared_mutex> lock{ shard.mutex };
+            for (std::size_t islot = 0; islot < shard.used; ++islot) {
+                shard.slots[islot].obfuscator.reset();
+                shard.slots[islot].referenced.store(false, std::memory_order_relaxed);
+            };
+            shard.index.clear();
+            shard.used = 0;
+            shard.hand = 0;
+        };
+    }
+
+    RegistryStats ObfuscatorRegistry::stats() const
+    {
+        RegistryStats stats{ 0, 0, 0, 0 };
+        for (std::size_t istripe = 0; istripe < hit_stripes; ++istripe) {
+            stats.hits += this->hit_stripes_[istripe].hits.load(std::memory_order_relaxed);
+        };
+        for (const Shard& shard : this->shards_) {
+            stats.misses += shard.misses.load(std::memory_order_relaxed);
+            stats.evictions += shard.evictions.load(std::memory_order_relaxed);
+            std::shared_lock<std::shared_mutex> lock{ shard.mutex };
+            stats.size += shard.index.size();
+        };
+        return stats;
+    }
+}
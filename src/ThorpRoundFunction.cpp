@@ -0,0 +1,184 @@
+#include "ThorpRoundFunction.hpp"
+#include "CpuFeatures.hpp"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <sodium.h>
+
+namespace thorp::detail {
+    // defined in ThorpAes.cpp
+    void aes128_expand_key(const byte_t* key, byte_t* prepared_key) noexcept;
+    void aes128_hash(byte_t* out, std::size_t outlen, uint64_t message, const byte_t* prepared_key) noexcept;
+    void aes128_hash_lanes(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* keys, std::size_t keylen) noexcept;
+}
+
+namespace {
+    using thorp::byte_t;
+    static_assert(thorp::detail::round_key_size == crypto_generichash_KEYBYTES_MIN, "unexpected blake2b key length");
+    static_assert(thorp::detail::round_key_size == crypto_shorthash_KEYBYTES, "unexpected siphash key length");
+    static_assert(crypto_shorthash_BYTES * CHAR_BIT == 64, "unexpected siphash length");
+
+    std::array<byte_t, sizeof(uint64_t)> generate_message(uint64_t message) noexcept
+    {
+        std::array<byte_t, sizeof(uint64_t)> message_out{};
+        for (int ibyte = 0; ibyte < 8; ++ibyte) {
+            message_out[ibyte] = static_cast<byte_t>(message >> 8 * ibyte);
+        };
+        return message_out;
+    }
+
+    void siphash_hash(byte_t* out, std::size_t outlen, uint64_t message, const byte_t* key) noexcept
+    {
+        assert(outlen <= crypto_shorthash_BYTES);
+        const std::array<byte_t, sizeof(uint64_t)> in_message = generate_message(message);
+        std::array<byte_t, crypto_shorthash_BYTES> out_message{};
+        crypto_shorthash(out_message.data(), in_message.data(), in_message.size(), key);
+        for (std::size_t ibyte = 0; ibyte < outlen; ++ibyte) {
+            out[ibyte] = out_message[ibyte];
+        };
+    }
+
+    // siphash is cheap enough on its own, the lanes are hashed one after the other.
+    void siphash_hash_lanes(uint64_t* out_words, std::size_t outlen, const uint64_t* messages,
+        const byte_t* const* keys, std::size_t) noexcept
+    {
+        constexpr std::size_t lanes = 4;
+        assert(outlen == crypto_shorthash_BYTES);
+        for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+            std::array<byte_t, crypto_shorthash_BYTES> out_message{};
+            siphash_hash(out_message.data(), out_message.size(), messages[ilane], keys[ilane]);
+            out_words[ilane] = thorp::detail::blake2b_load_word(out_message.data(), out_message.size());
+        };
+    }
+
+    constexpr thorp::detail::Blake2bLaneKernel siphash_kernel{ "siphash24", 4, &siphash_hash_lanes };
+    constexpr thorp::detail::Blake2bLaneKernel aes_kernel{ "aesni", thorp::detail::blake2b_lanes_max, &thorp::detail::aes128_hash_lanes };
+}
+
+namespace thorp {
+    bool round_function_supported(RoundFunction round_function) noexcept
+    {
+        if (round_function == RoundFunction::aes128) {
+            return THORP_X86 && detail::cpu_features().aes;
+        };
+        return true;
+    }
+
+    void require_round_function_supported(RoundFunction round_function)
+    {
+        if (!round_function_supported(round_function)) {
+            throw std::invalid_argument("the round function is not supported by this cpu (aes128 needs AES-NI)");
+        };
+    }
+
+    RoundFunction fastest_round_function() noexcept
+    {
+        // aes-ni needs a few cycles per round, siphash a few dozen and blake2b some hundreds.
+        return round_function_supported(RoundFunction::aes128) ? RoundFunction::aes128 : RoundFunction::siphash24;
+    }
+}
+
+namespace {
+    // prepared_round_key_size(round_function) > 0
+    void prepare_round_key(thorp::RoundFunction round_function, const byte_t* key, std::size_t outlen, byte_t* prepared_key) noexcept
+    {
+        if (round_function == thorp::RoundFunction::aes128) {
+            assert(thorp::round_function_supported(round_function));
+            thorp::detail::aes128_expand_key(key, prepared_key);
+        }
+        else {
+            thorp::detail::blake2b_key_state(prepared_key, outlen, key, thorp::detail::round_key_size);
+        };
+    }
+}
+
+namespace thorp::detail {
+    static_assert(master_key_size == crypto_kdf_KEYBYTES, "unexpected kdf key length");
+    static_assert(round_key_size >= crypto_kdf_BYTES_MIN, "round keys too short for the kdf");
+
+    std::vector<byte_t> prepare_round_keys(RoundFunction round_function, const byte_t* round_keys, std::size_t nround_keys,
+        std::size_t outlen)
+    {
+        const std::size_t prepared_size = prepared_round_key_size(round_function);
+        std::vector<byte_t> prepared(prepared_size * nround_keys);
+        for (std::size_t ikey = 0; ikey < nround_keys && prepared_size > 0; ++ikey) {
+            prepare_round_key(round_function, round_keys + ikey * round_key_size, outlen, prepared.data() + ikey * prepared_size);
+        };
+        return prepared;
+    }
+
+    void derive_round_key(byte_t* round_key, const byte_t* master_key, uint64_t iround) noexcept
+    {
+        static constexpr char context[crypto_kdf_CONTEXTBYTES] = { 'T', 'h', 'o', 'r', 'p', 'K', 'e', 'y' };
+        crypto_kdf_derive_from_key(round_key, round_key_size, iround, context, master_key);
+    }
+
+    const byte_t* RoundKeySource::round_key(uint64_t iround, byte_t* scratch) const noexcept
+    {
+        if (this->keys != nullptr) {
+            return this->keys + iround * this->stride;
+        };
+        if (prepared_round_key_size(this->round_function) == 0) {
+            derive_round_key(scratch, this->master_key, iround);
+            return scratch;
+        };
+        std::array<byte_t, round_key_size> key{};
+        derive_round_key(key.data(), this->master_key, iround);
+        prepare_round_key(this->round_function, key.data(), this->outlen, scratch);
+        sodium_memzero(key.data(), key.size());
+        return scratch;
+    }
+
+    void round_hash(RoundFunction round_function, byte_t* out, std::size_t outlen, uint64_t message, const byte_t* key) noexcept
+    {
+        switch (round_function) {
+        case RoundFunction::aes128:
+            aes128_hash(out, outlen, message, key);
+            break;
+        case RoundFunction::siphash24:
+            siphash_hash(out, outlen, message, key);
+            break;
+        default:
+            blake2b_hash_from_state(out, outlen, message, key);
+        };
+    }
+
+    void round_hash_wide(RoundFunction round_function, byte_t* out, std::size_t outlen, uint64_t message_lo, uint64_t message_hi,
+        const byte_t* key) noexcept
+    {
+        std::array<byte_t, 2 * sizeof(uint64_t)> in_message{};
+        for (std::size_t ibyte = 0; ibyte < sizeof(uint64_t); ++ibyte) {
+            in_message[ibyte] = static_cast<byte_t>(message_lo >> 8 * ibyte);
+            in_message[sizeof(uint64_t) + ibyte] = static_cast<byte_t>(message_hi >> 8 * ibyte);
+        };
+        switch (round_function) {
+        case RoundFunction::aes128: {
+            std::array<byte_t, 16> block{};
+            aes128_encrypt_block(block.data(), in_message.data(), key);
+            std::copy_n(block.begin(), outlen, out);
+            break;
+        }
+        case RoundFunction::siphash24: {
+            std::array<byte_t, crypto_shorthash_BYTES> out_message{};
+            crypto_shorthash(out_message.data(), in_message.data(), in_message.size(), key);
+            std::copy_n(out_message.begin(), outlen, out);
+            break;
+        }
+        default:
+            blake2b_hash_from_state_wide(out, outlen, message_lo, message_hi, key);
+        };
+    }
+
+    const Blake2bLaneKernel& round_lane_kernel(RoundFunction round_function) noexcept
+    {
+        switch (round_function) {
+        case RoundFunction::aes128:
+            return aes_kernel;
+        case RoundFunction::siphash24:
+            return siphash_kernel;
+        default:
+            return blake2b_state_lane_kernel();
+        };
+    }
+}
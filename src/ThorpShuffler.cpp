@@ -1,18 +1,28 @@
 #include "ThorpShuffler.hpp"
+#include "ThorpBlake2b.hpp"
+#include <algorithm>
 
 namespace thorp {
 
-    ThorpObfuscator::ThorpObfuscator(std::vector<byte_t> passkeys_data, uint64_t max_message, uint64_t npasses)
+    ThorpObfuscator::ThorpObfuscator(std::vector<byte_t> passkeys_data, uint64_t max_message, uint64_t npasses,
+        RoundFunction round_function)
         :passkeys_data_{ std::move(passkeys_data) }
         , npasses_{ npasses }
-        , max_message_{ max_message }{
+        , max_message_{ max_message }
+        , round_function_{ round_function }{
         const uint64_t nrounds = nrounds_per_pass(max_message) * this->npasses_;
         const uint64_t nroundkeys_bytes_sum = nrounds * crypto_generichash_KEYBYTES_MIN;
         assert(this->passkeys_data_.size() >= nroundkeys_bytes_sum);
         assert(this->max_message_ % 2 == 1);// Thorpe can only handle even message_spaces
+        require_round_function_supported(this->round_function_);
+        this->prepared_round_keys_ = detail::prepare_round_keys(this->round_function_, this->passkeys_data_.data(), nrounds,
+            hash_size(this->round_function_));
+        if (!this->prepared_round_keys_.empty()) {
+            std::vector<byte_t>{}.swap(this->passkeys_data_); // only the prepared keys are used from now on.
+        };
     }
 
-    ThorpObfuscator ThorpObfuscator::from_uint64(uint64_t key_number, uint64_t max_message)
+    ThorpObfuscator ThorpObfuscator::from_uint64(uint64_t key_number, uint64_t max_message, RoundFunction round_function)
     {
         constexpr uint64_t key_length = randombytes_SEEDBYTES;
         const uint64_t npasses = 8;
@@ -27,19 +37,28 @@ namespace thorp {
         std::vector<byte_t> round_keys_data(round_keys_data_size(npasses, max_message), 0);
         assert(key.size() >= randombytes_SEEDBYTES); // randombytes_buf_deterministic takes a unsigned char[randombytes_SEEDBYTES]
         randombytes_buf_deterministic(round_keys_data.data(), round_keys_data.size(), key.data());
-        return ThorpObfuscator{ round_keys_data, max_message,npasses };
+        return ThorpObfuscator{ round_keys_data, max_message,npasses, round_function };
+    }
+
+    const byte_t* ThorpObfuscator::round_keys() const noexcept
+    {
+        return this->prepared_round_keys_.empty() ? this->passkeys_data_.data() : this->prepared_round_keys_.data();
     }
 
+    std::size_t ThorpObfuscator::round_key_stride() const noexcept
+    {
+        return this->prepared_round_keys_.empty()
+            ? crypto_generichash_KEYBYTES_MIN
+            : detail::prepared_round_key_size(this->round_function_);
+    }
 
-    bool ThorpObfuscator::generate_random_bit(uint64_t remainder, const byte_t* pass_key, unsigned long long passkey_length) noexcept
+    bool ThorpObfuscator::generate_random_bit(uint64_t remainder, const byte_t* pass_key) const noexcept
     {
-        std::array<byte_t, sizeof(uint64_t) > in_message = generate_message(remainder);
+        const std::size_t out_size = hash_size(this->round_function_);
         std::array<byte_t, crypto_generichash_BYTES_MIN> out_message{};
-        crypto_generichash(out_message.data(), out_message.size(),
-            in_message.data(), in_message.size(),
-            pass_key, passkey_length);
+        detail::round_hash(this->round_function_, out_message.data(), out_size, remainder, pass_key);
         byte_t reduced_output = std::accumulate(
-            out_message.begin(), out_message.end(),
+            out_message.begin(), out_message.begin() + out_size,
             static_cast<byte_t>(0),
             [](byte_t left, byte_t right) ->byte_t {return left ^ right; });
         reduced_output = reduced_output ^ (reduced_output >> 4);
@@ -49,33 +68,23 @@ namespace thorp {
         return static_cast<bool>(reduced_output & 1);
     }
 
-    uint64_t ThorpObfuscator::encrypt(uint64_t plaintext) const
+    uint64_t ThorpObfuscator::encrypt(uint64_t plaintext) const noexcept
     {
-        auto passkey_ptr_fn = [this](
-            uint64_t iround) {
-                uint64_t offset = iround * crypto_generichash_KEYBYTES_MIN;
-                return this->passkeys_data_.data() + offset; };
-
         uint64_t message = plaintext;
         const uint64_t half_max = this->max_message_ / 2 + 1;
         const uint64_t nrounds = nrounds_per_pass(this->max_message_) * this->npasses_;
         for (uint64_t iround = 0; iround < nrounds; ++iround) {
             uint64_t leading_bit = message / half_max;
             uint64_t remainder = message % half_max;
-            const byte_t* const key_ptr = passkey_ptr_fn(iround);
-            bool random_bit = generate_random_bit(remainder, key_ptr, crypto_generichash_KEYBYTES_MIN);
+            const byte_t* const key_ptr = this->round_keys() + iround * this->round_key_stride();
+            bool random_bit = this->generate_random_bit(remainder, key_ptr);
             message = remainder * 2 + leading_bit ^ (random_bit ? 1ull : 0ull);
         };
         return message;
     }
 
-    uint64_t ThorpObfuscator::decrypt(uint64_t cyphertext) const
+    uint64_t ThorpObfuscator::decrypt(uint64_t cyphertext) const noexcept
     {
-
-        auto passkey_ptr_fn = [this](
-            uint64_t iround) {
-                uint64_t offset = (iround ) * crypto_generichash_KEYBYTES_MIN;
-                return this->passkeys_data_.data() + offset; };
         uint64_t message = cyphertext;
         const uint64_t half_max = this->max_message_ / 2 + 1;
 
@@ -83,53 +92,121 @@ namespace thorp {
         for (uint64_t iround = 0; iround < nrounds; ++iround) {
                 uint64_t leading_bit = message % 2;
                 uint64_t remainder = message / 2;
-                const byte_t* const key_ptr = passkey_ptr_fn(nrounds-iround-1);
-                bool random_bit = generate_random_bit(remainder, key_ptr, crypto_generichash_KEYBYTES_MIN);
+                const byte_t* const key_ptr = this->round_keys() + (nrounds - iround - 1) * this->round_key_stride();
+                bool random_bit = this->generate_random_bit(remainder, key_ptr);
                 message = remainder + (leading_bit ^ (random_bit ? 1ull : 0ull)) * half_max;
         };
         return message;
     }
+
+    void ThorpObfuscator::encrypt_batch(const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const
+    {
+        const detail::Blake2bLaneKernel& kernel = detail::round_lane_kernel(this->round_function_);
+        const std::size_t lanes = kernel.lanes;
+        const std::size_t out_size = hash_size(this->round_function_);
+        const uint64_t half_max = this->max_message_ / 2 + 1;
+        const uint64_t nrounds = nrounds_per_pass(this->max_message_) * this->npasses_;
+        std::array<uint64_t, detail::blake2b_lanes_max> messages{};
+        std::array<uint64_t, detail::blake2b_lanes_max> remainders{};
+        std::array<uint64_t, 2 * detail::blake2b_lanes_max> hash_words{};
+        std::array<const byte_t*, detail::blake2b_lanes_max> keys{};
+        for (std::size_t ifirst = 0; ifirst < count; ifirst += lanes) {
+            const std::size_t nlanes = std::min(lanes, count - ifirst);
+            std::copy_n(plaintexts + ifirst, nlanes, messages.begin());
+            for (uint64_t iround = 0; iround < nrounds; ++iround) {
+                keys.fill(this->round_keys() + iround * this->round_key_stride());
+                for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                    remainders[ilane] = messages[ilane] % half_max;
+                };
+                kernel.keyed_hash(hash_words.data(), out_size,
+                    remainders.data(), keys.data(), crypto_generichash_KEYBYTES_MIN);
+                for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                    const uint64_t leading_bit = messages[ilane] / half_max;
+                    const uint64_t random_bit = detail::parity(hash_words[ilane] ^ (out_size > 8 ? hash_words[lanes + ilane] : 0));
+                    messages[ilane] = remainders[ilane] * 2 + (leading_bit ^ random_bit);
+                };
+            };
+            std::copy_n(messages.begin(), nlanes, cyphertexts + ifirst);
+        };
+    }
+
+    void ThorpObfuscator::decrypt_batch(const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const
+    {
+        const detail::Blake2bLaneKernel& kernel = detail::round_lane_kernel(this->round_function_);
+        const std::size_t lanes = kernel.lanes;
+        const std::size_t out_size = hash_size(this->round_function_);
+        const uint64_t half_max = this->max_message_ / 2 + 1;
+        const uint64_t nrounds = nrounds_per_pass(this->max_message_) * this->npasses_;
+        std::array<uint64_t, detail::blake2b_lanes_max> messages{};
+        std::array<uint64_t, detail::blake2b_lanes_max> remainders{};
+        std::array<uint64_t, 2 * detail::blake2b_lanes_max> hash_words{};
+        std::array<const byte_t*, detail::blake2b_lanes_max> keys{};
+        for (std::size_t ifirst = 0; ifirst < count; ifirst += lanes) {
+            const std::size_t nlanes = std::min(lanes, count - ifirst);
+            std::copy_n(cyphertexts + ifirst, nlanes, messages.begin());
+            for (uint64_t iround = 0; iround < nrounds; ++iround) {
+                keys.fill(this->round_keys() + (nrounds - iround - 1) * this->round_key_stride());
+                for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                    remainders[ilane] = messages[ilane] / 2;
+                };
+                kernel.keyed_hash(hash_words.data(), out_size,
+                    remainders.data(), keys.data(), crypto_generichash_KEYBYTES_MIN);
+                for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                    const uint64_t leading_bit = messages[ilane] % 2;
+                    const uint64_t random_bit = detail::parity(hash_words[ilane] ^ (out_size > 8 ? hash_words[lanes + ilane] : 0));
+                    messages[ilane] = remainders[ilane] + (leading_bit ^ random_bit) * half_max;
+                };
+            };
+            std::copy_n(messages.begin(), nlanes, plaintexts + ifirst);
+        };
+    }
 } //thorp
 namespace {
     class OptimizedBitGenerator {
     private:
         using byte_t = thorp::byte_t;
-    public:
-        static constexpr  uint64_t hash_size = crypto_generichash_BYTES_MAX;
-        static constexpr uint64_t pass_key_size = crypto_generichash_KEYBYTES_MIN;
-
     public:
         OptimizedBitGenerator(
-            const std::vector<byte_t>* pass_key_data,
+            const thorp::detail::RoundKeySource& round_keys,
             uint64_t max_message,
-            uint64_t optimization_level
-        );
-        thorp::byte_t generate_bit(uint64_t message, uint64_t iround);
+            uint64_t optimization_level,
+            thorp::CipherContext& context,
+            thorp::detail::OperationCounts& counts
+        )noexcept;
+        thorp::byte_t generate_bit(uint64_t message, uint64_t iround) noexcept;
         std::pair<uint64_t, uint64_t> opt_pass_parameters(uint64_t iround) const noexcept;
     private:
-        byte_t generate_bit_core( uint64_t iopt_round, uint64_t iopt_pass, uint64_t selector);
-        void update_hash(uint64_t remainder, uint64_t ipass);
-        static constexpr std::array < byte_t, sizeof(uint64_t)> generate_message(uint64_t remainder);
+        byte_t generate_bit_core( uint64_t iopt_round, uint64_t iopt_pass, uint64_t selector) const noexcept;
+        void update_hash(uint64_t remainder, uint64_t ipass) noexcept;
     private:
-        const std::vector<byte_t>* pass_key_data_;
+        const thorp::detail::RoundKeySource* round_keys_;
         uint64_t max_message_;
         uint64_t optimization_level_;
-        std::vector<byte_t> cached_hash_{};
-        uint64_t cached_opt_round_{}; 
+        std::size_t hash_size_;
+        // the cached hash and its opt round.
+        thorp::CipherContext* context_;
+        thorp::detail::OperationCounts* counts_;
     };
 
 
     OptimizedBitGenerator::OptimizedBitGenerator(
-        const std::vector<byte_t>* pass_key_data,
+        const thorp::detail::RoundKeySource& round_keys,
         uint64_t max_message,
-        uint64_t optimization_level)
-        :pass_key_data_{ pass_key_data }
+        uint64_t optimization_level,
+        thorp::CipherContext& context,
+        thorp::detail::OperationCounts& counts)noexcept
+        :round_keys_{ &round_keys }
         , max_message_{ max_message }
         , optimization_level_{ optimization_level }
+        , hash_size_{ round_keys.outlen }
+        , context_{ &context }
+        , counts_{ &counts }
     {
+        assert(this->hash_size_ <= this->context_->hash.size());
+        this->context_->has_hash = false;
     };
 
-    auto OptimizedBitGenerator::generate_bit(uint64_t message, uint64_t iround)->byte_t
+    auto OptimizedBitGenerator::generate_bit(uint64_t message, uint64_t iround) noexcept ->byte_t
     {
         // equiv x   --> equivalent to x in Fig.6 ;
         auto [iopt_pass, iopt_round] = this->opt_pass_parameters(iround); // equiv j,i
@@ -139,8 +216,11 @@ namespace {
 
         const uint64_t lo = message % (1ull << iopt_pass);                        // equiv lo
         const uint64_t selector = (hi << iopt_pass) + lo;                      // equic b
-        if (this->cached_hash_.size() != hash_size || this->cached_opt_round_ != iopt_round) {
+        if (!this->context_->has_hash || this->context_->opt_round != iopt_round) {
             this->update_hash(remainder, iopt_round);
+        }
+        else {
+            this->counts_->add_cache_hits(1);
         };
         return this->generate_bit_core(iopt_pass,  iopt_round, selector);
     }
@@ -152,41 +232,104 @@ namespace {
         return std::pair<uint64_t, uint64_t>(iopt_pass, iopt_round);
     }
 
-    thorp::byte_t OptimizedBitGenerator::generate_bit_core(uint64_t iopt_pass,uint64_t iopt_round, uint64_t selector)
+    thorp::byte_t OptimizedBitGenerator::generate_bit_core(uint64_t iopt_pass,uint64_t iopt_round, uint64_t selector) const noexcept
     {
-        assert(this->cached_opt_round_ == iopt_round);
+        assert(this->context_->opt_round == iopt_round);
         assert(selector < (1ull << (this->optimization_level_ - 1)));
         const uint64_t ibit = iopt_pass * (1ull << (this->optimization_level_ - 1)) + selector;
-        const byte_t selected_byte = this->cached_hash_[ibit / 8];
+        const byte_t selected_byte = this->context_->hash[ibit / 8];
         return (selected_byte>> (ibit%8)) & 1;
     }
 
-    void OptimizedBitGenerator::update_hash(uint64_t remainder, uint64_t iround)
+    void OptimizedBitGenerator::update_hash(uint64_t remainder, uint64_t iround) noexcept
     {
-        std::array<byte_t, sizeof(uint64_t) > in_message = generate_message(remainder);
-        this->cached_hash_.resize(hash_size, 0);
-        const byte_t* pass_key_ptr= this->pass_key_data_->data() + pass_key_size * iround;
+        const byte_t* pass_key_ptr = this->round_keys_->round_key(iround, this->context_->round_key.data());
 
-        crypto_generichash(this->cached_hash_.data(), this->cached_hash_.size(),
-            in_message.data(), in_message.size(),
-            pass_key_ptr, pass_key_size);
-        this->cached_opt_round_ = iround;
+        thorp::detail::round_hash(this->round_keys_->round_function, this->context_->hash.data(), this->hash_size_,
+            remainder, pass_key_ptr);
+        this->context_->opt_round = iround;
+        this->context_->has_hash = true;
+        this->counts_->add_hashes(1, *this->round_keys_);
     }
 
-    /**
-    * reformats  a uint64_t to an array of bytes suitable to pass it to the hash function.
-    */
-    constexpr  auto OptimizedBitGenerator::generate_message(uint64_t remainder)->std::array<byte_t,sizeof(uint64_t)>
+    // the multi lane twin of OptimizedBitGenerator: all lanes share the round
+    // and therefore hash at the same time with the same pass key.
+    class OptimizedLaneBitGenerator {
+    private:
+        using byte_t = thorp::byte_t;
+    public:
+        static constexpr uint64_t hash_size_max = crypto_generichash_BYTES_MAX;
+        static constexpr uint64_t pass_key_size = crypto_generichash_KEYBYTES_MIN;
+    public:
+        OptimizedLaneBitGenerator(
+            const thorp::detail::RoundKeySource& round_keys,
+            uint64_t max_message,
+            uint64_t optimization_level,
+            const thorp::detail::Blake2bLaneKernel& kernel,
+            thorp::detail::OperationCounts& counts
+        );
+        // bits[ilane] is the bit for messages[ilane]; for kernel.lanes lanes.
+        void generate_bits(const uint64_t* messages, uint64_t iround, byte_t* bits);
+    private:
+        const thorp::detail::RoundKeySource* round_keys_;
+        uint64_t max_message_;
+        uint64_t optimization_level_;
+        std::size_t hash_size_;
+        const thorp::detail::Blake2bLaneKernel* kernel_;
+        std::array<byte_t, thorp::detail::prepared_round_key_size_max> round_key_scratch_;
+        std::array<uint64_t, hash_size_max / sizeof(uint64_t) * thorp::detail::blake2b_lanes_max> cached_hash_words_{};
+        bool has_cached_hash_{ false };
+        uint64_t cached_opt_round_{};
+        thorp::detail::OperationCounts* counts_;
+    };
+
+    OptimizedLaneBitGenerator::OptimizedLaneBitGenerator(
+        const thorp::detail::RoundKeySource& round_keys,
+        uint64_t max_message,
+        uint64_t optimization_level,
+        const thorp::detail::Blake2bLaneKernel& kernel,
+        thorp::detail::OperationCounts& counts)
+        :round_keys_{ &round_keys }
+        , max_message_{ max_message }
+        , optimization_level_{ optimization_level }
+        , hash_size_{ round_keys.outlen }
+        , kernel_{ &kernel }
+        , counts_{ &counts }
     {
+        assert(kernel.lanes <= thorp::detail::blake2b_lanes_max);
+    };
 
-        std::array<byte_t, sizeof(uint64_t)>message_out{};
-        static_assert(sizeof(uint64_t) == 8, "need 8 byte integers");
-        static_assert(CHAR_BIT == 8, "need 8 bit characters");
-        constexpr uint64_t mask = std::numeric_limits<byte_t>::max();
-        for (int ibyte = 0; ibyte < 8; ++ibyte) {
-            message_out[ibyte] = static_cast<byte_t>((remainder >> 8 * ibyte) & mask);
+    void OptimizedLaneBitGenerator::generate_bits(const uint64_t* messages, uint64_t iround, byte_t* bits)
+    {
+        const std::size_t lanes = this->kernel_->lanes;
+        const uint64_t iopt_pass = iround % this->optimization_level_;
+        const uint64_t iopt_round = iround / this->optimization_level_;
+        const uint64_t projector = (this->max_message_ / 2 + 1) >> (this->optimization_level_ - 1);
+        if (!this->has_cached_hash_ || this->cached_opt_round_ != iopt_round) {
+            std::array<uint64_t, thorp::detail::blake2b_lanes_max> remainders{};
+            std::array<const byte_t*, thorp::detail::blake2b_lanes_max> keys{};
+            for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                remainders[ilane] = (messages[ilane] >> iopt_pass) % projector;
+            };
+            keys.fill(this->round_keys_->round_key(iopt_round, this->round_key_scratch_.data()));
+            this->kernel_->keyed_hash(this->cached_hash_words_.data(), this->hash_size_,
+                remainders.data(), keys.data(), pass_key_size);
+            this->has_cached_hash_ = true;
+            this->cached_opt_round_ = iopt_round;
+            this->counts_->add_hashes(lanes, *this->round_keys_);
+        }
+        else {
+            this->counts_->add_cache_hits(lanes);
+        };
+        for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+            const uint64_t hi = (messages[ilane] >> iopt_pass) / projector;
+            const uint64_t lo = messages[ilane] % (1ull << iopt_pass);
+            const uint64_t selector = (hi << iopt_pass) + lo;
+            assert(selector < (1ull << (this->optimization_level_ - 1)));
+            const uint64_t ibit = iopt_pass * (1ull << (this->optimization_level_ - 1)) + selector;
+            const uint64_t word = this->cached_hash_words_[(ibit / 64) * lanes + ilane];
+            bits[ilane] = static_cast<byte_t>((word >> (ibit % 64)) & 1);
         };
-        return message_out;
     }
 
 }
@@ -194,72 +337,276 @@ namespace thorp {
 
     OptThorpObfuscator::OptThorpObfuscator(std::vector<byte_t> round_keys_data,
         uint64_t max_message, 
-        uint64_t npasses, uint64_t optimization_level)
+        uint64_t npasses, uint64_t optimization_level, RoundFunction round_function)
         :round_keys_data_{ std::move(round_keys_data) }
         , npasses_{ npasses }
         , max_message_{ max_message }
-        , optimization_level_{optimization_level}{
+        , optimization_level_{optimization_level}
+        , round_function_{ round_function }{
         assert(this->optimization_level_ > 0);
-        assert(this->optimization_level_ <= this->optimization_level_max);
+        assert(this->optimization_level_ <= this->optimization_level_max_for(this->round_function_));
         const uint64_t nrounds = nrounds_per_pass(max_message) * this->npasses_;
-        const uint64_t nroundkeys_bytes_sum = nrounds * crypto_generichash_KEYBYTES_MIN;
+        const uint64_t nopt_rounds = nrounds / this->optimization_level_ + (nrounds % this->optimization_level_ > 0 ? 1 : 0);
+        const uint64_t nroundkeys_bytes_sum = nopt_rounds * crypto_generichash_KEYBYTES_MIN;
         assert(this->round_keys_data_.size() >= nroundkeys_bytes_sum);
         assert(this->max_message_ % 2 == 1);// Thorpe can only handle even message_spaces
+        require_round_function_supported(this->round_function_);
+        this->prepared_round_keys_ = detail::prepare_round_keys(this->round_function_, this->round_keys_data_.data(), nopt_rounds,
+            round_function_output_bits(this->round_function_) / CHAR_BIT);
+        if (!this->prepared_round_keys_.empty()) {
+            std::vector<byte_t>{}.swap(this->round_keys_data_); // only the prepared keys are used from now on.
+        }
+        else {
+            this->round_keys_data_.resize(nroundkeys_bytes_sum);
+            this->round_keys_data_.shrink_to_fit();
+        };
     }
 
-    OptThorpObfuscator OptThorpObfuscator::from_uint64(uint64_t key_number, const uint64_t max_message){        
-    const uint64_t  optimization_level = optimization_level_max;
-    constexpr uint64_t key_length = randombytes_SEEDBYTES;
-    const uint64_t npasses = 8;
-    std::array<byte_t, key_length>key{};
-    for (auto& elem : key) elem = 0;
-    static_assert(key_length >= 8, "too short key length");
-    static_assert(CHAR_BIT == 8, "need 8 bit characters");
-    constexpr uint64_t mask = std::numeric_limits<byte_t>::max();
-    for (int ibyte = 0; ibyte < 8; ++ibyte) {
-        key[ibyte] = static_cast<byte_t>((key_number >> 8 * ibyte) & mask);
-    };
+    OptThorpObfuscator::OptThorpObfuscator(const std::array<byte_t, detail::master_key_size>& master_key, uint64_t max_message,
+        uint64_t npasses, uint64_t optimization_level, RoundFunction round_function)
+        :npasses_{ npasses }
+        , max_message_{ max_message }
+        , optimization_level_{ optimization_level }
+        , round_function_{ round_function }
+        , key_schedule_{ KeySchedule::derived }
+        , master_key_{ master_key }{
+        assert(this->optimization_level_ > 0);
+        assert(this->optimization_level_ <= this->optimization_level_max_for(this->round_function_));
+        assert(this->max_message_ % 2 == 1);// Thorpe can only handle even message_spaces
+        require_round_function_supported(this->round_function_);
+    }
+
+    OptThorpObfuscator OptThorpObfuscator::from_master_key(const std::array<byte_t, detail::master_key_size>& master_key,
+        uint64_t max_message, uint64_t npasses, uint64_t optimization_level, RoundFunction round_function, KeySchedule key_schedule)
+    {
+        if (key_schedule == KeySchedule::derived) {
+            return OptThorpObfuscator{ master_key, max_message, npasses, optimization_level, round_function };
+        };
+        std::vector<byte_t> round_keys_data(round_keys_data_size(npasses, max_message, optimization_level), 0);
+        for (std::size_t ikey = 0; ikey < round_keys_data.size() / detail::round_key_size; ++ikey) {
+            detail::derive_round_key(round_keys_data.data() + ikey * detail::round_key_size, master_key.data(), ikey);
+        };
+        return OptThorpObfuscator{ std::move(round_keys_data), max_message, npasses, optimization_level, round_function };
+    }
 
+    std::array<byte_t, crypto_generichash_BYTES> OptThorpObfuscator::key_fingerprint() const
+    {
+        const uint64_t nrounds = nrounds_per_pass(this->max_message_) * this->npasses_;
+        const uint64_t nopt_rounds = nrounds / this->optimization_level_ + (nrounds % this->optimization_level_ > 0 ? 1 : 0);
+        const detail::RoundKeySource round_keys = this->round_key_source();
+        const std::size_t key_size = detail::prepared_round_key_size(this->round_function_) > 0
+            ? detail::prepared_round_key_size(this->round_function_) : detail::round_key_size;
+        std::vector<byte_t> key_material;
+        key_material.reserve(nopt_rounds * key_size + 1);
+        key_material.push_back(static_cast<byte_t>(this->round_function_));
+        std::array<byte_t, detail::prepared_round_key_size_max> scratch{};
+        for (uint64_t iopt_round = 0; iopt_round < nopt_rounds; ++iopt_round) {
+            const byte_t* const key = round_keys.round_key(iopt_round, scratch.data());
+            key_material.insert(key_material.end(), key, key + key_size);
+        };
+        std::array<byte_t, crypto_generichash_BYTES> fingerprint{};
+        crypto_generichash(fingerprint.data(), fingerprint.size(), key_material.data(), key_material.size(), nullptr, 0);
+        sodium_memzero(key_material.data(), key_material.size());
+        sodium_memzero(scratch.data(), scratch.size());
+        return fingerprint;
+    }
 
-    std::vector<byte_t> round_keys_data(round_keys_data_size(npasses, max_message,optimization_level), 0);
-    assert(key.size() >= randombytes_SEEDBYTES); // randombytes_buf_deterministic takes a unsigned char[randombytes_SEEDBYTES]
-    randombytes_buf_deterministic(round_keys_data.data(), round_keys_data.size(), key.data());
-    return OptThorpObfuscator{ round_keys_data, max_message,npasses , optimization_level};
+    InstrumentationSnapshot OptThorpObfuscator::instrumentation() const noexcept
+    {
+        InstrumentationSnapshot snapshot{};
+        snapshot.max_message = this->max_message_;
+        snapshot.npasses = this->npasses_;
+        snapshot.optimization_level = this->optimization_level_;
+        snapshot.round_function = this->round_function_;
+        this->instrumentation_.fill(snapshot);
+        return snapshot;
+    }
+
+    void OptThorpObfuscator::reset_instrumentation() const noexcept
+    {
+        this->instrumentation_.reset();
+    }
+
+    void OptThorpObfuscator::set_cycle_sampling(uint64_t every) const noexcept
+    {
+        this->instrumentation_.set_sample_every(every);
+    }
+
+    detail::RoundKeySource OptThorpObfuscator::round_key_source() const noexcept
+    {
+        const bool derived = this->key_schedule_ == KeySchedule::derived;
+        return detail::RoundKeySource{
+            this->round_function_,
+            round_function_output_bits(this->round_function_) / CHAR_BIT,
+            derived ? nullptr : this->round_keys(),
+            this->round_key_stride(),
+            this->master_key_.data() };
+    }
+
+    const byte_t* OptThorpObfuscator::round_keys() const noexcept
+    {
+        return this->prepared_round_keys_.empty() ? this->round_keys_data_.data() : this->prepared_round_keys_.data();
+    }
+
+    std::size_t OptThorpObfuscator::round_key_stride() const noexcept
+    {
+        return this->prepared_round_keys_.empty()
+            ? crypto_generichash_KEYBYTES_MIN
+            : detail::prepared_round_key_size(this->round_function_);
+    }
+
+    OptThorpObfuscator OptThorpObfuscator::from_uint64(uint64_t key_number, const uint64_t max_message, RoundFunction round_function){        
+    const uint64_t  optimization_level = optimization_level_max_for(round_function);
+    const uint64_t npasses = 8;
+    return from_uint64(key_number, max_message, npasses, optimization_level, round_function);
     }
     ;
 
-    uint64_t OptThorpObfuscator::encrypt(uint64_t plaintext) const
+    OptThorpObfuscator OptThorpObfuscator::from_uint64(uint64_t key_number, uint64_t max_message, uint64_t npasses,
+        uint64_t optimization_level, RoundFunction round_function)
+    {
+        constexpr uint64_t key_length = randombytes_SEEDBYTES;
+        std::array<byte_t, key_length>key{};
+        static_assert(key_length >= 8, "too short key length");
+        static_assert(CHAR_BIT == 8, "need 8 bit characters");
+        constexpr uint64_t mask = std::numeric_limits<byte_t>::max();
+        for (int ibyte = 0; ibyte < 8; ++ibyte) {
+            key[ibyte] = static_cast<byte_t>((key_number >> 8 * ibyte) & mask);
+        };
+        std::vector<byte_t> round_keys_data(round_keys_data_size(npasses, max_message, optimization_level), 0);
+        assert(key.size() >= randombytes_SEEDBYTES); // randombytes_buf_deterministic takes a unsigned char[randombytes_SEEDBYTES]
+        randombytes_buf_deterministic(round_keys_data.data(), round_keys_data.size(), key.data());
+        return OptThorpObfuscator{ std::move(round_keys_data), max_message, npasses, optimization_level, round_function };
+    }
+
+    uint64_t OptThorpObfuscator::encrypt(uint64_t plaintext) const noexcept
+    {
+        CipherContext context;
+        return this->encrypt(plaintext, context);
+    }
+
+    uint64_t OptThorpObfuscator::decrypt(uint64_t cyphertext) const noexcept
+    {
+        CipherContext context;
+        return this->decrypt(cyphertext, context);
+    }
+
+    uint64_t OptThorpObfuscator::encrypt(uint64_t plaintext, CipherContext& context) const noexcept
     {
         uint64_t message = plaintext;
         const uint64_t half_max = this->max_message_ / 2 + 1;
         const uint64_t nrounds = nrounds_per_pass(this->max_message_) * this->npasses_;
-        OptimizedBitGenerator bit_generator(&this->round_keys_data_, this->max_message_, this->optimization_level_);
+        const detail::RoundKeySource round_keys = this->round_key_source();
+        detail::OperationCounts counts;
+        const bool sampled = this->instrumentation_.sample();
+        OptimizedBitGenerator bit_generator(round_keys, this->max_message_, this->optimization_level_, context, counts);
         for (uint64_t iround = 0; iround < nrounds; ++iround) {
+            const uint64_t start = sampled ? detail::cycle_counter() : 0;
             uint64_t leading_bit = message / half_max;
             uint64_t remainder = message % half_max;
             byte_t random_bit = bit_generator.generate_bit(message%half_max, iround);
             assert(random_bit == 1 || random_bit == 0);
             message = remainder * 2 + random_bit^leading_bit;
+            if (sampled) {
+                counts.add_sampled_round(detail::cycle_counter() - start);
+            };
         };
+        counts.add_operations(1);
+        counts.add_rounds(nrounds);
+        this->instrumentation_.record(counts);
         return message;
     }
 
-    uint64_t OptThorpObfuscator::decrypt(uint64_t cyphertext) const
+    uint64_t OptThorpObfuscator::decrypt(uint64_t cyphertext, CipherContext& context) const noexcept
     {
 
         uint64_t message = cyphertext;
         const uint64_t half_max = this->max_message_ / 2 + 1;
         const uint64_t nrounds = nrounds_per_pass(this->max_message_) * this->npasses_;
-        OptimizedBitGenerator bit_generator(&this->round_keys_data_, this->max_message_, this->optimization_level_);
+        const detail::RoundKeySource round_keys = this->round_key_source();
+        detail::OperationCounts counts;
+        const bool sampled = this->instrumentation_.sample();
+        OptimizedBitGenerator bit_generator(round_keys, this->max_message_, this->optimization_level_, context, counts);
         for (uint64_t iround = 0; iround < nrounds; ++iround) {
+            const uint64_t start = sampled ? detail::cycle_counter() : 0;
             uint64_t trailing_bit = message % 2;
             uint64_t remainder = message /2;
             byte_t random_bit = bit_generator.generate_bit(message>>1, (nrounds - 1 - iround));
             assert(random_bit == 1 || random_bit == 0);
             message = remainder + half_max*(random_bit^trailing_bit);
+            if (sampled) {
+                counts.add_sampled_round(detail::cycle_counter() - start);
+            };
         };
+        counts.add_operations(1);
+        counts.add_rounds(nrounds);
+        this->instrumentation_.record(counts);
         return message;
     }
 
+    void OptThorpObfuscator::encrypt_batch(const uint64_t* plaintexts, uint64_t* cyphertexts, std::size_t count) const
+    {
+        const detail::Blake2bLaneKernel& kernel = detail::round_lane_kernel(this->round_function_);
+        const detail::RoundKeySource round_keys = this->round_key_source();
+        const std::size_t lanes = kernel.lanes;
+        const uint64_t half_max = this->max_message_ / 2 + 1;
+        const uint64_t nrounds = nrounds_per_pass(this->max_message_) * this->npasses_;
+        std::array<uint64_t, detail::blake2b_lanes_max> messages{};
+        std::array<uint64_t, detail::blake2b_lanes_max> remainders{};
+        std::array<byte_t, detail::blake2b_lanes_max> random_bits{};
+        detail::OperationCounts counts;
+        for (std::size_t ifirst = 0; ifirst < count; ifirst += lanes) {
+            const std::size_t nlanes = std::min(lanes, count - ifirst);
+            std::copy_n(plaintexts + ifirst, nlanes, messages.begin());
+            OptimizedLaneBitGenerator bit_generator(round_keys, this->max_message_, this->optimization_level_, kernel, counts);
+            for (uint64_t iround = 0; iround < nrounds; ++iround) {
+                for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                    remainders[ilane] = messages[ilane] % half_max;
+                };
+                bit_generator.generate_bits(remainders.data(), iround, random_bits.data());
+                for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                    const uint64_t leading_bit = messages[ilane] / half_max;
+                    messages[ilane] = remainders[ilane] * 2 + (random_bits[ilane] ^ leading_bit);
+                };
+            };
+            std::copy_n(messages.begin(), nlanes, cyphertexts + ifirst);
+        };
+        counts.add_operations(count);
+        counts.add_rounds(count * nrounds);
+        this->instrumentation_.record(counts);
+    }
+
+    void OptThorpObfuscator::decrypt_batch(const uint64_t* cyphertexts, uint64_t* plaintexts, std::size_t count) const
+    {
+        const detail::Blake2bLaneKernel& kernel = detail::round_lane_kernel(this->round_function_);
+        const detail::RoundKeySource round_keys = this->round_key_source();
+        const std::size_t lanes = kernel.lanes;
+        const uint64_t half_max = this->max_message_ / 2 + 1;
+        const uint64_t nrounds = nrounds_per_pass(this->max_message_) * this->npasses_;
+        std::array<uint64_t, detail::blake2b_lanes_max> messages{};
+        std::array<uint64_t, detail::blake2b_lanes_max> remainders{};
+        std::array<byte_t, detail::blake2b_lanes_max> random_bits{};
+        detail::OperationCounts counts;
+        for (std::size_t ifirst = 0; ifirst < count; ifirst += lanes) {
+            const std::size_t nlanes = std::min(lanes, count - ifirst);
+            std::copy_n(cyphertexts + ifirst, nlanes, messages.begin());
+            OptimizedLaneBitGenerator bit_generator(round_keys, this->max_message_, this->optimization_level_, kernel, counts);
+            for (uint64_t iround = 0; iround < nrounds; ++iround) {
+                for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                    remainders[ilane] = messages[ilane] / 2;
+                };
+                bit_generator.generate_bits(remainders.data(), nrounds - 1 - iround, random_bits.data());
+                for (std::size_t ilane = 0; ilane < lanes; ++ilane) {
+                    const uint64_t trailing_bit = messages[ilane] % 2;
+                    messages[ilane] = remainders[ilane] + half_max * (random_bits[ilane] ^ trailing_bit);
+                };
+            };
+            std::copy_n(messages.begin(), nlanes, plaintexts + ifirst);
+        };
+        counts.add_operations(count);
+        counts.add_rounds(count * nrounds);
+        this->instrumentation_.record(counts);
+    }
+
 
 };
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "ThorpShuffler.hpp"
+#include <doctest/doctest.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// counts every allocation of the test binary, the hot paths must not show up.
+#if defined(__GNUC__) && !defined(__clang__)
+// gcc does not know that the replaced operator new allocates with malloc.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+namespace {
+	std::atomic<std::size_t> allocation_count{ 0 };
+}
+
+void* operator new(std::size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+	throw std::bad_alloc{};
+}
+void* operator new[](std::size_t size)
+{
+	return ::operator new(size);
+}
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+
+TEST_CASE("allocation free encryption") {
+	sodium_init();
+	const std::vector<uint64_t> messages{ 0, 1, 4, 11, 234112341, std::numeric_limits<uint64_t>::max() };
+	for (thorp::RoundFunction round_function : { thorp::RoundFunction::blake2b, thorp::RoundFunction::aes128, thorp::RoundFunction::siphash24 }) {
+		if (!thorp::round_function_supported(round_function)) continue;
+		const auto opt_obfuscator = thorp::OptThorpObfuscator::from_uint64(4, std::numeric_limits<uint64_t>::max(), round_function);
+		const auto obfuscator = thorp::ThorpObfuscator::from_uint64(4, std::numeric_limits<uint64_t>::max(), round_function);
+		static_assert(noexcept(opt_obfuscator.encrypt(0)) && noexcept(opt_obfuscator.decrypt(0)), "the hot path has to be noexcept");
+		static_assert(noexcept(obfuscator.encrypt(0)) && noexcept(obfuscator.decrypt(0)), "the hot path has to be noexcept");
+
+		thorp::CipherContext context;
+		uint64_t checksum = 0;
+		const std::size_t allocations_before = allocation_count.load();
+		for (uint64_t message : messages) {
+			checksum ^= opt_obfuscator.decrypt(opt_obfuscator.encrypt(message)) ^ message;
+			checksum ^= opt_obfuscator.decrypt(opt_obfuscator.encrypt(message, context), context) ^ message;
+			checksum ^= obfuscator.decrypt(obfuscator.encrypt(message)) ^ message;
+		};
+		const std::size_t allocations_after = allocation_count.load();
+		CHECK(allocations_after == allocations_before);
+		CHECK(checksum == 0);
+		// the context gives the same results as the stack one.
+		for (uint64_t message : messages) {
+			CHECK(opt_obfuscator.encrypt(message, context) == opt_obfuscator.encrypt(message));
+		};
+	};
+};
@@ -0,0 +1,135 @@
+#include "ThorpShuffler.hpp"
+#include "ThorpBlake2b.hpp"
+#include <doctest/doctest.h>
+
+
+TEST_CASE("blake2b lane kernels") {
+	sodium_init();
+	std::vector<thorp::byte_t> key_data(16 * thorp::detail::blake2b_lanes_max);
+	for (std::size_t i = 0; i < key_data.size(); ++i) key_data[i] = static_cast<thorp::byte_t>(i * 7 + 3);
+	const uint64_t messages[thorp::detail::blake2b_lanes_max]{ 0,1,2,0xdeadbeef,~0ull,1ull << 63,42,12345678901234ull };
+
+	SUBCASE("scalar matches crypto_generichash") {
+		for (std::size_t outlen : {16, 64}) {
+			for (uint64_t message : messages) {
+				std::array<thorp::byte_t, sizeof(uint64_t)> in{};
+				for (int ibyte = 0; ibyte < 8; ++ibyte) in[ibyte] = static_cast<thorp::byte_t>(message >> 8 * ibyte);
+				std::array<thorp::byte_t, 64> expected{};
+				std::array<thorp::byte_t, 64> actual{};
+				crypto_generichash(expected.data(), outlen, in.data(), in.size(), key_data.data(), 16);
+				thorp::detail::blake2b_keyed_hash(actual.data(), outlen, message, key_data.data(), 16);
+				CHECK(expected == actual);
+			};
+		};
+	};
+
+	SUBCASE("hashing from the key state matches crypto_generichash") {
+		for (std::size_t outlen : {16, 64}) {
+			std::vector<thorp::byte_t> states(thorp::detail::blake2b_state_bytes * thorp::detail::blake2b_lanes_max);
+			std::array<const thorp::byte_t*, thorp::detail::blake2b_lanes_max> state_ptrs{};
+			for (std::size_t ilane = 0; ilane < thorp::detail::blake2b_lanes_max; ++ilane) {
+				thorp::detail::blake2b_key_state(states.data() + thorp::detail::blake2b_state_bytes * ilane, outlen, key_data.data() + 16 * ilane, 16);
+				state_ptrs[ilane] = states.data() + thorp::detail::blake2b_state_bytes * ilane;
+			};
+			for (std::size_t ilane = 0; ilane < thorp::detail::blake2b_lanes_max; ++ilane) {
+				std::array<thorp::byte_t, 64> expected{};
+				std::array<thorp::byte_t, 64> actual{};
+				thorp::detail::blake2b_keyed_hash(expected.data(), outlen, messages[ilane], key_data.data() + 16 * ilane, 16);
+				thorp::detail::blake2b_hash_from_state(actual.data(), outlen, messages[ilane], state_ptrs[ilane]);
+				CHECK(expected == actual);
+			};
+			const thorp::detail::Blake2bLaneKernel* kernels[8]{};
+			const std::size_t nkernels = thorp::detail::blake2b_state_lane_kernels(kernels, 8);
+			REQUIRE(nkernels >= 1);
+			for (std::size_t ikernel = 0; ikernel < nkernels; ++ikernel) {
+				const auto& kernel = *kernels[ikernel];
+				std::array<uint64_t, 8 * thorp::detail::blake2b_lanes_max> words{};
+				kernel.keyed_hash(words.data(), outlen, messages, state_ptrs.data(), 16);
+				for (std::size_t ilane = 0; ilane < kernel.lanes; ++ilane) {
+					std::array<thorp::byte_t, 64> expected{};
+					thorp::detail::blake2b_keyed_hash(expected.data(), outlen, messages[ilane], key_data.data() + 16 * ilane, 16);
+					for (std::size_t ibyte = 0; ibyte < outlen; ++ibyte) {
+						const auto byte = static_cast<thorp::byte_t>(words[(ibyte / 8) * kernel.lanes + ilane] >> 8 * (ibyte % 8));
+						CHECK(byte == expected[ibyte]);
+					};
+				};
+			};
+		};
+	};
+
+	SUBCASE("every supported kernel matches the scalar hash") {
+		const thorp::detail::Blake2bLaneKernel* kernels[8]{};
+		const std::size_t nkernels = thorp::detail::blake2b_lane_kernels(kernels, 8);
+		REQUIRE(nkernels >= 1);
+		for (std::size_t ikernel = 0; ikernel < nkernels; ++ikernel) {
+			const auto& kernel = *kernels[ikernel];
+			std::array<const thorp::byte_t*, thorp::detail::blake2b_lanes_max> keys{};
+			for (std::size_t ilane = 0; ilane < kernel.lanes; ++ilane) keys[ilane] = key_data.data() + 16 * ilane;
+			for (std::size_t outlen : {16, 64}) {
+				std::array<uint64_t, 8 * thorp::detail::blake2b_lanes_max> words{};
+				kernel.keyed_hash(words.data(), outlen, messages, keys.data(), 16);
+				for (std::size_t ilane = 0; ilane < kernel.lanes; ++ilane) {
+					std::array<thorp::byte_t, 64> expected{};
+					thorp::detail::blake2b_keyed_hash(expected.data(), outlen, messages[ilane], keys[ilane], 16);
+					for (std::size_t ibyte = 0; ibyte < outlen; ++ibyte) {
+						const auto byte = static_cast<thorp::byte_t>(words[(ibyte / 8) * kernel.lanes + ilane] >> 8 * (ibyte % 8));
+						CHECK(byte == expected[ibyte]);
+					};
+				};
+			};
+		};
+	};
+};
+
+
+TEST_CASE("batch encryption") {
+	sodium_init();
+	const uint64_t key = 4;
+	// 13 is not a multiple of any lane count, so the last chunk is partial.
+	std::vector<uint64_t> plaintexts{ 0,1,4,11,234112341,std::numeric_limits<uint64_t>::max(),5,6,7,8,9,10,12 };
+
+	SUBCASE("OptThorpObfuscator") {
+		thorp::OptThorpObfuscator obfuscator = thorp::OptThorpObfuscator::from_uint64(key, std::numeric_limits<uint64_t>::max());
+		std::vector<uint64_t> cyphertexts(plaintexts.size());
+		obfuscator.encrypt_batch(plaintexts.data(), cyphertexts.data(), plaintexts.size());
+		for (std::size_t i = 0; i < plaintexts.size(); ++i) {
+			CHECK(cyphertexts[i] == obfuscator.encrypt(plaintexts[i]));
+		};
+		std::vector<uint64_t> decrypted(plaintexts.size());
+		obfuscator.decrypt_batch(cyphertexts.data(), decrypted.data(), cyphertexts.size());
+		CHECK(decrypted == plaintexts);
+		for (std::size_t i = 0; i < plaintexts.size(); ++i) {
+			CHECK(decrypted[i] == obfuscator.decrypt(cyphertexts[i]));
+		};
+	};
+
+	SUBCASE("OptThorpObfuscator small domains") {
+		for (uint64_t opt_level = 1; opt_level <= thorp::OptThorpObfuscator::optimization_level_max; ++opt_level) {
+			const uint64_t max_message = (1ull << (opt_level + 3)) - 1;
+			std::vector<thorp::byte_t> key_vec(10000, 173);
+			thorp::OptThorpObfuscator obfuscator{ key_vec, max_message, 3, opt_level };
+			std::vector<uint64_t> messages(max_message + 1);
+			std::iota(messages.begin(), messages.end(), 0);
+			std::vector<uint64_t> batch(messages.size());
+			obfuscator.encrypt_batch(messages.data(), batch.data(), messages.size());
+			for (uint64_t message : messages) {
+				CHECK(batch[message] == obfuscator.encrypt(message));
+			};
+			// in place
+			obfuscator.decrypt_batch(batch.data(), batch.data(), batch.size());
+			CHECK(batch == messages);
+		};
+	};
+
+	SUBCASE("ThorpObfuscator") {
+		thorp::ThorpObfuscator obfuscator = thorp::ThorpObfuscator::from_uint64(key, 1000001);
+		std::vector<uint64_t> small_plaintexts{ 0,1,4,11,234112,1000001,5,6,7,8,9,10,12 };
+		std::vector<uint64_t> cyphertexts(small_plaintexts.size());
+		obfuscator.encrypt_batch(small_plaintexts.data(), cyphertexts.data(), small_plaintexts.size());
+		for (std::size_t i = 0; i < small_plaintexts.size(); ++i) {
+			CHECK(cyphertexts[i] == obfuscator.encrypt(small_plaintexts[i]));
+		};
+		obfuscator.decrypt_batch(cyphertexts.data(), cyphertexts.data(), cyphertexts.size());
+		CHECK(cyphertexts == small_plaintexts);
+	};
+};
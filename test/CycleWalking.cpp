@@ -0,0 +1,84 @@
+#include "ThorpCycleWalking.hpp"
+#include "ThorpParallel.hpp"
+#include <doctest/doctest.h>
+#include <numeric>
+
+namespace {
+	// encrypt_batch, encrypt and decrypt have to agree and permute [0, max_message].
+	void check_bijection(const thorp::CycleWalkingObfuscator& obfuscator)
+	{
+		const uint64_t max_message = obfuscator.max_message();
+		std::vector<uint64_t> messages(max_message + 1);
+		std::iota(messages.begin(), messages.end(), uint64_t{ 0 });
+		std::vector<uint64_t> encrypted(messages.size());
+		obfuscator.encrypt_batch(messages.data(), encrypted.data(), messages.size());
+		std::vector<bool> seen(messages.size(), false);
+		for (uint64_t message = 0; message <= max_message; ++message) {
+			REQUIRE(encrypted[message] <= max_message);
+			CHECK_FALSE(seen[encrypted[message]]);
+			seen[encrypted[message]] = true;
+			CHECK(obfuscator.encrypt(message) == encrypted[message]);
+			CHECK(obfuscator.decrypt(encrypted[message]) == message);
+		};
+		std::vector<uint64_t> decrypted(messages.size());
+		obfuscator.decrypt_batch(encrypted.data(), decrypted.data(), encrypted.size());
+		CHECK(decrypted == messages);
+	}
+}
+
+TEST_CASE("CycleWalkingObfuscator") {
+	sodium_init();
+
+	SUBCASE("cover domains") {
+		CHECK(thorp::CycleWalkingObfuscator::cover_max_message(0, 1) == 1);
+		CHECK(thorp::CycleWalkingObfuscator::cover_max_message(1, 1) == 1);
+		CHECK(thorp::CycleWalkingObfuscator::cover_max_message(2, 1) == 3);
+		CHECK(thorp::CycleWalkingObfuscator::cover_max_message(999, 7) == 1023);
+		CHECK(thorp::CycleWalkingObfuscator::cover_max_message(1023, 7) == 1023);
+		CHECK(thorp::CycleWalkingObfuscator::cover_max_message(1024, 7) == 1151);
+		CHECK(thorp::CycleWalkingObfuscator::cover_max_message(std::numeric_limits<uint64_t>::max() - 5, 7) == std::numeric_limits<uint64_t>::max());
+		// the default level trades walks for fewer hashes per round: at level 1 a domain of 101 messages costs
+		// about 57 hashes per message, at level 7 (a cover of 128 messages) about 10.
+		const auto hundred = thorp::CycleWalkingObfuscator::from_uint64(4, 100);
+		CHECK(hundred.cover().optimization_level() == 7);
+		CHECK(hundred.cover().max_message() == 127);
+		CHECK(thorp::CycleWalkingObfuscator::from_uint64(4, 1000).cover().optimization_level() == 7);
+		CHECK(thorp::CycleWalkingObfuscator::from_uint64(4, 2).cover().max_message() == 3);
+		const auto large = thorp::CycleWalkingObfuscator::from_uint64(4, 1000000);
+		CHECK(large.cover().optimization_level() == 7);
+		CHECK(large.cover().max_message() == 1000063);
+	};
+
+	SUBCASE("odd domains") {
+		check_bijection(thorp::CycleWalkingObfuscator::from_uint64(4, 0));
+		check_bijection(thorp::CycleWalkingObfuscator::from_uint64(4, 2));
+		check_bijection(thorp::CycleWalkingObfuscator::from_uint64(4, 9));
+		check_bijection(thorp::CycleWalkingObfuscator::from_uint64(5, 999));
+		check_bijection(thorp::CycleWalkingObfuscator::from_uint64(6, 12344));
+		// a cover twice as large as the domain, about every other message walks.
+		check_bijection(thorp::CycleWalkingObfuscator::from_uint64(7, 4096, 3, 7));
+		check_bijection(thorp::CycleWalkingObfuscator::from_uint64(7, 1000, 4, 4, thorp::RoundFunction::siphash24));
+	};
+
+	SUBCASE("valid domains need no walks") {
+		const auto obfuscator = thorp::CycleWalkingObfuscator::from_uint64(4, std::numeric_limits<uint64_t>::max());
+		const auto plain = thorp::OptThorpObfuscator::from_uint64(4, std::numeric_limits<uint64_t>::max());
+		CHECK(obfuscator.encrypt(0) == 0xe780572b98733e76ull);
+		CHECK(obfuscator.encrypt(12345) == plain.encrypt(12345));
+		CHECK(obfuscator.decrypt(12345) == plain.decrypt(12345));
+	};
+
+	SUBCASE("parallel_encrypt") {
+		const auto obfuscator = thorp::CycleWalkingObfuscator::from_uint64(8, 100000);
+		std::vector<uint64_t> messages(100001);
+		std::iota(messages.begin(), messages.end(), uint64_t{ 0 });
+		std::vector<uint64_t> encrypted(messages.size());
+		thorp::WorkStealingPool pool{ 2 };
+		thorp::parallel_encrypt(obfuscator, messages.data(), encrypted.data(), messages.size(), pool);
+		for (uint64_t message : { uint64_t{ 0 }, uint64_t{ 777 }, uint64_t{ 100000 } }) {
+			CHECK(encrypted[message] == obfuscator.encrypt(message));
+		};
+		thorp::parallel_decrypt(obfuscator, encrypted.data(), encrypted.data(), encrypted.size(), pool);
+		CHECK(encrypted == messages);
+	};
+};
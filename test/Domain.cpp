@@ -0,0 +1,39 @@
+#include "ThorpShuffler.hpp"
+#include <doctest/doctest.h>
+
+
+TEST_CASE("domain permutation") {
+	sodium_init();
+
+	SUBCASE("ThorpObfuscator") {
+		for (uint64_t max_message : {1ull, 7ull, 1001ull, (1ull << 16) - 1}) {
+			thorp::ThorpObfuscator obfuscator = thorp::ThorpObfuscator::from_uint64(4, max_message);
+			std::vector<uint64_t> permutation(max_message + 1);
+			std::vector<uint64_t> inverse(max_message + 1);
+			obfuscator.permute_domain(permutation.data());
+			obfuscator.inverse_permute_domain(inverse.data(), 3);
+			for (uint64_t message = 0; message <= max_message; ++message) {
+				CHECK(permutation[message] == obfuscator.encrypt(message));
+				CHECK(inverse[message] == obfuscator.decrypt(message));
+			};
+		};
+	};
+
+	SUBCASE("OptThorpObfuscator") {
+		for (uint64_t opt_level = 1; opt_level <= thorp::OptThorpObfuscator::optimization_level_max; ++opt_level) {
+			for (uint64_t max_message : {(1ull << opt_level) - 1, (1ull << (opt_level + 5)) - 1, (1ull << 17) - 1}) {
+				std::vector<thorp::byte_t> key_vec(10000);
+				for (std::size_t i = 0; i < key_vec.size(); ++i) key_vec[i] = static_cast<thorp::byte_t>(i * 31 + 7);
+				thorp::OptThorpObfuscator obfuscator{ key_vec, max_message, 3, opt_level };
+				std::vector<uint64_t> permutation(max_message + 1);
+				std::vector<uint64_t> inverse(max_message + 1);
+				obfuscator.permute_domain(permutation.data(), 4);
+				obfuscator.inverse_permute_domain(inverse.data(), 1);
+				for (uint64_t message = 0; message <= max_message; ++message) {
+					CHECK(permutation[message] == obfuscator.encrypt(message));
+					CHECK(inverse[permutation[message]] == message);
+				};
+			};
+		};
+	};
+};
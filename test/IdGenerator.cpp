@@ -0,0 +1,93 @@
+#include "ThorpIdGenerator.hpp"
+#include <doctest/doctest.h>
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+
+TEST_CASE("ObfuscatedIdGenerator") {
+	sodium_init();
+	const uint64_t max_message = (1ull << 14) - 1;
+	const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, max_message);
+
+	SUBCASE("ids are the encrypted counters") {
+		thorp::ObfuscatedIdGenerator generator{ obfuscator, 0, 16 };
+		for (uint64_t counter = 0; counter < 100; ++counter) {
+			CHECK(generator.next_id() == obfuscator.encrypt(counter));
+		};
+		CHECK(generator.reserved_counters() == 112);
+	};
+
+	SUBCASE("threads issue every id once until the domain is exhausted") {
+		thorp::ObfuscatedIdGenerator generator{ obfuscator, 0, 64 };
+		std::vector<std::vector<uint64_t>> issued(4);
+		std::vector<std::thread> threads;
+		for (auto& ids : issued) {
+			threads.emplace_back([&generator, &ids]() {
+				try {
+					for (;;) ids.push_back(generator.next_id());
+				}
+				catch (const thorp::IdsExhausted&) {
+				};
+				});
+		};
+		for (auto& thread : threads) thread.join();
+		std::vector<uint64_t> all;
+		for (const auto& ids : issued) all.insert(all.end(), ids.begin(), ids.end());
+		std::sort(all.begin(), all.end());
+		REQUIRE(all.size() == max_message + 1);
+		for (uint64_t id = 0; id <= max_message; ++id) {
+			CHECK(all[id] == id);
+		};
+		CHECK_THROWS_AS(generator.next_id(), thorp::IdsExhausted);
+	};
+
+	SUBCASE("the last block is cut short and every later call throws") {
+		const auto full = thorp::OptThorpObfuscator::from_uint64(4, std::numeric_limits<uint64_t>::max());
+		const uint64_t first_counter = std::numeric_limits<uint64_t>::max() - 99;
+		thorp::ObfuscatedIdGenerator generator{ full, first_counter };
+		for (uint64_t counter = first_counter; counter != 0; ++counter) {
+			CHECK(generator.next_id() == full.encrypt(counter));
+		};
+		for (std::size_t i = 0; i < 3 * thorp::ObfuscatedIdGenerator::default_block_size; ++i) {
+			CHECK_THROWS_AS(generator.next_id(), thorp::IdsExhausted);
+		};
+		CHECK(generator.reserved_counters() == std::numeric_limits<uint64_t>::max());
+
+		thorp::ObfuscatedIdGenerator partial{ obfuscator, max_message - 20, 16 };
+		std::vector<uint64_t> issued;
+		for (int i = 0; i < 21; ++i) issued.push_back(partial.next_id());
+		CHECK(issued.back() == obfuscator.encrypt(max_message));
+		CHECK_THROWS_AS(partial.next_id(), thorp::IdsExhausted);
+		CHECK_THROWS_AS(partial.next_id(), thorp::IdsExhausted);
+		CHECK(partial.reserved_counters() == max_message + 1);
+	};
+
+	SUBCASE("a restart from the persisted mark repeats no id") {
+		uint64_t persisted = 0;
+		std::vector<uint64_t> marks;
+		thorp::IdPersistence persistence{ [&](uint64_t mark) { persisted = mark; marks.push_back(mark); }, 100 };
+		std::vector<uint64_t> issued;
+		{
+			thorp::ObfuscatedIdGenerator generator{ obfuscator, 0, 16, persistence };
+			for (int i = 0; i < 250; ++i) issued.push_back(generator.next_id());
+			CHECK(generator.high_water_mark() == persisted);
+			CHECK(generator.reserved_counters() <= persisted);
+		};
+		CHECK(std::is_sorted(marks.begin(), marks.end()));
+		CHECK(marks.size() < 250 / 16);
+		thorp::ObfuscatedIdGenerator restarted{ obfuscator, persisted, 16, persistence };
+		for (int i = 0; i < 250; ++i) issued.push_back(restarted.next_id());
+		std::sort(issued.begin(), issued.end());
+		CHECK(std::adjacent_find(issued.begin(), issued.end()) == issued.end());
+	};
+
+	SUBCASE("a failing persist issues no id past the mark") {
+		bool fail = true;
+		thorp::IdPersistence persistence{ [&](uint64_t) { if (fail) throw std::runtime_error("disk full"); }, 100 };
+		thorp::ObfuscatedIdGenerator generator{ obfuscator, 0, 16, persistence };
+		CHECK_THROWS_AS(generator.next_id(), std::runtime_error);
+		fail = false;
+		CHECK(generator.next_id() == obfuscator.encrypt(16)); // the first block was dropped
+	};
+}
@@ -0,0 +1,141 @@
+#include "ThorpIdStream.hpp"
+#include <doctest/doctest.h>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+	// the ids the parser makes of input fed in pieces of piece_size bytes, and the sizes of its batches.
+	std::vector<uint64_t> parse(thorp::IdFormat format, const std::string& input, std::size_t piece_size,
+		std::vector<std::size_t>* batch_sizes = nullptr, std::size_t batch_size = 1 << 16, uint64_t max_message = ~uint64_t{ 0 })
+	{
+		std::vector<uint64_t> ids;
+		thorp::IdParser parser{ format, max_message, [&](std::vector<uint64_t>&& batch) {
+			if (batch_sizes != nullptr) batch_sizes->push_back(batch.size());
+			ids.insert(ids.end(), batch.begin(), batch.end());
+			}, batch_size };
+		for (std::size_t first = 0; first < input.size(); first += piece_size) {
+			parser.feed(input.data() + first, std::min(piece_size, input.size() - first));
+		};
+		parser.finish();
+		return ids;
+	}
+
+	std::string binary(const std::vector<uint64_t>& ids)
+	{
+		std::string bytes;
+		for (uint64_t id : ids) {
+			for (int ibyte = 0; ibyte < 8; ++ibyte) bytes.push_back(static_cast<char>(id >> (8 * ibyte)));
+		};
+		return bytes;
+	}
+
+	// what an IdWriter with a buffer of buffer_size bytes writes.
+	template <class Write>
+	std::string written(thorp::IdFormat format, std::size_t buffer_size, const Write& write)
+	{
+		std::unique_ptr<std::FILE, int (*)(std::FILE*)> file{ std::tmpfile(), &std::fclose };
+		REQUIRE(file);
+		thorp::IdWriter writer{ file.get(), format, buffer_size };
+		write(writer);
+		writer.close();
+		std::string content(static_cast<std::size_t>(std::ftell(file.get())), '\0');
+		std::rewind(file.get());
+		CHECK(std::fread(&content[0], 1, content.size(), file.get()) == content.size());
+		return content;
+	}
+}
+
+TEST_CASE("id streams") {
+	const std::vector<uint64_t> ids{ 0, 7, 123456789, 18446744073709551615ull, 42 };
+
+	SUBCASE("text ids split over any blocks") {
+		const std::string input = "0\n7\r\n  123456789 \n\n\t\n18446744073709551615\r\n\n42";
+		for (std::size_t piece_size = 1; piece_size <= input.size(); ++piece_size) {
+			CHECK(parse(thorp::IdFormat::decimal, input, piece_size) == ids);
+		};
+		const std::string hex = "0x0\n7\n0X75BCD15\nffffffffffffffff\r\n0x2a\n";
+		for (std::size_t piece_size = 1; piece_size <= hex.size(); ++piece_size) {
+			CHECK(parse(thorp::IdFormat::hex, hex, piece_size) == ids);
+		};
+	};
+
+	SUBCASE("binary ids split within a word") {
+		const std::string input = binary(ids);
+		for (std::size_t piece_size = 1; piece_size <= input.size(); ++piece_size) {
+			CHECK(parse(thorp::IdFormat::binary, input, piece_size) == ids);
+		};
+		CHECK(parse(thorp::IdFormat::binary, "", 1).empty());
+	};
+
+	SUBCASE("batches") {
+		std::vector<std::size_t> batch_sizes;
+		CHECK(parse(thorp::IdFormat::decimal, "1\n2\n3\n4\n5\n6\n7\n", 3, &batch_sizes, 3).size() == 7);
+		CHECK(batch_sizes == std::vector<std::size_t>{ 3, 3, 1 });
+	};
+
+	SUBCASE("malformed input") {
+		CHECK_THROWS_AS(parse(thorp::IdFormat::decimal, "12\n1a\n", 4), std::runtime_error);
+		CHECK_THROWS_AS(parse(thorp::IdFormat::decimal, "-1\n", 4), std::runtime_error);
+		CHECK_THROWS_AS(parse(thorp::IdFormat::decimal, "18446744073709551616\n", 4), std::runtime_error);
+		CHECK_THROWS_AS(parse(thorp::IdFormat::decimal, "1 2\n", 4), std::runtime_error);
+		CHECK_THROWS_AS(parse(thorp::IdFormat::hex, "0x\n", 4), std::runtime_error);
+		CHECK_THROWS_AS(parse(thorp::IdFormat::decimal, "100\n", 4, nullptr, 16, 99), std::runtime_error);
+		CHECK_THROWS_AS(parse(thorp::IdFormat::binary, binary(ids) + "abc", 5), std::runtime_error);
+		CHECK_THROWS_AS(thorp::parse_id_format("octal"), std::invalid_argument);
+		CHECK(thorp::parse_id_format("hex") == thorp::IdFormat::hex);
+	};
+
+	SUBCASE("writer") {
+		// a buffer smaller than the output flushes in between.
+		for (std::size_t buffer_size : { std::size_t{ 1 }, std::size_t{ 50 }, thorp::IdWriter::default_buffer_size }) {
+			const auto write_ids = [&](thorp::IdWriter& writer) { writer.write(ids.data(), ids.size()); };
+			CHECK(written(thorp::IdFormat::decimal, buffer_size, write_ids) == "0\n7\n123456789\n18446744073709551615\n42\n");
+			CHECK(written(thorp::IdFormat::hex, buffer_size, write_ids) == "0\n7\n75bcd15\nffffffffffffffff\n2a\n");
+			CHECK(written(thorp::IdFormat::binary, buffer_size, write_ids) == binary(ids));
+			const std::vector<thorp::PermutationPair> pairs{ { 1, 2 }, { 18446744073709551615ull, 0 } };
+			const auto write_pairs = [&](thorp::IdWriter& writer) { writer.write_pairs(pairs.data(), pairs.size()); };
+			CHECK(written(thorp::IdFormat::decimal, buffer_size, write_pairs) == "1 2\n18446744073709551615 0\n");
+			CHECK(written(thorp::IdFormat::binary, buffer_size, write_pairs) == binary({ 1, 2, 18446744073709551615ull, 0 }));
+		};
+	};
+
+	SUBCASE("what the writer writes the parser reads") {
+		for (auto format : { thorp::IdFormat::binary, thorp::IdFormat::decimal, thorp::IdFormat::hex }) {
+			const std::string output = written(format, 64, [&](thorp::IdWriter& writer) { writer.write(ids.data(), ids.size()); });
+			CHECK(parse(format, output, 5) == ids);
+		};
+	};
+}
+
+TEST_CASE("obfuscator parameters") {
+	const uint64_t max_message = std::numeric_limits<uint64_t>::max();
+	const auto blake2b = thorp::RoundFunction::blake2b;
+
+	SUBCASE("the default level is the largest of the round function") {
+		CHECK(thorp::check_obfuscator_parameters({ max_message, 8, 0, blake2b }).optimization_level == 7);
+		CHECK(thorp::check_obfuscator_parameters({ max_message, 8, 0, thorp::RoundFunction::siphash24 }).optimization_level == 4);
+		CHECK(thorp::check_obfuscator_parameters({ 1023, 1, 3, blake2b }).optimization_level == 3);
+	};
+
+	SUBCASE("levels beyond the hash are rejected") {
+		CHECK_THROWS_AS(thorp::check_obfuscator_parameters({ max_message, 8, 8, blake2b }), std::invalid_argument);
+		CHECK_THROWS_AS(thorp::check_obfuscator_parameters({ max_message, 8, 9, blake2b }), std::invalid_argument);
+		CHECK_THROWS_AS(thorp::check_obfuscator_parameters({ max_message, 8, 65, blake2b }), std::invalid_argument);
+		CHECK_THROWS_AS(thorp::check_obfuscator_parameters({ max_message, 8, 5, thorp::RoundFunction::siphash24 }), std::invalid_argument);
+	};
+
+	SUBCASE("even domains are rejected") {
+		CHECK_THROWS_AS(thorp::check_obfuscator_parameters({ 10, 8, 1, blake2b }), std::invalid_argument);
+		CHECK_THROWS_AS(thorp::check_obfuscator_parameters({ 0, 8, 1, blake2b }), std::invalid_argument);
+	};
+
+	SUBCASE("no passes are rejected") {
+		CHECK_THROWS_AS(thorp::check_obfuscator_parameters({ max_message, 0, 0, blake2b }), std::invalid_argument);
+	};
+
+	SUBCASE("the level has to divide the domain") {
+		CHECK_THROWS_AS(thorp::check_obfuscator_parameters({ 11, 8, 3, blake2b }), std::invalid_argument);
+		CHECK_NOTHROW(thorp::check_obfuscator_parameters({ 11, 8, 2, blake2b }));
+	};
+}
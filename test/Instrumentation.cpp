@@ -0,0 +1,92 @@
+#include "ThorpShuffler.hpp"
+#include <doctest/doctest.h>
+
+
+TEST_CASE("instrumentation") {
+	sodium_init();
+	const uint64_t max_message = (1ull << 20) - 1;
+	const uint64_t npasses = 3;
+	const uint64_t optimization_level = 4;
+	const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, max_message, npasses, optimization_level);
+	const uint64_t nrounds = thorp::nrounds_per_pass(max_message) * npasses;
+	const uint64_t nopt_rounds = (nrounds + optimization_level - 1) / optimization_level;
+
+	SUBCASE("the snapshot names the obfuscator") {
+		const thorp::InstrumentationSnapshot snapshot = obfuscator.instrumentation();
+		CHECK(snapshot.max_message == max_message);
+		CHECK(snapshot.npasses == npasses);
+		CHECK(snapshot.optimization_level == optimization_level);
+		CHECK(snapshot.round_function == thorp::RoundFunction::blake2b);
+	};
+
+	SUBCASE("scalar calls") {
+		obfuscator.reset_instrumentation();
+		const uint64_t cyphertext = obfuscator.encrypt(12345);
+		CHECK(obfuscator.decrypt(cyphertext) == 12345);
+		const thorp::InstrumentationSnapshot snapshot = obfuscator.instrumentation();
+		if constexpr (thorp::instrumentation_enabled) {
+			CHECK(snapshot.operations == 2);
+			CHECK(snapshot.rounds == 2 * nrounds);
+			CHECK(snapshot.hashes == 2 * nopt_rounds);
+			CHECK(snapshot.cache_hits == 2 * (nrounds - nopt_rounds));
+			CHECK(snapshot.key_bytes == 2 * nopt_rounds * thorp::detail::prepared_round_key_size(thorp::RoundFunction::blake2b));
+			CHECK(snapshot.key_derivations == 0);
+			CHECK(snapshot.hashes_per_operation() == static_cast<double>(nopt_rounds));
+		}
+		else {
+			CHECK(snapshot.operations == 0);
+			CHECK(snapshot.hashes == 0);
+		};
+	};
+
+	SUBCASE("derived keys are counted") {
+		const std::array<thorp::byte_t, thorp::detail::master_key_size> master_key{ 1, 2, 3 };
+		const auto derived = thorp::OptThorpObfuscator::from_master_key(master_key, max_message, npasses, optimization_level);
+		derived.encrypt(7);
+		if constexpr (thorp::instrumentation_enabled) {
+			CHECK(derived.instrumentation().key_derivations == nopt_rounds);
+			CHECK(derived.instrumentation().key_bytes == nopt_rounds * thorp::detail::master_key_size);
+		};
+	};
+
+	SUBCASE("batches and ranges") {
+		obfuscator.reset_instrumentation();
+		std::vector<uint64_t> messages(100);
+		obfuscator.encrypt_range(0, messages.size(), messages.data());
+		obfuscator.decrypt_batch(messages.data(), messages.data(), messages.size());
+		const thorp::InstrumentationSnapshot snapshot = obfuscator.instrumentation();
+		if constexpr (thorp::instrumentation_enabled) {
+			CHECK(snapshot.operations == 200);
+			CHECK(snapshot.rounds == 200 * nrounds);
+			CHECK(snapshot.hashes > 0);
+			CHECK(snapshot.hashes + snapshot.cache_hits >= snapshot.rounds);
+		};
+	};
+
+	SUBCASE("cycle sampling") {
+		obfuscator.reset_instrumentation();
+		obfuscator.set_cycle_sampling(4);
+		for (uint64_t message = 0; message < 8; ++message) {
+			obfuscator.encrypt(message);
+		};
+		obfuscator.set_cycle_sampling(0);
+		obfuscator.encrypt(9);
+		const thorp::InstrumentationSnapshot snapshot = obfuscator.instrumentation();
+		if constexpr (thorp::instrumentation_enabled) {
+			CHECK(snapshot.sampled_rounds == 2 * nrounds);
+			CHECK(snapshot.sampled_cycles >= snapshot.max_round_cycles);
+			CHECK(snapshot.cycles_per_round() > 0);
+		}
+		else {
+			CHECK(snapshot.sampled_rounds == 0);
+		};
+	};
+
+	SUBCASE("copies count on their own") {
+		obfuscator.reset_instrumentation();
+		const thorp::OptThorpObfuscator copy = obfuscator;
+		copy.encrypt(1);
+		CHECK(obfuscator.instrumentation().operations == 0);
+		CHECK(copy.encrypt(1) == obfuscator.encrypt(1));
+	};
+}
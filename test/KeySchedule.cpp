@@ -0,0 +1,54 @@
+#include "ThorpShuffler.hpp"
+#include <doctest/doctest.h>
+
+
+TEST_CASE("key schedules") {
+	sodium_init();
+	std::array<thorp::byte_t, thorp::detail::master_key_size> master_key{};
+	for (std::size_t i = 0; i < master_key.size(); ++i) master_key[i] = static_cast<thorp::byte_t>(i * 7 + 1);
+
+	SUBCASE("round_keys_data_size") {
+		// one 16 byte key per opt round.
+		CHECK(thorp::OptThorpObfuscator::round_keys_data_size(8, std::numeric_limits<uint64_t>::max(), 7) == 74 * 16);
+		CHECK(thorp::OptThorpObfuscator::round_keys_data_size(2, 255, 1) == 16 * 16);
+	};
+
+	for (thorp::RoundFunction round_function : { thorp::RoundFunction::blake2b, thorp::RoundFunction::aes128, thorp::RoundFunction::siphash24 }) {
+		if (!thorp::round_function_supported(round_function)) continue;
+		const uint64_t opt_level = thorp::OptThorpObfuscator::optimization_level_max_for(round_function);
+
+		SUBCASE("derived and expanded agree") {
+			const uint64_t max_message = (1ull << 12) - 1;
+			const auto expanded = thorp::OptThorpObfuscator::from_master_key(master_key, max_message, 3, opt_level, round_function,
+				thorp::KeySchedule::expanded);
+			const auto derived = thorp::OptThorpObfuscator::from_master_key(master_key, max_message, 3, opt_level, round_function);
+			std::vector<uint64_t> messages(max_message + 1);
+			std::iota(messages.begin(), messages.end(), 0);
+			std::vector<uint64_t> batch(messages.size());
+			std::vector<uint64_t> domain(messages.size());
+			derived.encrypt_batch(messages.data(), batch.data(), messages.size());
+			derived.permute_domain(domain.data(), 2);
+			thorp::CipherContext context;
+			for (uint64_t message : messages) {
+				const uint64_t encrypted = expanded.encrypt(message);
+				CHECK(derived.encrypt(message, context) == encrypted);
+				CHECK(batch[message] == encrypted);
+				CHECK(domain[message] == encrypted);
+				CHECK(derived.decrypt(encrypted) == message);
+			};
+			derived.decrypt_batch(batch.data(), batch.data(), batch.size());
+			CHECK(batch == messages);
+		};
+
+		SUBCASE("full domain") {
+			const uint64_t max_message = std::numeric_limits<uint64_t>::max();
+			const auto expanded = thorp::OptThorpObfuscator::from_master_key(master_key, max_message, 8, opt_level, round_function,
+				thorp::KeySchedule::expanded);
+			const auto derived = thorp::OptThorpObfuscator::from_master_key(master_key, max_message, 8, opt_level, round_function);
+			for (uint64_t message : std::vector<uint64_t>{ 0, 1, 234112341, max_message }) {
+				CHECK(derived.encrypt(message) == expanded.encrypt(message));
+				CHECK(derived.decrypt(expanded.encrypt(message)) == message);
+			};
+		};
+	};
+};
@@ -0,0 +1,63 @@
+#include "ThorpKeySet.hpp"
+#include <doctest/doctest.h>
+
+TEST_CASE("KeySet") {
+	sodium_init();
+	std::vector<uint64_t> key_numbers;
+	for (uint64_t key_number = 0; key_number < 21; ++key_number) key_numbers.push_back(key_number * 7 + 4);
+
+	SUBCASE("encrypt_under_all matches the obfuscators") {
+		const uint64_t max_message = std::numeric_limits<uint64_t>::max();
+		const thorp::KeySet key_set = thorp::KeySet::from_uint64(key_numbers, max_message);
+		REQUIRE(key_set.size() == key_numbers.size());
+		std::vector<uint64_t> cyphertexts(key_set.size());
+		key_set.encrypt_under_all(0, cyphertexts.data());
+		CHECK(cyphertexts[0] == 0xe780572b98733e76ull);
+		for (uint64_t plaintext : { uint64_t{ 0 }, uint64_t{ 234112341 }, max_message }) {
+			key_set.encrypt_under_all(plaintext, cyphertexts.data());
+			for (std::size_t ikey = 0; ikey < key_numbers.size(); ++ikey) {
+				CHECK(cyphertexts[ikey] == thorp::OptThorpObfuscator::from_uint64(key_numbers[ikey], max_message).encrypt(plaintext));
+			};
+		};
+	};
+
+	SUBCASE("encrypt_many and decrypt_many") {
+		const uint64_t max_message = 383; // half of the domain is 3*2^6, the round count is not a multiple of the level.
+		for (uint64_t optimization_level : { 1, 4, 7 }) {
+			const thorp::KeySet key_set = thorp::KeySet::from_uint64(key_numbers, max_message, 3, optimization_level);
+			std::vector<std::size_t> key_indices;
+			std::vector<uint64_t> plaintexts;
+			for (std::size_t imessage = 0; imessage < 53; ++imessage) {
+				key_indices.push_back(imessage * 5 % key_numbers.size());
+				plaintexts.push_back(imessage * 37 % (max_message + 1));
+			};
+			std::vector<uint64_t> cyphertexts(plaintexts.size());
+			key_set.encrypt_many(key_indices.data(), plaintexts.data(), cyphertexts.data(), plaintexts.size());
+			for (std::size_t imessage = 0; imessage < plaintexts.size(); ++imessage) {
+				const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(key_numbers[key_indices[imessage]], max_message, 3, optimization_level);
+				CHECK(cyphertexts[imessage] == obfuscator.encrypt(plaintexts[imessage]));
+			};
+			std::vector<uint64_t> decrypted(cyphertexts.size());
+			key_set.decrypt_many(key_indices.data(), cyphertexts.data(), decrypted.data(), cyphertexts.size());
+			CHECK(decrypted == plaintexts);
+		};
+	};
+
+	SUBCASE("round functions and key data") {
+		for (thorp::RoundFunction round_function : { thorp::RoundFunction::aes128, thorp::RoundFunction::siphash24 }) {
+			if (!thorp::round_function_supported(round_function)) continue;
+			const uint64_t level = thorp::OptThorpObfuscator::optimization_level_max_for(round_function);
+			std::vector<std::vector<thorp::byte_t>> round_keys_data(5, std::vector<thorp::byte_t>(10000));
+			for (std::size_t ikey = 0; ikey < round_keys_data.size(); ++ikey) {
+				for (std::size_t i = 0; i < round_keys_data[ikey].size(); ++i) round_keys_data[ikey][i] = static_cast<thorp::byte_t>(i * 31 + ikey);
+			};
+			const thorp::KeySet key_set{ round_keys_data, 4095, 3, level, round_function };
+			std::vector<uint64_t> cyphertexts(key_set.size());
+			key_set.encrypt_under_all(1234, cyphertexts.data());
+			for (std::size_t ikey = 0; ikey < round_keys_data.size(); ++ikey) {
+				const thorp::OptThorpObfuscator obfuscator{ round_keys_data[ikey], 4095, 3, level, round_function };
+				CHECK(cyphertexts[ikey] == obfuscator.encrypt(1234));
+			};
+		};
+	};
+};
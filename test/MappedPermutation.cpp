@@ -0,0 +1,96 @@
+#include "ThorpMappedPermutation.hpp"
+#include <doctest/doctest.h>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+
+TEST_CASE("MappedPermutation") {
+	sodium_init();
+	const uint64_t max_message = (1ull << 12) - 1;
+	const std::string path = "thorp_mapped_permutation_test.bin";
+	const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, max_message);
+
+	SUBCASE("lookups match the obfuscator") {
+		thorp::write_permutation_file(path, obfuscator, 2);
+		const thorp::MappedPermutation permutation{ path, obfuscator };
+		REQUIRE(permutation.is_mapped());
+		for (uint64_t message = 0; message <= max_message; ++message) {
+			CHECK(permutation.encrypt(message) == obfuscator.encrypt(message));
+			CHECK(permutation.decrypt(permutation.encrypt(message)) == message);
+		};
+		std::remove(path.c_str());
+	};
+
+	SUBCASE("large domains use 8 byte entries") {
+		const auto header = thorp::PermutationFileHeader::for_obfuscator(
+			thorp::OptThorpObfuscator::from_uint64(4, (1ull << 33) - 1));
+		CHECK(header.entry_bytes == 8);
+		CHECK(thorp::PermutationFileHeader::for_obfuscator(obfuscator).entry_bytes == 4);
+	};
+
+	SUBCASE("a missing file falls back to the obfuscator") {
+		const thorp::MappedPermutation permutation{ "does_not_exist.bin", obfuscator };
+		CHECK_FALSE(permutation.is_mapped());
+		CHECK(permutation.encrypt(17) == obfuscator.encrypt(17));
+		CHECK(permutation.decrypt(17) == obfuscator.decrypt(17));
+	};
+
+	SUBCASE("a file of another key falls back to the obfuscator") {
+		thorp::write_permutation_file(path, thorp::OptThorpObfuscator::from_uint64(5, max_message));
+		const thorp::MappedPermutation permutation{ path, obfuscator };
+		CHECK_FALSE(permutation.is_mapped());
+		CHECK(permutation.encrypt(17) == obfuscator.encrypt(17));
+		std::remove(path.c_str());
+	};
+
+	SUBCASE("a truncated file falls back to the obfuscator") {
+		thorp::write_permutation_file(path, obfuscator);
+		std::ifstream in{ path, std::ios::binary };
+		std::vector<char> content{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+		in.close();
+		std::ofstream{ path, std::ios::binary | std::ios::trunc }.write(content.data(), static_cast<std::streamsize>(content.size() / 2));
+		const thorp::MappedPermutation permutation{ path, obfuscator };
+		CHECK_FALSE(permutation.is_mapped());
+		std::remove(path.c_str());
+	};
+
+	SUBCASE("moving keeps the mapping") {
+		thorp::write_permutation_file(path, obfuscator);
+		thorp::MappedPermutation permutation{ path, obfuscator };
+		thorp::MappedPermutation moved{ std::move(permutation) };
+		CHECK(moved.is_mapped());
+		CHECK(moved.encrypt(3) == obfuscator.encrypt(3));
+		std::remove(path.c_str());
+	};
+
+	SUBCASE("concurrent writers replace the file in one step") {
+		const auto other = thorp::OptThorpObfuscator::from_uint64(5, max_message);
+		thorp::write_permutation_file(path, obfuscator);
+		std::atomic<bool> writing{ true };
+		std::thread first{ [&]() { for (int i = 0; i < 200; ++i) thorp::write_permutation_file(path, obfuscator); } };
+		std::thread second{ [&]() { for (int i = 0; i < 200; ++i) thorp::write_permutation_file(path, other); } };
+		std::thread reader{ [&]() {
+			while (writing.load()) {
+				// the file is always there and always complete, for one of the two keys.
+				std::ifstream in{ path, std::ios::binary };
+				std::vector<char> content{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+				thorp::PermutationFileHeader header{};
+				CHECK(content.size() >= sizeof(header));
+				if (content.size() < sizeof(header)) continue;
+				std::memcpy(&header, content.data(), sizeof(header));
+				CHECK((header.matches(thorp::PermutationFileHeader::for_obfuscator(obfuscator))
+					|| header.matches(thorp::PermutationFileHeader::for_obfuscator(other))));
+				CHECK(content.size() == header.file_size());
+			};
+			} };
+		first.join();
+		second.join();
+		writing.store(false);
+		reader.join();
+		CHECK((thorp::MappedPermutation{ path, obfuscator }.is_mapped() || thorp::MappedPermutation{ path, other }.is_mapped()));
+		std::remove(path.c_str());
+	};
+}
@@ -0,0 +1,93 @@
+#include "ThorpMemo.hpp"
+#include <doctest/doctest.h>
+#include <thread>
+
+TEST_CASE("MemoizedObfuscator") {
+	sodium_init();
+	const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, std::numeric_limits<uint64_t>::max());
+
+	SUBCASE("results match the obfuscator") {
+		const thorp::MemoizedObfuscator memoized{ obfuscator, 1 << 16 };
+		CHECK(memoized.encrypt(0) == 0xe780572b98733e76ull);
+		CHECK(memoized.encrypt(0) == 0xe780572b98733e76ull);
+		CHECK(memoized.decrypt(0xe780572b98733e76ull) == 0);
+		const thorp::MemoStatistics statistics = memoized.statistics();
+		CHECK(statistics.hits == 2); // the encryption also filled the inverse cache.
+		CHECK(statistics.misses == 1);
+		CHECK(statistics.capacity > 0);
+		for (uint64_t message : { uint64_t{ 5 }, uint64_t{ 1234567 }, std::numeric_limits<uint64_t>::max() }) {
+			CHECK(memoized.decrypt(message) == obfuscator.decrypt(message));
+			CHECK(memoized.encrypt(memoized.decrypt(message)) == message);
+		};
+	};
+
+	SUBCASE("skewed batches") {
+		const thorp::MemoizedObfuscator memoized{ obfuscator, 1 << 16 };
+		std::vector<uint64_t> messages;
+		for (uint64_t imessage = 0; imessage < 1000; ++imessage) {
+			messages.push_back(imessage % 10 == 0 ? 1000 + imessage : imessage % 7); // 7 hot ids
+		};
+		std::vector<uint64_t> encrypted(messages.size());
+		// the lookups of a batch come before its insertions, the first batch misses throughout.
+		memoized.encrypt_batch(messages.data(), encrypted.data(), messages.size());
+		CHECK(memoized.statistics().misses == messages.size());
+		memoized.reset_statistics();
+		memoized.encrypt_batch(messages.data(), encrypted.data(), messages.size());
+		for (std::size_t imessage = 0; imessage < messages.size(); ++imessage) {
+			CHECK(encrypted[imessage] == obfuscator.encrypt(messages[imessage]));
+		};
+		CHECK(memoized.statistics().hit_rate() == 1.0);
+		std::vector<uint64_t> decrypted(encrypted.size());
+		memoized.decrypt_batch(encrypted.data(), decrypted.data(), encrypted.size());
+		CHECK(decrypted == messages);
+		memoized.reset_statistics();
+		memoized.clear();
+		CHECK(memoized.encrypt(3) == obfuscator.encrypt(3));
+		CHECK(memoized.statistics().hits == 0);
+	};
+
+	SUBCASE("the memory cap bounds the entries") {
+		const thorp::MemoizedObfuscator memoized{ obfuscator, 4096 };
+		const std::size_t capacity = memoized.statistics().capacity;
+		CHECK(capacity <= 4096 / (2 * sizeof(uint64_t)));
+		for (uint64_t message = 0; message < 2000; ++message) {
+			CHECK(memoized.encrypt(message) == obfuscator.encrypt(message));
+		};
+		const thorp::MemoStatistics statistics = memoized.statistics();
+		CHECK(statistics.evictions > 0);
+		CHECK(statistics.insertions - statistics.evictions <= capacity);
+		// a hot id survives the cold ones passing through its bucket.
+		memoized.reset_statistics();
+		for (uint64_t message = 0; message < 200; ++message) {
+			memoized.encrypt(42);
+			memoized.encrypt(100000 + message);
+		};
+		CHECK(memoized.statistics().hits >= 190);
+
+		const thorp::MemoizedObfuscator uncached{ obfuscator, 0 };
+		CHECK(uncached.encrypt(7) == obfuscator.encrypt(7));
+		CHECK(uncached.encrypt(7) == obfuscator.encrypt(7));
+		CHECK(uncached.statistics().hits == 0);
+		CHECK(uncached.statistics().capacity == 0);
+	};
+
+	SUBCASE("concurrent calls") {
+		const auto small = thorp::OptThorpObfuscator::from_uint64(4, (1ull << 16) - 1);
+		const thorp::MemoizedObfuscator memoized{ small, 1 << 12 };
+		std::vector<std::thread> threads;
+		std::vector<int> failures(4, 0);
+		for (unsigned ithread = 0; ithread < failures.size(); ++ithread) {
+			threads.emplace_back([&, ithread]() {
+				for (uint64_t imessage = 0; imessage < 300; ++imessage) {
+					const uint64_t message = (imessage * (ithread + 3)) % 64;
+					if (memoized.decrypt(memoized.encrypt(message)) != message) ++failures[ithread];
+				};
+				});
+		};
+		for (std::thread& thread : threads) {
+			thread.join();
+		};
+		CHECK(failures == std::vector<int>(4, 0));
+		CHECK(memoized.statistics().hits > 0);
+	};
+};
@@ -0,0 +1,94 @@
+#include "ThorpParallel.hpp"
+#include "ThorpShuffler.hpp"
+#include <doctest/doctest.h>
+#include <atomic>
+#include <stdexcept>
+
+
+TEST_CASE("parallel_encrypt") {
+	sodium_init();
+	const uint64_t max_message = (1ull << 32) - 1;
+	const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, max_message);
+	// a few chunks and a partial one.
+	const std::size_t count = 3 * thorp::parallel_chunk_size + 17;
+	std::vector<uint64_t> plaintexts(count);
+	for (std::size_t i = 0; i < count; ++i) {
+		plaintexts[i] = (i * 0x9e3779b97f4a7c15ull) & max_message;
+	};
+	std::vector<uint64_t> expected(count);
+	obfuscator.encrypt_batch(plaintexts.data(), expected.data(), count);
+
+	SUBCASE("pool") {
+		thorp::WorkStealingPool pool{ 4 };
+		CHECK(pool.size() == 4);
+		std::vector<uint64_t> cyphertexts(count);
+		thorp::parallel_encrypt(obfuscator, plaintexts.data(), cyphertexts.data(), count, pool);
+		CHECK(cyphertexts == expected);
+		thorp::parallel_decrypt(obfuscator, cyphertexts.data(), cyphertexts.data(), count, pool);
+		CHECK(cyphertexts == plaintexts);
+	};
+
+	SUBCASE("shared pool and ThorpObfuscator") {
+		const auto old_obfuscator = thorp::ThorpObfuscator::from_uint64(4, (1ull << 16) - 1);
+		std::vector<uint64_t> messages(1 << 16);
+		std::iota(messages.begin(), messages.end(), 0);
+		std::vector<uint64_t> cyphertexts(messages.size());
+		thorp::parallel_encrypt(old_obfuscator, messages.data(), cyphertexts.data(), messages.size());
+		for (std::size_t i = 0; i < messages.size(); i += 997) {
+			CHECK(cyphertexts[i] == old_obfuscator.encrypt(messages[i]));
+		};
+	};
+
+	SUBCASE("injected executor") {
+		std::size_t ncalls = 0;
+		const thorp::Executor sequential = [&ncalls](std::size_t ntasks, const std::function<void(std::size_t)>& task) {
+			++ncalls;
+			for (std::size_t itask = ntasks; itask-- > 0;) task(itask);
+		};
+		std::vector<uint64_t> cyphertexts(count);
+		thorp::parallel_encrypt(obfuscator, plaintexts.data(), cyphertexts.data(), count, sequential);
+		CHECK(ncalls == 1);
+		CHECK(cyphertexts == expected);
+	};
+
+	SUBCASE("concurrent runs on one pool and one obfuscator") {
+		thorp::WorkStealingPool pool{ 3 };
+		std::vector<std::vector<uint64_t>> outputs(4, std::vector<uint64_t>(count));
+		std::vector<std::thread> threads;
+		for (auto& output : outputs) {
+			threads.emplace_back([&]() {
+				thorp::parallel_encrypt(obfuscator, plaintexts.data(), output.data(), count, pool);
+				});
+		};
+		for (auto& thread : threads) thread.join();
+		for (const auto& output : outputs) {
+			CHECK(output == expected);
+		};
+	};
+
+	SUBCASE("every task runs once and exceptions reach the caller") {
+		thorp::WorkStealingPool pool{ 4 };
+		std::vector<std::atomic<int>> runs(1000);
+		pool.run(runs.size(), [&runs](std::size_t itask) { runs[itask].fetch_add(1); });
+		bool all_once = true;
+		for (const auto& run : runs) all_once = all_once && run.load() == 1;
+		CHECK(all_once);
+		CHECK_THROWS_AS(pool.run(100, [](std::size_t itask) { if (itask == 42) throw std::runtime_error("task"); }), std::runtime_error);
+		pool.run(0, [](std::size_t) {});
+	};
+
+	SUBCASE("a task running the pool again runs it inline") {
+		thorp::WorkStealingPool pool{ 4 };
+		std::vector<std::vector<uint64_t>> outputs(8, std::vector<uint64_t>(count));
+		pool.run(outputs.size(), [&](std::size_t itask) {
+			thorp::parallel_encrypt(obfuscator, plaintexts.data(), outputs[itask].data(), count, pool);
+			});
+		for (const auto& output : outputs) {
+			CHECK(output == expected);
+		};
+		thorp::WorkStealingPool single{ 1 };
+		std::vector<uint64_t> cyphertexts(count);
+		single.run(1, [&](std::size_t) { thorp::parallel_encrypt(obfuscator, plaintexts.data(), cyphertexts.data(), count, single); });
+		CHECK(cyphertexts == expected);
+	};
+}
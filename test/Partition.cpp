@@ -0,0 +1,128 @@
+#include "ThorpPartition.hpp"
+#include <doctest/doctest.h>
+#include <cstdio>
+#include <string>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	// checks that the pairs cover the domain [0, max_message] once, as a permutation of the obfuscator.
+	void check_permutation(const thorp::OptThorpObfuscator& obfuscator, const std::vector<thorp::PermutationPair>& pairs)
+	{
+		const uint64_t max_message = obfuscator.max_message();
+		REQUIRE(pairs.size() == max_message + 1);
+		std::vector<bool> seen(max_message + 1, false);
+		for (std::size_t ipair = 0; ipair < pairs.size(); ++ipair) {
+			CHECK(pairs[ipair].cyphertext == ipair);
+			REQUIRE(pairs[ipair].plaintext <= max_message);
+			CHECK_FALSE(seen[pairs[ipair].plaintext]);
+			seen[pairs[ipair].plaintext] = true;
+		};
+		for (uint64_t message : { uint64_t{ 0 }, uint64_t{ 1 }, max_message / 3, max_message }) {
+			CHECK(obfuscator.encrypt(pairs[message].plaintext) == message);
+		};
+	}
+}
+
+TEST_CASE("partitioned permutation export") {
+	sodium_init();
+
+	SUBCASE("partition_domain") {
+		const std::vector<thorp::Shard> shards = thorp::partition_domain(9, 4);
+		REQUIRE(shards.size() == 4);
+		CHECK(shards[0].first == 0);
+		CHECK(shards[0].last == 2);
+		CHECK(shards[1].first == 3);
+		CHECK(shards[1].last == 5);
+		CHECK(shards[2].first == 6);
+		CHECK(shards[2].last == 7);
+		CHECK(shards[3].first == 8);
+		CHECK(shards[3].last == 9);
+
+		// 2^64 messages, 3 does not divide them.
+		const std::vector<thorp::Shard> full = thorp::partition_domain(std::numeric_limits<uint64_t>::max(), 3);
+		CHECK(full[0].first == 0);
+		CHECK(full[1].first == full[0].last + 1);
+		CHECK(full[2].first == full[1].last + 1);
+		CHECK(full[2].last == std::numeric_limits<uint64_t>::max());
+		CHECK(thorp::partition_domain(std::numeric_limits<uint64_t>::max(), 1)[0].last == std::numeric_limits<uint64_t>::max());
+		CHECK(thorp::partition_domain(3, 4).back().first == 3);
+
+		CHECK_THROWS_AS(thorp::partition_domain(9, 0), std::invalid_argument);
+		CHECK_THROWS_AS(thorp::partition_domain(9, 11), std::invalid_argument);
+	};
+
+	SUBCASE("export_partition covers the domain") {
+		// shards of more than one export block.
+		const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, (1ull << 19) - 1);
+		thorp::WorkStealingPool pool{ 2 };
+		std::vector<thorp::PermutationPair> pairs;
+		uint64_t last_shard = 0;
+		thorp::export_partition(obfuscator, 3, [&](uint64_t ishard, const thorp::PermutationPair* block, std::size_t count) {
+			CHECK(ishard >= last_shard);
+			CHECK(count <= thorp::export_block_size);
+			last_shard = ishard;
+			pairs.insert(pairs.end(), block, block + count);
+			}, pool);
+		CHECK(last_shard == 2);
+		check_permutation(obfuscator, pairs);
+	};
+
+	SUBCASE("export_shard of a single message") {
+		const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, std::numeric_limits<uint64_t>::max());
+		std::vector<thorp::PermutationPair> pairs;
+		thorp::export_shard(obfuscator, thorp::Shard{ std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint64_t>::max() },
+			[&](const thorp::PermutationPair* block, std::size_t count) { pairs.insert(pairs.end(), block, block + count); });
+		REQUIRE(pairs.size() == 1);
+		CHECK(pairs[0].cyphertext == std::numeric_limits<uint64_t>::max());
+		CHECK(pairs[0].plaintext == obfuscator.decrypt(std::numeric_limits<uint64_t>::max()));
+	};
+
+#if !defined(_WIN32)
+	SUBCASE("one process per shard") {
+		const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(7, (1ull << 14) - 1);
+		const uint64_t nshards = 3;
+		const std::vector<thorp::Shard> shards = thorp::partition_domain(obfuscator.max_message(), nshards);
+		auto shard_path = [](uint64_t ishard) { return "thorp_partition_test." + std::to_string(ishard) + ".bin"; };
+		std::vector<pid_t> children;
+		for (uint64_t ishard = 0; ishard < nshards; ++ishard) {
+			const pid_t pid = fork();
+			REQUIRE(pid >= 0);
+			if (pid == 0) {
+				// the child has none of the worker threads of the parent, it brings its own pool.
+				int status = 0;
+				try {
+					thorp::WorkStealingPool pool{ 2 };
+					thorp::write_shard_file(shard_path(ishard), obfuscator, shards[ishard], pool);
+				}
+				catch (...) {
+					status = 1;
+				};
+				_exit(status);
+			};
+			children.push_back(pid);
+		};
+		for (pid_t pid : children) {
+			int status = 0;
+			REQUIRE(waitpid(pid, &status, 0) == pid);
+			CHECK(WIFEXITED(status));
+			CHECK(WEXITSTATUS(status) == 0);
+		};
+		std::vector<thorp::PermutationPair> pairs;
+		for (uint64_t ishard = 0; ishard < nshards; ++ishard) {
+			std::FILE* file = std::fopen(shard_path(ishard).c_str(), "rb");
+			REQUIRE(file != nullptr);
+			thorp::PermutationPair pair{};
+			while (std::fread(&pair, sizeof(pair), 1, file) == 1) {
+				pairs.push_back(pair);
+			};
+			std::fclose(file);
+			std::remove(shard_path(ishard).c_str());
+		};
+		check_permutation(obfuscator, pairs);
+	};
+#endif
+};
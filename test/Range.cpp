@@ -0,0 +1,64 @@
+#include "ThorpShuffler.hpp"
+#include <doctest/doctest.h>
+
+
+TEST_CASE("range encryption") {
+	sodium_init();
+	for (thorp::RoundFunction round_function : { thorp::RoundFunction::blake2b, thorp::RoundFunction::aes128, thorp::RoundFunction::siphash24 }) {
+		if (!thorp::round_function_supported(round_function)) continue;
+		const uint64_t opt_level = thorp::OptThorpObfuscator::optimization_level_max_for(round_function);
+
+		SUBCASE("small domain") {
+			// more messages than hash inputs per opt round, the whole table is hashed.
+			const uint64_t max_message = (1ull << 10) - 1;
+			for (uint64_t level = 1; level <= opt_level; ++level) {
+				const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, max_message, 3, level, round_function);
+				std::vector<uint64_t> encrypted(max_message + 1);
+				std::vector<uint64_t> decrypted(300);
+				obfuscator.encrypt_range(0, encrypted.size(), encrypted.data());
+				obfuscator.decrypt_range(500, decrypted.size(), decrypted.data());
+				for (uint64_t message = 0; message <= max_message; ++message) {
+					CHECK(encrypted[message] == obfuscator.encrypt(message));
+				};
+				for (uint64_t i = 0; i < decrypted.size(); ++i) {
+					CHECK(decrypted[i] == obfuscator.decrypt(500 + i));
+				};
+			};
+		};
+
+		SUBCASE("mid-size domain") {
+			// between projector/4 and projector messages at the largest level: fewer messages than hash inputs
+			// per opt round, only some hashes are shared and the distinct inputs are collected.
+			const uint64_t max_message = (1ull << 21) - 1;
+			const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, max_message, round_function);
+			const uint64_t projector = (max_message / 2 + 1) >> (opt_level - 1);
+			const uint64_t first = 123457;
+			std::vector<uint64_t> encrypted(projector / 2 + 3);
+			REQUIRE(encrypted.size() >= projector / 4);
+			REQUIRE(encrypted.size() < projector);
+			obfuscator.encrypt_range(first, encrypted.size(), encrypted.data());
+			std::vector<uint64_t> decrypted(encrypted.size());
+			obfuscator.decrypt_range(first, decrypted.size(), decrypted.data());
+			for (uint64_t i = 0; i < encrypted.size(); ++i) {
+				CHECK(encrypted[i] == obfuscator.encrypt(first + i));
+				CHECK(decrypted[i] == obfuscator.decrypt(first + i));
+			};
+		};
+
+		SUBCASE("large domain") {
+			// far fewer messages than hash inputs (shares_hashes is false), the range falls back to encrypt_batch.
+			const uint64_t max_message = std::numeric_limits<uint64_t>::max();
+			const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, max_message, round_function);
+			std::vector<uint64_t> encrypted(100);
+			obfuscator.encrypt_range(max_message - 99, encrypted.size(), encrypted.data());
+			for (uint64_t i = 0; i < encrypted.size(); ++i) {
+				CHECK(encrypted[i] == obfuscator.encrypt(max_message - 99 + i));
+			};
+			std::vector<uint64_t> decrypted(100);
+			obfuscator.decrypt_range(1234, decrypted.size(), decrypted.data());
+			for (uint64_t i = 0; i < decrypted.size(); ++i) {
+				CHECK(decrypted[i] == obfuscator.decrypt(1234 + i));
+			};
+		};
+	};
+};
@@ -0,0 +1,81 @@
+#include "ThorpRegistry.hpp"
+#include <doctest/doctest.h>
+#include <thread>
+
+
+TEST_CASE("ObfuscatorRegistry") {
+	sodium_init();
+	const uint64_t max_message = (1ull << 20) - 1;
+
+	SUBCASE("hits and misses") {
+		thorp::ObfuscatorRegistry registry{ 16, 4 };
+		const auto first = registry.get({ 4, max_message });
+		const auto second = registry.get({ 4, max_message });
+		const auto other = registry.get({ 4, max_message, 3, 2 });
+		CHECK(first == second);
+		CHECK(first != other);
+		const auto expected = thorp::OptThorpObfuscator::from_uint64(4, max_message);
+		const auto expected_other = thorp::OptThorpObfuscator::from_uint64(4, max_message, 3, 2);
+		for (uint64_t message : { 0u, 1u, 12345u }) {
+			CHECK(first->encrypt(message) == expected.encrypt(message));
+			CHECK(other->encrypt(message) == expected_other.encrypt(message));
+		};
+		const thorp::RegistryStats stats = registry.stats();
+		CHECK(stats.hits == 1);
+		CHECK(stats.misses == 2);
+		CHECK(stats.evictions == 0);
+		CHECK(stats.size == 2);
+	};
+
+	SUBCASE("the default level is the largest of the round function") {
+		thorp::ObfuscatorRegistry registry{ 16, 4 };
+		for (auto round_function : { thorp::RoundFunction::siphash24, thorp::RoundFunction::aes128 }) {
+			if (!thorp::round_function_supported(round_function)) continue;
+			const uint64_t level = thorp::OptThorpObfuscator::optimization_level_max_for(round_function);
+			const auto defaulted = registry.get({ 4, max_message, 8, 0, round_function });
+			CHECK(defaulted->optimization_level() == level);
+			CHECK(registry.get({ 4, max_message, 8, level, round_function }) == defaulted);
+			CHECK(defaulted->encrypt(12345) == thorp::OptThorpObfuscator::from_uint64(4, max_message, 8, level, round_function).encrypt(12345));
+		};
+	};
+
+	SUBCASE("least recently used is evicted") {
+		thorp::ObfuscatorRegistry registry{ 2, 1 };
+		const auto first = registry.get({ 1, max_message });
+		registry.get({ 2, max_message });
+		registry.get({ 1, max_message });
+		registry.get({ 3, max_message }); // evicts 2
+		CHECK(registry.stats().evictions == 1);
+		CHECK(registry.stats().size == 2);
+		CHECK(registry.get({ 1, max_message }) == first);
+		const uint64_t misses = registry.stats().misses;
+		registry.get({ 2, max_message });
+		CHECK(registry.stats().misses == misses + 1);
+		// evicted obfuscators stay usable by whoever holds them.
+		registry.clear();
+		CHECK(registry.stats().size == 0);
+		CHECK(first->decrypt(first->encrypt(77)) == 77);
+	};
+
+	SUBCASE("concurrent lookups") {
+		thorp::ObfuscatorRegistry registry{ 256, 4 };
+		std::vector<std::thread> threads;
+		std::vector<uint64_t> results(8);
+		for (unsigned ithread = 0; ithread < results.size(); ++ithread) {
+			threads.emplace_back([&registry, &results, ithread, max_message]() {
+				uint64_t checksum = 0;
+				for (uint64_t i = 0; i < 200; ++i) {
+					checksum ^= registry.get({ i % 32, max_message })->encrypt(i);
+				};
+				results[ithread] = checksum;
+				});
+		};
+		for (auto& thread : threads) thread.join();
+		for (uint64_t result : results) {
+			CHECK(result == results[0]);
+		};
+		const thorp::RegistryStats stats = registry.stats();
+		CHECK(stats.hits + stats.misses == 8 * 200);
+		CHECK(stats.size == 32);
+	};
+};
@@ -0,0 +1,134 @@
+#include "ThorpShuffler.hpp"
+#include "ThorpRoundFunction.hpp"
+#include "ThorpKeySet.hpp"
+#include <doctest/doctest.h>
+#include <stdexcept>
+
+
+TEST_CASE("round function known answers") {
+	sodium_init();
+	std::array<thorp::byte_t, 16> key{};
+	for (std::size_t i = 0; i < key.size(); ++i) key[i] = static_cast<thorp::byte_t>(i);
+
+	SUBCASE("optimization levels") {
+		CHECK(thorp::OptThorpObfuscator::optimization_level_max_for(thorp::RoundFunction::blake2b) == 7);
+		CHECK(thorp::OptThorpObfuscator::optimization_level_max_for(thorp::RoundFunction::aes128) == 5);
+		CHECK(thorp::OptThorpObfuscator::optimization_level_max_for(thorp::RoundFunction::siphash24) == 4);
+		CHECK(thorp::round_function_supported(thorp::fastest_round_function()));
+	};
+
+	SUBCASE("siphash24") {
+		// the reference test vector of the siphash paper for the message 00 01 .. 07.
+		const std::array<thorp::byte_t, 8> expected{ 0x62, 0x24, 0x93, 0x9a, 0x79, 0xf5, 0xf5, 0x93 };
+		std::array<thorp::byte_t, 8> actual{};
+		thorp::detail::round_hash(thorp::RoundFunction::siphash24, actual.data(), actual.size(), 0x0706050403020100ull, key.data());
+		CHECK(actual == expected);
+	};
+
+	SUBCASE("blake2b") {
+		const std::array<thorp::byte_t, 16> expected{
+			0x73, 0xb0, 0xe1, 0x1b, 0x7d, 0xa3, 0x0a, 0x83, 0xc3, 0xa3, 0x06, 0xd5, 0x3f, 0x57, 0x42, 0xe6 };
+		const std::vector<thorp::byte_t> prepared_key = thorp::detail::prepare_round_keys(thorp::RoundFunction::blake2b, key.data(), 1, 16);
+		std::array<thorp::byte_t, 16> actual{};
+		thorp::detail::round_hash(thorp::RoundFunction::blake2b, actual.data(), actual.size(), 0x0706050403020100ull, prepared_key.data());
+		CHECK(actual == expected);
+	};
+
+	if (thorp::round_function_supported(thorp::RoundFunction::aes128)) {
+		SUBCASE("aes128") {
+			// FIPS-197 appendix C.1
+			const std::array<thorp::byte_t, 16> plaintext{
+				0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+			const std::array<thorp::byte_t, 16> expected{
+				0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+			const std::vector<thorp::byte_t> prepared_key = thorp::detail::prepare_round_keys(thorp::RoundFunction::aes128, key.data(), 1, 16);
+			std::array<thorp::byte_t, 16> actual{};
+			thorp::detail::aes128_encrypt_block(actual.data(), plaintext.data(), prepared_key.data());
+			CHECK(actual == expected);
+			// the message is zero padded to a block.
+			std::array<thorp::byte_t, 16> padded{};
+			padded[0] = 0x2a;
+			std::array<thorp::byte_t, 16> expected_hash{};
+			thorp::detail::aes128_encrypt_block(expected_hash.data(), padded.data(), prepared_key.data());
+			thorp::detail::round_hash(thorp::RoundFunction::aes128, actual.data(), actual.size(), 0x2a, prepared_key.data());
+			CHECK(actual == expected_hash);
+		};
+	};
+};
+
+
+TEST_CASE("round functions") {
+	sodium_init();
+	struct Pinned {
+		thorp::RoundFunction round_function;
+		uint64_t opt_encrypted_0;
+		uint64_t opt_encrypted_234112341;
+		uint64_t encrypted_0;
+		uint64_t encrypted_234112341;
+	};
+	// pins the outputs of the obfuscators for key 4 on the full 64 bit domain.
+	const std::array<Pinned, 3> pinned_outputs{ {
+		{ thorp::RoundFunction::blake2b, 0xe780572b98733e76ull, 0xfb0f8632ce593064ull, 0xfa2105264f6c6a66ull, 0xe831df4705754e5eull },
+		{ thorp::RoundFunction::aes128, 0x2a2e4df1d2696fa4ull, 0x4f5d6b5a55305a08ull, 0xc757353f77b29901ull, 0x431c0476c6c24e90ull },
+		{ thorp::RoundFunction::siphash24, 0x808001b41e33783full, 0xe942b8c6ac1c615cull, 0x1d2bdd526011a865ull, 0x742e4bebd9ec4aaeull },
+	} };
+	for (const Pinned& pinned : pinned_outputs) {
+		if (!thorp::round_function_supported(pinned.round_function)) continue;
+		const thorp::RoundFunction round_function = pinned.round_function;
+
+		SUBCASE("pinned outputs") {
+			auto opt_obfuscator = thorp::OptThorpObfuscator::from_uint64(4, std::numeric_limits<uint64_t>::max(), round_function);
+			auto obfuscator = thorp::ThorpObfuscator::from_uint64(4, std::numeric_limits<uint64_t>::max(), round_function);
+			CHECK(opt_obfuscator.encrypt(0) == pinned.opt_encrypted_0);
+			CHECK(opt_obfuscator.encrypt(234112341) == pinned.opt_encrypted_234112341);
+			CHECK(obfuscator.encrypt(0) == pinned.encrypted_0);
+			CHECK(obfuscator.encrypt(234112341) == pinned.encrypted_234112341);
+		};
+
+		SUBCASE("all paths agree") {
+			const uint64_t max_message = (1ull << 12) - 1;
+			std::vector<uint64_t> messages(max_message + 1);
+			std::iota(messages.begin(), messages.end(), 0);
+			auto opt_obfuscator = thorp::OptThorpObfuscator::from_uint64(4, max_message, round_function);
+			auto obfuscator = thorp::ThorpObfuscator::from_uint64(4, max_message, round_function);
+			std::vector<uint64_t> opt_batch(messages.size());
+			std::vector<uint64_t> opt_domain(messages.size());
+			std::vector<uint64_t> batch(messages.size());
+			std::vector<uint64_t> domain(messages.size());
+			opt_obfuscator.encrypt_batch(messages.data(), opt_batch.data(), messages.size());
+			opt_obfuscator.permute_domain(opt_domain.data());
+			obfuscator.encrypt_batch(messages.data(), batch.data(), messages.size());
+			obfuscator.permute_domain(domain.data());
+			for (uint64_t message : messages) {
+				const uint64_t opt_encrypted = opt_obfuscator.encrypt(message);
+				CHECK(opt_batch[message] == opt_encrypted);
+				CHECK(opt_domain[message] == opt_encrypted);
+				CHECK(opt_obfuscator.decrypt(opt_encrypted) == message);
+				const uint64_t encrypted = obfuscator.encrypt(message);
+				CHECK(batch[message] == encrypted);
+				CHECK(domain[message] == encrypted);
+				CHECK(obfuscator.decrypt(encrypted) == message);
+			};
+		};
+	};
+};
+
+TEST_CASE("unsupported round functions are rejected") {
+	sodium_init();
+	for (const auto round_function : { thorp::RoundFunction::blake2b, thorp::RoundFunction::aes128, thorp::RoundFunction::siphash24 }) {
+		const uint64_t max_message = 1023;
+		if (thorp::round_function_supported(round_function)) {
+			CHECK_NOTHROW(thorp::require_round_function_supported(round_function));
+			CHECK_NOTHROW(thorp::ThorpObfuscator::from_uint64(1, max_message, round_function));
+			CHECK_NOTHROW(thorp::OptThorpObfuscator::from_uint64(1, max_message, round_function));
+			CHECK_NOTHROW(thorp::KeySet::from_uint64({ 1, 2 }, max_message, round_function));
+		}
+		else {
+			// not just an assert, release builds must not run the rounds on a missing instruction set.
+			CHECK_THROWS_AS(thorp::require_round_function_supported(round_function), std::invalid_argument);
+			CHECK_THROWS_AS(thorp::ThorpObfuscator::from_uint64(1, max_message, round_function), std::invalid_argument);
+			CHECK_THROWS_AS(thorp::OptThorpObfuscator::from_uint64(1, max_message, round_function), std::invalid_argument);
+			CHECK_THROWS_AS(thorp::KeySet::from_uint64({ 1, 2 }, max_message, round_function), std::invalid_argument);
+		};
+	};
+};
@@ -0,0 +1,80 @@
+#include "ThorpShuffledView.hpp"
+#include <doctest/doctest.h>
+#include <algorithm>
+
+
+TEST_CASE("shuffled view") {
+	sodium_init();
+	const uint64_t max_message = (1ull << 10) - 1;
+	std::vector<uint64_t> data(max_message + 1);
+	std::iota(data.begin(), data.end(), 0);
+	auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, max_message);
+	auto view = thorp::make_shuffled_view(data, obfuscator);
+	REQUIRE(view.size() == data.size());
+
+	SUBCASE("indexing and iteration") {
+		std::size_t index = 0;
+		for (uint64_t value : view) {
+			CHECK(value == obfuscator.encrypt(index));
+			CHECK(view[index] == value);
+			++index;
+		};
+		CHECK(index == data.size());
+		auto it = view.end();
+		for (std::size_t i = data.size(); i-- > 0;) {
+			--it;
+			CHECK(*it == obfuscator.encrypt(i));
+			CHECK(view.begin()[i] == *it);
+		};
+	};
+
+	SUBCASE("copies share the blocks of their traversal") {
+		using iterator = decltype(view.begin());
+		CHECK(sizeof(iterator) <= 2 * sizeof(void*) + sizeof(std::size_t) + sizeof(std::shared_ptr<int>));
+		// two ends walking towards each other, as in a partition.
+		auto left = view.begin();
+		auto right = view.end();
+		std::size_t ileft = 0;
+		std::size_t iright = data.size();
+		while (ileft < iright) {
+			CHECK(*left++ == obfuscator.encrypt(ileft++));
+			if (ileft < iright) {
+				CHECK(*--right == obfuscator.encrypt(--iright));
+			};
+		};
+		std::vector<uint64_t> reversed(data.size());
+		std::copy(std::make_reverse_iterator(view.end()), std::make_reverse_iterator(view.begin()), reversed.begin());
+		for (std::size_t i = 0; i < data.size(); ++i) {
+			CHECK(reversed[data.size() - 1 - i] == obfuscator.encrypt(i));
+		};
+	};
+
+	SUBCASE("gather and scatter") {
+		std::vector<uint64_t> gathered(data.size());
+		view.gather(gathered.begin());
+		for (std::size_t i = 0; i < data.size(); ++i) {
+			CHECK(gathered[i] == obfuscator.encrypt(i));
+		};
+		std::vector<uint64_t> scattered(data.size());
+		thorp::make_shuffled_view(scattered, obfuscator).scatter(gathered.begin());
+		CHECK(scattered == data);
+	};
+
+	SUBCASE("algorithms") {
+		// sorting through the view writes the sorted values to the shuffled positions.
+		std::sort(view.begin(), view.end(), std::greater<>{});
+		for (std::size_t i = 0; i < data.size(); ++i) {
+			CHECK(data[obfuscator.encrypt(i)] == max_message - i);
+		};
+	};
+
+	SUBCASE("const data") {
+		const std::vector<uint64_t>& const_data = data;
+		thorp::ThorpObfuscator thorp_obfuscator = thorp::ThorpObfuscator::from_uint64(4, max_message);
+		auto const_view = thorp::make_shuffled_view(const_data, thorp_obfuscator);
+		std::vector<uint64_t> gathered;
+		const_view.gather(std::back_inserter(gathered));
+		CHECK(std::equal(const_view.begin(), const_view.end(), gathered.begin(), gathered.end()));
+		CHECK(std::find(const_view.begin(), const_view.end(), const_data[thorp_obfuscator.encrypt(17)]) - const_view.begin() == 17);
+	};
+};
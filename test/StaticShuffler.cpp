@@ -0,0 +1,53 @@
+#include "ThorpStaticShuffler.hpp"
+#include <doctest/doctest.h>
+
+namespace {
+	// the static obfuscator has to agree with the runtime one for the same keys.
+	template <uint64_t MaxMessage, uint64_t Passes, uint64_t OptLevel, thorp::RoundFunction Rf = thorp::RoundFunction::blake2b>
+	void check_against_runtime(const std::vector<uint64_t>& messages)
+	{
+		if (!thorp::round_function_supported(Rf)) return;
+		std::vector<thorp::byte_t> key_vec(10000);
+		for (std::size_t i = 0; i < key_vec.size(); ++i) key_vec[i] = static_cast<thorp::byte_t>(i * 31 + 7);
+		const thorp::StaticOptThorpObfuscator<MaxMessage, Passes, OptLevel, Rf> static_obfuscator{ key_vec };
+		const thorp::OptThorpObfuscator obfuscator{ key_vec, MaxMessage, Passes, OptLevel, Rf };
+		for (uint64_t message : messages) {
+			if (message > MaxMessage) continue;
+			const uint64_t encrypted = static_obfuscator.encrypt(message);
+			CHECK(encrypted == obfuscator.encrypt(message));
+			CHECK(static_obfuscator.decrypt(encrypted) == message);
+		};
+	}
+}
+
+TEST_CASE("StaticOptThorpObfuscator") {
+	sodium_init();
+	const std::vector<uint64_t> messages{ 0, 1, 2, 3, 5, 100, 255, 383, 4095, 234112341, std::numeric_limits<uint64_t>::max() };
+
+	SUBCASE("from_uint64") {
+		constexpr uint64_t max_message = std::numeric_limits<uint64_t>::max();
+		const auto static_obfuscator = thorp::StaticOptThorpObfuscator<max_message, 8, 7>::from_uint64(4);
+		const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, max_message);
+		CHECK(static_obfuscator.encrypt(0) == 0xe780572b98733e76ull);
+		for (uint64_t message : messages) {
+			CHECK(static_obfuscator.encrypt(message) == obfuscator.encrypt(message));
+			CHECK(static_obfuscator.decrypt(obfuscator.encrypt(message)) == message);
+		};
+	};
+
+	SUBCASE("power of two domains") {
+		check_against_runtime<1, 2, 1>(messages);
+		check_against_runtime<3, 2, 2>(messages);
+		check_against_runtime<255, 3, 3>(messages);
+		check_against_runtime<4095, 8, 5>(messages);
+		check_against_runtime<(1ull << 33) - 1, 2, 7>(messages);
+	};
+
+	SUBCASE("other domains") {
+		// half of the domain is 3*2^6, the round count is not a multiple of the optimization level.
+		check_against_runtime<383, 3, 7>(messages);
+		check_against_runtime<383, 4, 4>(messages);
+		check_against_runtime<4095, 3, 5, thorp::RoundFunction::aes128>(messages);
+		check_against_runtime<4095, 3, 4, thorp::RoundFunction::siphash24>(messages);
+	};
+};
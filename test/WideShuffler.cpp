@@ -0,0 +1,132 @@
+#include "ThorpWideShuffler.hpp"
+#include <doctest/doctest.h>
+#include <set>
+
+namespace {
+	std::vector<thorp::byte_t> test_keys()
+	{
+		std::vector<thorp::byte_t> key_vec(10000);
+		for (std::size_t i = 0; i < key_vec.size(); ++i) key_vec[i] = static_cast<thorp::byte_t>(i * 31 + 7);
+		return key_vec;
+	}
+
+	// the 64 bit instantiation has to agree with OptThorpObfuscator for the same keys.
+	void check_against_runtime(uint64_t max_message, uint64_t npasses, uint64_t optimization_level,
+		thorp::RoundFunction round_function = thorp::RoundFunction::blake2b)
+	{
+		if (!thorp::round_function_supported(round_function)) return;
+		const thorp::BasicOptThorpObfuscator<uint64_t> wide_obfuscator{ test_keys(), max_message, npasses, optimization_level, round_function };
+		const thorp::OptThorpObfuscator obfuscator{ test_keys(), max_message, npasses, optimization_level, round_function };
+		for (uint64_t message : std::vector<uint64_t>{ 0, 1, 2, 3, 100, 383, 4095, 234112341 }) {
+			if (message > max_message) continue;
+			const uint64_t encrypted = wide_obfuscator.encrypt(message);
+			CHECK(encrypted == obfuscator.encrypt(message));
+			CHECK(wide_obfuscator.decrypt(encrypted) == message);
+		};
+	}
+}
+
+TEST_CASE("BasicOptThorpObfuscator<uint64_t>") {
+	sodium_init();
+
+	SUBCASE("from_uint64") {
+		const auto wide_obfuscator = thorp::BasicOptThorpObfuscator<uint64_t>::from_uint64(4, std::numeric_limits<uint64_t>::max());
+		const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(4, std::numeric_limits<uint64_t>::max());
+		CHECK(wide_obfuscator.encrypt(0) == 0xe780572b98733e76ull);
+		for (uint64_t message : std::vector<uint64_t>{ 1, 234112341, std::numeric_limits<uint64_t>::max() }) {
+			CHECK(wide_obfuscator.encrypt(message) == obfuscator.encrypt(message));
+			CHECK(wide_obfuscator.decrypt(obfuscator.encrypt(message)) == message);
+		};
+	};
+
+	SUBCASE("domains") {
+		check_against_runtime(255, 3, 3);
+		check_against_runtime((1ull << 33) - 1, 2, 7);
+		// half of the domain is 3*2^6, the divisions can't be shifts.
+		check_against_runtime(383, 3, 7);
+		check_against_runtime(383, 4, 4);
+		check_against_runtime(4095, 3, 5, thorp::RoundFunction::aes128);
+		check_against_runtime(4095, 3, 4, thorp::RoundFunction::siphash24);
+	};
+};
+
+#if THORP_HAS_INT128
+TEST_CASE("OptThorpObfuscator128") {
+	sodium_init();
+	using thorp::uint128_t;
+
+	SUBCASE("round_hash_wide") {
+		std::array<thorp::byte_t, 16> key{};
+		for (std::size_t i = 0; i < key.size(); ++i) key[i] = static_cast<thorp::byte_t>(i);
+		std::array<thorp::byte_t, 16> message{};
+		for (std::size_t i = 0; i < message.size(); ++i) message[i] = static_cast<thorp::byte_t>(0xf0 - i);
+		const uint64_t message_lo = 0xe9eaebecedeeeff0ull;
+		const uint64_t message_hi = 0xe1e2e3e4e5e6e7e8ull;
+
+		std::array<thorp::byte_t, 16> expected{};
+		crypto_generichash(expected.data(), expected.size(), message.data(), message.size(), key.data(), key.size());
+		const std::vector<thorp::byte_t> prepared_key = thorp::detail::prepare_round_keys(thorp::RoundFunction::blake2b, key.data(), 1, 16);
+		std::array<thorp::byte_t, 16> actual{};
+		thorp::detail::round_hash_wide(thorp::RoundFunction::blake2b, actual.data(), actual.size(), message_lo, message_hi, prepared_key.data());
+		CHECK(actual == expected);
+
+		std::array<thorp::byte_t, 8> expected_siphash{};
+		crypto_shorthash(expected_siphash.data(), message.data(), message.size(), key.data());
+		std::array<thorp::byte_t, 8> actual_siphash{};
+		thorp::detail::round_hash_wide(thorp::RoundFunction::siphash24, actual_siphash.data(), actual_siphash.size(), message_lo, message_hi, key.data());
+		CHECK(actual_siphash == expected_siphash);
+	};
+
+	SUBCASE("uuid domain") {
+		const uint128_t max_message = ~uint128_t{ 0 };
+		const auto obfuscator = thorp::OptThorpObfuscator128::from_uint64(4, max_message);
+		CHECK(obfuscator.max_message() == max_message);
+		const uint128_t big = (uint128_t{ 0x0123456789abcdefull } << 64) | 0xfedcba9876543210ull;
+		std::set<uint128_t> encrypted;
+		for (uint128_t message : { uint128_t{ 0 }, uint128_t{ 1 }, uint128_t{ 2 }, big, max_message - 1, max_message }) {
+			const uint128_t cyphertext = obfuscator.encrypt(message);
+			CHECK(obfuscator.decrypt(cyphertext) == message);
+			encrypted.insert(cyphertext);
+		};
+		CHECK(encrypted.size() == 6);
+		// the upper half of the cyphertexts is used, the domain is not folded into 64 bits.
+		CHECK((obfuscator.encrypt(0) >> 64) != 0);
+	};
+
+	SUBCASE("bijection") {
+		for (uint64_t optimization_level : { 1, 4, 7 }) {
+			const auto obfuscator = thorp::OptThorpObfuscator128::from_uint64(9, 4095, 3, optimization_level);
+			std::set<uint128_t> encrypted;
+			for (uint128_t message = 0; message <= 4095; ++message) {
+				const uint128_t cyphertext = obfuscator.encrypt(message);
+				CHECK(cyphertext <= 4095);
+				CHECK(obfuscator.decrypt(cyphertext) == message);
+				encrypted.insert(cyphertext);
+			};
+			CHECK(encrypted.size() == 4096);
+		};
+		// no power of two halves, the divisions are real 128 bit divisions.
+		const auto obfuscator = thorp::OptThorpObfuscator128::from_uint64(9, 383, 3, 7);
+		std::set<uint128_t> encrypted;
+		for (uint128_t message = 0; message <= 383; ++message) {
+			const uint128_t cyphertext = obfuscator.encrypt(message);
+			CHECK(obfuscator.decrypt(cyphertext) == message);
+			encrypted.insert(cyphertext);
+		};
+		CHECK(encrypted.size() == 384);
+	};
+
+	SUBCASE("aes128 and siphash24") {
+		for (thorp::RoundFunction round_function : { thorp::RoundFunction::aes128, thorp::RoundFunction::siphash24 }) {
+			if (!thorp::round_function_supported(round_function)) continue;
+			const uint128_t max_message = (uint128_t{ 1 } << 100) - 1;
+			const auto obfuscator = thorp::OptThorpObfuscator128::from_uint64(5, max_message, round_function);
+			for (uint128_t message : { uint128_t{ 0 }, uint128_t{ 77 }, max_message }) {
+				const uint128_t cyphertext = obfuscator.encrypt(message);
+				CHECK(cyphertext <= max_message);
+				CHECK(obfuscator.decrypt(cyphertext) == message);
+			};
+		};
+	};
+};
+#endif
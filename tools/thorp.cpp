@@ -0,0 +1,413 @@
+#include <sodium.h>
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ThorpIdStream.hpp"
+#include "ThorpParallel.hpp"
+#include "ThorpPartition.hpp"
+#include "ThorpShuffler.hpp"
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// encrypts or decrypts a stream of ids with OptThorpObfuscator::from_uint64(key, max_message, passes, level, round_function),
+// or exports the (plaintext, cyphertext) pairs of shards of its permutation.
+//
+// usage: thorp encrypt|decrypt --key n [--max-message n] [--passes n] [--level n] [--round-function blake2b|aes128|siphash24]
+//              [--format binary|decimal|hex] [--input-format ...] [--output-format ...]
+//              [--input file] [--output file] [--threads n]
+//        thorp export --key n --shards n [--shard i] [--max-message n] ... [--format ...] [--output file] [--threads n]
+//
+// the formats are those of ThorpIdStream.hpp: binary ids are little endian uint64, text ids are one per line
+// (hex with or without 0x), empty lines are skipped.
+// input and output default to stdin and stdout, so thorp can sit in a pipeline.
+//
+// export cuts the cyphertext domain into --shards shards (partition_domain) and writes the pairs of shard --shard,
+// or of all shards one after the other, in cyphertext order: "plaintext cyphertext" lines or two binary ids per pair.
+// one process per shard ("thorp export --shards 8 --shard $i") spreads a shuffle over workers.
+//
+// three stages run at once: the reader parses batches of ids (from a memory mapping for regular files),
+// the worker encrypts each batch with parallel_encrypt on a WorkStealingPool and the writer formats
+// the batches into a large buffer. bounded queues between them keep the memory use flat.
+// a batch is batch_chunks_per_worker chunks (parallel_chunk_size ids) for every worker of the pool, so every
+// worker has chunks of each batch to encrypt (and to steal).
+
+namespace {
+    struct Options {
+        bool decrypt = false;
+        bool export_pairs = false;
+        uint64_t nshards = 0;
+        std::optional<uint64_t> shard;
+        std::optional<uint64_t> key;
+        uint64_t max_message = std::numeric_limits<uint64_t>::max();
+        uint64_t npasses = 8;
+        uint64_t optimization_level = 0; // 0 for the largest level of the round function
+        thorp::RoundFunction round_function = thorp::RoundFunction::blake2b;
+        thorp::IdFormat input_format = thorp::IdFormat::decimal;
+        thorp::IdFormat output_format = thorp::IdFormat::decimal;
+        std::string input;
+        std::string output;
+        unsigned threads = 0;
+    };
+
+    constexpr std::size_t batch_chunks_per_worker = 2;
+    constexpr std::size_t read_block_size = 1 << 20;
+    constexpr std::size_t queue_depth = 4;
+
+    thorp::RoundFunction parse_round_function(const std::string& name)
+    {
+        if (name == "aes128") return thorp::RoundFunction::aes128;
+        if (name == "siphash24") return thorp::RoundFunction::siphash24;
+        if (name == "blake2b") return thorp::RoundFunction::blake2b;
+        throw std::invalid_argument("unknown round function " + name);
+    }
+
+    Options parse_options(int argc, char** argv)
+    {
+        Options options;
+        if (argc < 2) {
+            throw std::invalid_argument("usage: thorp encrypt|decrypt|export --key n [options]");
+        };
+        const std::string mode = argv[1];
+        if (mode != "encrypt" && mode != "decrypt" && mode != "export") {
+            throw std::invalid_argument("unknown mode " + mode + ", expected encrypt, decrypt or export");
+        };
+        options.decrypt = mode == "decrypt";
+        options.export_pairs = mode == "export";
+        for (int iarg = 2; iarg < argc; ++iarg) {
+            const std::string arg = argv[iarg];
+            auto value = [&]() -> std::string {
+                if (iarg + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+                return argv[++iarg];
+            };
+            if (arg == "--key") options.key = std::stoull(value(), nullptr, 0);
+            else if (arg == "--max-message") options.max_message = std::stoull(value(), nullptr, 0);
+            else if (arg == "--passes") options.npasses = std::stoull(value());
+            else if (arg == "--level") options.optimization_level = std::stoull(value());
+            else if (arg == "--round-function") options.round_function = parse_round_function(value());
+            else if (arg == "--format") options.input_format = options.output_format = thorp::parse_id_format(value());
+            else if (arg == "--input-format") options.input_format = thorp::parse_id_format(value());
+            else if (arg == "--output-format") options.output_format = thorp::parse_id_format(value());
+            else if (arg == "--input") options.input = value();
+            else if (arg == "--output") options.output = value();
+            else if (arg == "--threads") options.threads = static_cast<unsigned>(std::stoul(value()));
+            else if (arg == "--shards" && options.export_pairs) options.nshards = std::stoull(value());
+            else if (arg == "--shard" && options.export_pairs) options.shard = std::stoull(value());
+            else throw std::invalid_argument("unknown argument " + arg);
+        };
+        if (!options.key) {
+            throw std::invalid_argument("--key is required");
+        };
+        // the constructors only assert the parameters, release builds would write wrong ids.
+        options.optimization_level = thorp::check_obfuscator_parameters({ options.max_message, options.npasses,
+            options.optimization_level, options.round_function }).optimization_level;
+        if (options.export_pairs && options.nshards == 0) {
+            throw std::invalid_argument("--shards is required");
+        };
+        if (options.shard && *options.shard >= options.nshards) {
+            throw std::invalid_argument("--shard has to be smaller than --shards");
+        };
+        return options;
+    }
+
+    // a queue of at most queue_depth items, pop returns nothing once the queue is closed and empty.
+    template <class T>
+    class BoundedQueue {
+    public:
+        void push(T item)
+        {
+            std::unique_lock<std::mutex> lock{ this->mutex_ };
+            this->not_full_.wait(lock, [this]() { return this->items_.size() < queue_depth || this->closed_; });
+            if (this->closed_) {
+                return;
+            };
+            this->items_.push_back(std::move(item));
+            this->not_empty_.notify_one();
+        }
+        std::optional<T> pop()
+        {
+            std::unique_lock<std::mutex> lock{ this->mutex_ };
+            this->not_empty_.wait(lock, [this]() { return !this->items_.empty() || this->closed_; });
+            if (this->items_.empty()) {
+                return std::nullopt;
+            };
+            T item = std::move(this->items_.front());
+            this->items_.pop_front();
+            this->not_full_.notify_one();
+            return item;
+        }
+        void close()
+        {
+            std::lock_guard<std::mutex> lock{ this->mutex_ };
+            this->closed_ = true;
+            this->not_empty_.notify_all();
+            this->not_full_.notify_all();
+        }
+    private:
+        std::mutex mutex_;
+        std::condition_variable not_empty_;
+        std::condition_variable not_full_;
+        std::deque<T> items_;
+        bool closed_ = false;
+    };
+
+    // the first error of any stage, the others stop once it is set.
+    class ErrorSlot {
+    public:
+        void set(const std::string& message)
+        {
+            std::lock_guard<std::mutex> lock{ this->mutex_ };
+            if (this->message_.empty()) this->message_ = message;
+        }
+        std::string get()
+        {
+            std::lock_guard<std::mutex> lock{ this->mutex_ };
+            return this->message_;
+        }
+    private:
+        std::mutex mutex_;
+        std::string message_;
+    };
+
+    // the bytes of the input: the whole file at once if it can be mapped, blocks of read_block_size otherwise.
+    class Input {
+    public:
+        explicit Input(const std::string& path)
+        {
+            if (path.empty() || path == "-") {
+#if defined(_WIN32)
+                _setmode(_fileno(stdin), _O_BINARY);
+                this->fd_ = _fileno(stdin);
+#else
+                this->fd_ = STDIN_FILENO;
+#endif
+            }
+            else {
+#if defined(_WIN32)
+                this->fd_ = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+                this->fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+                if (this->fd_ < 0) {
+                    throw std::runtime_error("can not open " + path);
+                };
+                this->owns_fd_ = true;
+            };
+#if !defined(_WIN32)
+            // regular files (also when redirected to stdin) are mapped and read sequentially.
+            struct stat file_stat {};
+            if (::fstat(this->fd_, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+                void* const view = ::mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, this->fd_, 0);
+                if (view != MAP_FAILED) {
+                    ::madvise(view, static_cast<std::size_t>(file_stat.st_size), MADV_SEQUENTIAL);
+                    this->mapping_ = static_cast<const char*>(view);
+                    this->mapping_size_ = static_cast<std::size_t>(file_stat.st_size);
+                };
+            };
+#endif
+        }
+        Input(const Input&) = delete;
+        Input& operator=(const Input&) = delete;
+        ~Input()
+        {
+#if !defined(_WIN32)
+            if (this->mapping_ != nullptr) {
+                ::munmap(const_cast<char*>(this->mapping_), this->mapping_size_);
+            };
+            if (this->owns_fd_) ::close(this->fd_);
+#else
+            if (this->owns_fd_) _close(this->fd_);
+#endif
+        }
+        // the next bytes of the input, false at the end.
+        bool next(const char*& data, std::size_t& size)
+        {
+            if (this->mapping_ != nullptr) {
+                if (this->mapping_done_) return false;
+                this->mapping_done_ = true;
+                data = this->mapping_;
+                size = this->mapping_size_;
+                return true;
+            };
+            this->buffer_.resize(read_block_size);
+#if defined(_WIN32)
+            const int nread = _read(this->fd_, this->buffer_.data(), static_cast<unsigned>(this->buffer_.size()));
+#else
+            ssize_t nread = 0;
+            do {
+                nread = ::read(this->fd_, this->buffer_.data(), this->buffer_.size());
+            } while (nread < 0 && errno == EINTR);
+#endif
+            if (nread < 0) {
+                throw std::runtime_error("can not read the input");
+            };
+            data = this->buffer_.data();
+            size = static_cast<std::size_t>(nread);
+            return nread > 0;
+        }
+    private:
+        int fd_ = -1;
+        bool owns_fd_ = false;
+        const char* mapping_ = nullptr;
+        std::size_t mapping_size_ = 0;
+        bool mapping_done_ = false;
+        std::vector<char> buffer_;
+    };
+
+    // the file an IdWriter writes to: stdout or a file it opens.
+    class Output {
+    public:
+        explicit Output(const std::string& path)
+        {
+            if (path.empty() || path == "-") {
+#if defined(_WIN32)
+                _setmode(_fileno(stdout), _O_BINARY);
+#endif
+                this->file_ = stdout;
+            }
+            else {
+                this->file_ = std::fopen(path.c_str(), "wb");
+                if (this->file_ == nullptr) {
+                    throw std::runtime_error("can not open " + path);
+                };
+                this->owns_file_ = true;
+            };
+        }
+        Output(const Output&) = delete;
+        Output& operator=(const Output&) = delete;
+        ~Output()
+        {
+            if (this->owns_file_) std::fclose(this->file_);
+        }
+        std::FILE* file() const noexcept
+        {
+            return this->file_;
+        }
+    private:
+        std::FILE* file_ = nullptr;
+        bool owns_file_ = false;
+    };
+
+    // the pairs are written on the calling thread while the pool decrypts, export_shard streams block by block.
+    int run_export(const Options& options)
+    {
+        const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(*options.key, options.max_message, options.npasses,
+            options.optimization_level, options.round_function);
+        Output output_file{ options.output };
+        thorp::IdWriter output{ output_file.file(), options.output_format };
+        thorp::WorkStealingPool pool{ options.threads };
+        const std::vector<thorp::Shard> shards = thorp::partition_domain(options.max_message, options.nshards);
+        for (uint64_t ishard = 0; ishard < options.nshards; ++ishard) {
+            if (options.shard && *options.shard != ishard) continue;
+            thorp::export_shard(obfuscator, shards[ishard], [&](const thorp::PermutationPair* pairs, std::size_t count) {
+                output.write_pairs(pairs, count);
+                }, pool);
+        };
+        output.close();
+        return 0;
+    }
+
+    int run(const Options& options)
+    {
+        if (options.export_pairs) {
+            return run_export(options);
+        };
+        const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(*options.key, options.max_message, options.npasses,
+            options.optimization_level, options.round_function);
+        Input input{ options.input };
+        Output output_file{ options.output };
+        thorp::IdWriter output{ output_file.file(), options.output_format };
+        thorp::WorkStealingPool pool{ options.threads };
+        const std::size_t batch_size = batch_chunks_per_worker * pool.size() * thorp::parallel_chunk_size;
+        BoundedQueue<std::vector<uint64_t>> parsed;
+        BoundedQueue<std::vector<uint64_t>> encrypted;
+        ErrorSlot error;
+
+        std::thread reader([&]() {
+            try {
+                thorp::IdParser parser{ options.input_format, options.max_message,
+                    [&parsed](std::vector<uint64_t>&& batch) { parsed.push(std::move(batch)); }, batch_size };
+                const char* data = nullptr;
+                std::size_t size = 0;
+                while (error.get().empty() && input.next(data, size)) {
+                    parser.feed(data, size);
+                };
+                parser.finish();
+            }
+            catch (const std::exception& exception) {
+                error.set(exception.what());
+                encrypted.close(); // the writer stops as well.
+            };
+            parsed.close();
+            });
+        std::thread writer([&]() {
+            try {
+                while (auto batch = encrypted.pop()) {
+                    output.write(batch->data(), batch->size());
+                };
+                output.close();
+            }
+            catch (const std::exception& exception) {
+                error.set(exception.what());
+                parsed.close(); // the reader and the worker stop as well.
+                encrypted.close();
+            };
+            });
+        while (auto batch = parsed.pop()) {
+            if (options.decrypt) {
+                thorp::parallel_decrypt(obfuscator, batch->data(), batch->data(), batch->size(), pool);
+            }
+            else {
+                thorp::parallel_encrypt(obfuscator, batch->data(), batch->data(), batch->size(), pool);
+            };
+            encrypted.push(std::move(*batch));
+        };
+        encrypted.close();
+        reader.join();
+        writer.join();
+        const std::string message = error.get();
+        if (!message.empty()) {
+            std::cerr << "thorp: " << message << '\n';
+            return 1;
+        };
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (sodium_init() == -1) {
+        return 1;
+    };
+    Options options;
+    try {
+        options = parse_options(argc, argv);
+    }
+    catch (const std::exception& error) {
+        std::cerr << error.what() << '\n';
+        return 2;
+    };
+    try {
+        return run(options);
+    }
+    catch (const std::exception& error) {
+        std::cerr << "thorp: " << error.what() << '\n';
+        return 1;
+    };
+};
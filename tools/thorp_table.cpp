@@ -0,0 +1,88 @@
+#include <sodium.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "ThorpMappedPermutation.hpp"
+
+// writes the permutation file of OptThorpObfuscator::from_uint64(key, max_message, passes, level, round_function),
+// to be served with MappedPermutation.
+//
+// usage: thorp_table --output file --key n --max-message n [--passes n] [--level n]
+//                    [--round-function blake2b|aes128|siphash24] [--threads n]
+
+namespace {
+    struct Options {
+        std::string output;
+        uint64_t key = 0;
+        uint64_t max_message = 0;
+        uint64_t npasses = 8;
+        uint64_t optimization_level = 0; // 0 for the largest level of the round function
+        thorp::RoundFunction round_function = thorp::RoundFunction::blake2b;
+        unsigned threads = 0;
+    };
+
+    thorp::RoundFunction parse_round_function(const std::string& name)
+    {
+        if (name == "aes128") return thorp::RoundFunction::aes128;
+        if (name == "siphash24") return thorp::RoundFunction::siphash24;
+        if (name == "blake2b") return thorp::RoundFunction::blake2b;
+        throw std::invalid_argument("unknown round function " + name);
+    }
+
+    Options parse_options(int argc, char** argv)
+    {
+        Options options;
+        bool has_key = false;
+        bool has_max_message = false;
+        for (int iarg = 1; iarg < argc; ++iarg) {
+            const std::string arg = argv[iarg];
+            auto value = [&]() -> std::string {
+                if (iarg + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+                return argv[++iarg];
+            };
+            if (arg == "--output") options.output = value();
+            else if (arg == "--key") { options.key = std::stoull(value(), nullptr, 0); has_key = true; }
+            else if (arg == "--max-message") { options.max_message = std::stoull(value(), nullptr, 0); has_max_message = true; }
+            else if (arg == "--passes") options.npasses = std::stoull(value());
+            else if (arg == "--level") options.optimization_level = std::stoull(value());
+            else if (arg == "--round-function") options.round_function = parse_round_function(value());
+            else if (arg == "--threads") options.threads = static_cast<unsigned>(std::stoul(value()));
+            else throw std::invalid_argument("unknown argument " + arg);
+        };
+        if (options.output.empty() || !has_key || !has_max_message) {
+            throw std::invalid_argument("--output, --key and --max-message are required");
+        };
+        // two tables of 8 byte entries, beyond that the file would not fit into memory to begin with.
+        if (options.max_message >= (1ull << 36)) {
+            throw std::invalid_argument("--max-message too large for a permutation table");
+        };
+        if (options.optimization_level == 0) {
+            options.optimization_level = thorp::OptThorpObfuscator::optimization_level_max_for(options.round_function);
+        };
+        return options;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (sodium_init() == -1) {
+        return 1;
+    };
+    Options options;
+    try {
+        options = parse_options(argc, argv);
+    }
+    catch (const std::exception& error) {
+        std::cerr << error.what() << '\n';
+        return 2;
+    };
+    try {
+        const auto obfuscator = thorp::OptThorpObfuscator::from_uint64(
+            options.key, options.max_message, options.npasses, options.optimization_level, options.round_function);
+        thorp::write_permutation_file(options.output, obfuscator, options.threads);
+    }
+    catch (const std::exception& error) {
+        std::cerr << error.what() << '\n';
+        return 1;
+    };
+    return 0;
+};
@@ -3,12 +3,28 @@
 add_requires("doctest")
 add_requires("libsodium")
 
+option("instrumentation")
+    set_default(false)
+    set_showmenu(true)
+    set_description("count hashes, cache hits and rounds of the OptThorpObfuscator (see ThorpInstrumentation.hpp)")
+    add_defines("THORP_INSTRUMENTATION=1")
+option_end()
+
+option("tsan")
+    set_default(false)
+    set_showmenu(true)
+    set_description("build with ThreadSanitizer (gcc and clang), for running the concurrency tests")
+    add_cxflags("-fsanitize=thread", "-fno-omit-frame-pointer")
+    add_ldflags("-fsanitize=thread")
+option_end()
+
 target("example")
     set_kind("binary")
     set_default(false)
     set_languages("cxx17")
     add_files("example/*.cpp"   )
     add_includedirs("include")
+    add_options("instrumentation", "tsan")
     add_packages("libsodium")
     add_deps("static_lib")
     if is_plat("windows")then
@@ -24,6 +40,7 @@ target("test")
     set_languages("cxx17")
     add_files("test/*.cpp")
     add_includedirs("include")
+    add_options("instrumentation", "tsan")
     add_packages("libsodium", "doctest")
     add_deps("static_lib")
     if is_plat("windows")then
@@ -33,12 +50,61 @@ target("test")
         os.cp(target:targetfile(), "$(projectdir)/bin/")
     end)
 
+target("bench")
+    set_kind("binary")
+    set_default(false)
+    set_languages("cxx17")
+    add_files("bench/*.cpp")
+    add_includedirs("include")
+    add_options("instrumentation", "tsan")
+    add_packages("libsodium")
+    add_deps("static_lib")
+    if is_plat("windows")then
+        add_cxxflags("/permissive-","/W4")
+    end
+    after_build(function( target)
+        os.cp(target:targetfile(), "$(projectdir)/bin/")
+    end)
+
+target("thorp_table")
+    set_kind("binary")
+    set_default(false)
+    set_languages("cxx17")
+    add_files("tools/thorp_table.cpp")
+    add_includedirs("include")
+    add_options("instrumentation", "tsan")
+    add_packages("libsodium")
+    add_deps("static_lib")
+    if is_plat("windows")then
+        add_cxxflags("/permissive-","/W4")
+    end
+    after_build(function( target)
+        os.cp(target:targetfile(), "$(projectdir)/bin/")
+    end)
+
+target("thorp")
+    set_kind("binary")
+    set_default(false)
+    set_languages("cxx17")
+    add_files("tools/thorp.cpp")
+    add_includedirs("include")
+    add_options("instrumentation", "tsan")
+    add_packages("libsodium")
+    add_deps("static_lib")
+    if is_plat("windows")then
+        add_cxxflags("/permissive-","/W4")
+    end
+    after_build(function( target)
+        os.cp(target:targetfile(), "$(projectdir)/bin/")
+    end)
+
 target("static_lib")
     set_kind("static")
     set_default(true)
     set_languages("cxx17")
     add_files("src/*.cpp")
     add_includedirs("include")
+    add_options("instrumentation", "tsan")
     add_packages("libsodium")
     if is_plat("windows")then
         add_cxxflags("/permissive-","/W4")